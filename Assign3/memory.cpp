@@ -59,6 +59,20 @@ bool memory::check_illegal(uint32_t addr) const
     }
 }
 
+/**
+ * @brief Check a whole access is within memory.
+ * 
+ * Quietly tests every byte of an access at once, without printing any warnings.
+ * 
+ * @param addr First address of the access.
+ * @param len Number of bytes in the access.
+ * @return true if every byte from addr to addr+len-1 is within the simulated memory.
+ */
+bool memory::in_range(uint32_t addr, uint32_t len) const
+{
+    return addr < mem.size() && mem.size() - addr >= len;
+}
+
 /**
  * @brief Get memory size.
  * 
@@ -92,13 +106,18 @@ uint8_t memory::get8(uint32_t addr) const
 /**
  * @brief Get 16bits of memory.
  * 
- * Call get8() twice to retrieve two bytes then concatenate in little endian order.
+ * Read both bytes directly when they are in range. Otherwise call get8() twice to retrieve two bytes
+ * then concatenate in little endian order, so each out of range byte warns and reads as zero.
  *
  * @param addr Index address to access.
  * @return 16bit integer for contents of address bytes.
  */
 uint16_t memory::get16(uint32_t addr) const
 {
+    if(in_range(addr, 2)) //One check for the whole access.
+    {
+        return mem[addr] | (static_cast<uint16_t>(mem[addr+1]) << 8);
+    }
     std::string tempString = hex::to_hex8(get8(addr+1)) + hex::to_hex8(get8(addr)); //Create string object from concatenated get8() calls.
     uint16_t tempInt = std::stoi(tempString, NULL, 16); //Convert back to integer in hexidecimal form.
     return tempInt;
@@ -107,13 +126,18 @@ uint16_t memory::get16(uint32_t addr) const
 /**
  * @brief Get 32bits of memory.
  * 
- * Call get16() twice to retrieve four bytes then concatenate in little endian order.
+ * Read all four bytes directly when they are in range. Otherwise call get16() twice to retrieve four bytes
+ * then concatenate in little endian order, so each out of range byte warns and reads as zero.
  * 
  * @param addr Index address to access.
  * @return 32bit integer for contents of address bytes.
  */
 uint32_t memory::get32(uint32_t addr) const
 {
+    if(in_range(addr, 4)) //One check for the whole access.
+    {
+        return mem[addr] | (static_cast<uint32_t>(mem[addr+1]) << 8) | (static_cast<uint32_t>(mem[addr+2]) << 16) | (static_cast<uint32_t>(mem[addr+3]) << 24);
+    }
     std::string tempString = hex::to_hex16(get16(addr+2)) + hex::to_hex16(get16(addr)); //Create string object from concatenated get16() calls.
     uint32_t tempInt = std::stol(tempString, NULL, 16); //Convert back to integer in hexidecimal form. 
     return tempInt;
@@ -179,13 +203,20 @@ void memory::set8(uint32_t addr, uint8_t val)
 /**
  * @brief Set 16bits of memory.
  * 
- * Logically shift left and right to isolate target bytes then call set8() to write values.
+ * Write both bytes directly when they are in range. Otherwise logically shift left and right to isolate
+ * target bytes then call set8() to write values, so each out of range byte warns and is dropped.
  * 
  * @param addr Index address to write to.
  * @param val 16bit value to write to memory.
  */
 void memory::set16(uint32_t addr, uint16_t val)
 {
+    if(in_range(addr, 2)) //One check for the whole access.
+    {
+        mem[addr] = val;
+        mem[addr+1] = val >> 8;
+        return;
+    }
     set8(addr+1, val >> 8); //Shift right to cut off right byte.
     set8(addr, (val << 8) >> 8); //Shift left then right to cut off left byte.
 }
@@ -193,13 +224,22 @@ void memory::set16(uint32_t addr, uint16_t val)
 /**
  * @brief Set 32bits of memory.
  * 
- * Logically shift left and right to isolate target bytes then call set16() to write values.
+ * Write all four bytes directly when they are in range. Otherwise logically shift left and right to isolate
+ * target bytes then call set16() to write values, so each out of range byte warns and is dropped.
  * 
  * @param addr Index address to write to.
  * @param val 32bit value to write to memory.
  */
 void memory::set32(uint32_t addr, uint32_t val)
 {
+    if(in_range(addr, 4)) //One check for the whole access.
+    {
+        mem[addr] = val;
+        mem[addr+1] = val >> 8;
+        mem[addr+2] = val >> 16;
+        mem[addr+3] = val >> 24;
+        return;
+    }
     set16(addr+2, val >> 16); //Shift right to cut off right bytes.
     set16(addr, (val << 16) >> 16); //Shift left then right to cut off left bytes.
 }
@@ -241,7 +281,8 @@ void memory::dump() const
 /**
  * @brief Load file into simulated memory.
  * 
- * Attempt to load files into memory.
+ * Attempt to load files into memory. The file size is checked first so an image that does not fit
+ * fails before anything is loaded, then the whole image is brought in with one read.
  * 
  * @param fname Name of file within accessible directory.
  * @return true if file loading was successful and values could be written to memory.
@@ -249,27 +290,24 @@ void memory::dump() const
  */
 bool memory::load_file(const std::string &fname)
 {
-    std::ifstream infile(fname, std::ios::in|std::ios::binary); //Create file object and open file in binary mode.
+    std::ifstream infile(fname, std::ios::in|std::ios::binary|std::ios::ate); //Create file object and open file in binary mode, positioned at the end.
 
-    if(infile.is_open())
+    if(infile.is_open() && infile.tellg() >= 0)
     {
-        uint8_t i;
-        infile >> std::noskipws; //Prep stream extraction.
-        for(uint32_t addr = 0; infile >> i; ++addr)
+        std::streamoff len = infile.tellg(); //Size of the image.
+        if(static_cast<uint64_t>(len) > get_size()) //Check the whole image fits before loading any of it.
         {
-            if(!check_illegal(addr)) //Check validity of index address before writing vlaues.
-            {
-                mem[addr] = i;
-            }
-            else
-            {
-                std::cerr << "Program too big." << std::endl;
-                infile.close(); //Close the file.
-                return false;
-            }
+            check_illegal(get_size()); //Warn about the first byte that does not fit.
+            std::cerr << "Program too big." << std::endl;
+            infile.close(); //Close the file.
+            return false;
         }
+
+        infile.seekg(0);
+        infile.read(reinterpret_cast<char*>(mem.data()), len); //Read the whole image at once.
+        bool ok = infile.gcount() == len;
         infile.close(); //Close the file.
-        return true;
+        return ok;
     }
 
     std::cerr << "Can't open file '"  << fname << "' for reading." << std::endl;
@@ -46,6 +46,8 @@ public:
     bool load_file(const std::string &fname);  //Load file into simulated memory.
 
 private:
+    bool in_range(uint32_t addr, uint32_t len) const;  //Check a whole access is within memory.
+
     std::vector<uint8_t> mem; //Vector to simulate memory.
 };
 
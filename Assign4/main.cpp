@@ -10,6 +10,11 @@
 //***************************************************************************
 #include <iostream>
 #include <sstream>
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <algorithm>
 #include <getopt.h>
 #include "memory.h"
 #include "rv32i_decode.h"
@@ -31,19 +36,63 @@ static void usage()
 	exit(1); //Terminate program.
 }
 
+/**
+ * @brief Disassemble part of memory.
+ * 
+ * @param mem vector object to access and disassemble.
+ * @param begin Address of the first instruction.
+ * @param end Address the range stops before.
+ * @param out String the lines are appended to.
+ */
+static void disassemble_range(const memory &mem, uint32_t begin, uint32_t end, std::string &out)
+{
+	for(uint32_t addr = begin; addr < end; addr+=4)
+	{
+		uint32_t insn = mem.get32(addr);
+		out += hex::to_hex32(addr) + ": ";
+		out += hex::to_hex32(insn) + "  " + rv32i_decode::decode(addr, insn) + "\n";
+	}
+}
+
 /**
  * @brief Disassemble memory.
  * 
+ * Memory is split into fixed size chunks. Batches of chunks are decoded into their own buffers on every
+ * host core, then written in address order, so the output is the same as decoding one word after another.
+ * 
  * @param mem vector object to access and disassemble.
  */
 static void disassemble(const memory &mem)
 {
-	for(uint32_t addr = 0; addr < mem.get_size(); addr+=4)
+	const uint32_t chunk_bytes = 0x4000; //Roughly four thousand lines a chunk.
+	size_t chunks = (static_cast<uint64_t>(mem.get_size()) + chunk_bytes - 1) / chunk_bytes;
+	size_t workers = std::max(1u, std::thread::hardware_concurrency());
+	for(size_t first = 0; first < chunks; first += workers * 4) //Enough chunks per batch to even out the threads.
 	{
-		uint32_t insn = mem.get32(addr);
-		std::cout << hex::to_hex32(addr) << ": ";
-		std::cout << hex::to_hex32(insn) << "  " << rv32i_decode::decode(addr, insn) << std::endl;
+		size_t count = std::min(chunks - first, workers * 4);
+		std::vector<std::string> out(count);
+		std::atomic<size_t> next(0);
+		auto work = [&]()
+		{
+			for(size_t i = next++; i < count; i = next++)
+			{
+				uint64_t begin = (first + i) * chunk_bytes;
+				uint64_t end = std::min<uint64_t>(begin + chunk_bytes, mem.get_size());
+				disassemble_range(mem, begin, end, out[i]);
+			}
+		};
+
+		std::vector<std::thread> threads;
+		for(size_t t = 1; t < std::min(workers, count); ++t)
+			threads.emplace_back(work);
+		work(); //This thread takes chunks too.
+		for(std::thread &t : threads)
+			t.join();
+
+		for(const std::string &s : out)
+			std::cout << s;
 	}
+	std::cout.flush();
 }
 
 /**
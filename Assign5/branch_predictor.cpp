@@ -0,0 +1,380 @@
+//***************************************************************************
+//
+//  Matt Borek
+//  z1951125
+//  CSCI463-1
+//
+//  I certify that this is my own work and where appropriate an extension
+//  of the starter code provided for the assignment.
+//
+//***************************************************************************
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+#include "branch_predictor.h"
+
+/**
+ * @brief Construct the predictor a config describes.
+ *
+ * @param c Kind and size.
+ * @return The new predictor.
+ */
+std::unique_ptr<branch_predictor> branch_predictor::create(const config &c)
+{
+    switch(c.k)
+    {
+        case kind_static:       return std::unique_ptr<branch_predictor>(new static_predictor(c));
+        case kind_bimodal:      return std::unique_ptr<branch_predictor>(new bimodal_predictor(c));
+        case kind_gshare:       return std::unique_ptr<branch_predictor>(new gshare_predictor(c));
+        case kind_tournament:   return std::unique_ptr<branch_predictor>(new tournament_predictor(c));
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Get the kind and size.
+ *
+ * @return Name as parse() accepts it, such as gshare:12, or static.
+ */
+std::string branch_predictor::get_name() const
+{
+    static const char *kinds[] = { "static", "bimodal", "gshare", "tournament" };
+    if(cfg.k == kind_static)
+    {
+        return kinds[cfg.k];
+    }
+    return std::string(kinds[cfg.k]) + ":" + std::to_string(cfg.bits);
+}
+
+/**
+ * @brief Move a two bit saturating counter towards a direction.
+ *
+ * @param counter Counter, 0 and 1 predict not taken, 2 and 3 taken.
+ * @param taken Direction the branch went.
+ */
+void branch_predictor::train(uint8_t &counter, bool taken)
+{
+    if(taken && counter < 3)
+    {
+        ++counter;
+    }
+    else if(!taken && counter > 0)
+    {
+        --counter;
+    }
+}
+
+bool static_predictor::predict(uint32_t pc, uint32_t target) const
+{
+    return target < pc;
+}
+
+void static_predictor::update(uint32_t, bool)
+{
+}
+
+bool bimodal_predictor::predict(uint32_t pc, uint32_t) const
+{
+    return counters[index(pc, cfg.bits)] >= 2;
+}
+
+void bimodal_predictor::update(uint32_t pc, bool taken)
+{
+    train(counters[index(pc, cfg.bits)], taken);
+}
+
+bool gshare_predictor::predict(uint32_t pc, uint32_t) const
+{
+    return counters[index(pc, cfg.bits) ^ history] >= 2;
+}
+
+void gshare_predictor::update(uint32_t pc, bool taken)
+{
+    train(counters[index(pc, cfg.bits) ^ history], taken);
+    history = ((history << 1) | taken) & ((1u << cfg.bits) - 1);
+}
+
+bool tournament_predictor::predict(uint32_t pc, uint32_t target) const
+{
+    return chooser[index(pc, cfg.bits)] >= 2 ? global.predict(pc, target) : local.predict(pc, target);
+}
+
+/**
+ * @brief Train both components, and the chooser when only one of them was right.
+ *
+ * @param pc Address of the branch.
+ * @param taken Direction the branch went.
+ */
+void tournament_predictor::update(uint32_t pc, bool taken)
+{
+    bool local_right = local.predict(pc, 0) == taken;
+    bool global_right = global.predict(pc, 0) == taken;
+    if(local_right != global_right)
+    {
+        train(chooser[index(pc, cfg.bits)], global_right);
+    }
+    local.update(pc, taken);
+    global.update(pc, taken);
+}
+
+/**
+ * @brief Parse a comma separated list of predictors.
+ *
+ * Each item is static, bimodal, gshare or tournament, optionally followed by :bits giving log2 of its
+ * table entries (default 12), all for one of each, or ras:depth to size the return address stack
+ * (default 16).
+ *
+ * @param s Description, such as bimodal:10,gshare:14,ras:8.
+ * @param c Description to fill in.
+ * @return true if s describes at least one predictor.
+ */
+bool branch_unit::parse(const std::string &s, config &c)
+{
+    std::istringstream list(s);
+    std::string item;
+    c.predictors.clear();
+    while(std::getline(list, item, ','))
+    {
+        std::string name = item.substr(0, item.find(':'));
+        uint32_t value = 0;
+        if(name.size() != item.size())
+        {
+            std::istringstream iss(item.substr(name.size() + 1));
+            if(!(iss >> value) || !iss.eof() || value == 0)
+            {
+                return false;
+            }
+        }
+
+        branch_predictor::config p;
+        if(value != 0)
+        {
+            p.bits = value;
+        }
+        if(name == "ras" && value > 0 && value <= 1024)
+        {
+            c.ras_depth = value;
+            continue;
+        }
+        else if(name == "all" && value == 0)
+        {
+            for(branch_predictor::kind k : { branch_predictor::kind_static, branch_predictor::kind_bimodal, branch_predictor::kind_gshare, branch_predictor::kind_tournament })
+            {
+                p.k = k;
+                c.predictors.push_back(p);
+            }
+            continue;
+        }
+        else if(name == "static" && value == 0)
+            p.k = branch_predictor::kind_static;
+        else if(name == "bimodal")
+            p.k = branch_predictor::kind_bimodal;
+        else if(name == "gshare")
+            p.k = branch_predictor::kind_gshare;
+        else if(name == "tournament")
+            p.k = branch_predictor::kind_tournament;
+        else
+            return false;
+
+        if(p.bits > 24) //Keep the tables a sane size.
+        {
+            return false;
+        }
+        c.predictors.push_back(p);
+    }
+    return !c.predictors.empty();
+}
+
+/**
+ * @brief Construct a new branch unit.
+ *
+ * @param c Predictors and return address stack depth, as checked by parse().
+ */
+branch_unit::branch_unit(const config &c) : mispredicts(c.predictors.size()), ras(c.ras_depth)
+{
+    for(const branch_predictor::config &p : c.predictors)
+    {
+        predictors.push_back(branch_predictor::create(p));
+    }
+}
+
+/**
+ * @brief Predict and train on a conditional branch.
+ *
+ * @param pc Address of the branch.
+ * @param target Address it goes to if taken.
+ * @param taken Direction it went.
+ */
+void branch_unit::branch(uint32_t pc, uint32_t target, bool taken)
+{
+    site &s = sites[pc];
+    if(s.mispredicts.empty())
+    {
+        s.mispredicts.resize(predictors.size());
+    }
+    ++s.executed;
+    s.taken += taken;
+    ++branches;
+    this->taken += taken;
+
+    for(size_t i = 0; i < predictors.size(); ++i)
+    {
+        bool missed = predictors[i]->predict(pc, target) != taken;
+        if(missed)
+        {
+            ++mispredicts[i];
+            ++s.mispredicts[i];
+        }
+        if(i == 0) //The first predictor is the one the core uses.
+        {
+            mispredicted = missed;
+        }
+        predictors[i]->update(pc, taken);
+    }
+}
+
+/**
+ * @brief Push the return address of a call.
+ *
+ * @param rd Link xregister, only ra and t0 mark a call.
+ * @param link Return address.
+ */
+void branch_unit::jal(uint32_t rd, uint32_t link)
+{
+    mispredicted = false; //The target is known at decode.
+    if(is_link(rd))
+    {
+        push(link);
+    }
+}
+
+/**
+ * @brief Predict a return, or push the return address of a call.
+ *
+ * Follows the return address stack hints of the RISC-V specification: a jalr through ra or t0 that does not
+ * link to the other one is a return and pops, one that links to ra or t0 is a call and pushes, and one that
+ * does both pops then pushes. Any other jalr, whose target only a branch target buffer could guess, counts as
+ * mispredicted.
+ *
+ * @param rd Link xregister.
+ * @param rs1 Base xregister.
+ * @param target Address jumped to.
+ * @param link Return address.
+ */
+void branch_unit::jalr(uint32_t rd, uint32_t rs1, uint32_t target, uint32_t link)
+{
+    bool pop = is_link(rs1) && rs1 != rd;
+    mispredicted = true;
+    if(pop)
+    {
+        ++returns;
+        if(ras_used > 0)
+        {
+            ras_top = (ras_top + ras.size() - 1) % ras.size();
+            --ras_used;
+            mispredicted = ras[ras_top] != target;
+            ras_hits += !mispredicted;
+        }
+    }
+    else if(!is_link(rd))
+    {
+        ++indirect;
+    }
+
+    if(is_link(rd))
+    {
+        push(link);
+    }
+}
+
+/**
+ * @brief Check if the last branch or jump was mispredicted.
+ *
+ * @return true if the first predictor missed the last conditional branch, or a jalr target was not predicted.
+ */
+bool branch_unit::get_mispredicted() const
+{
+    return mispredicted;
+}
+
+/**
+ * @brief Write the accuracy of each predictor and the worst branches.
+ *
+ * The branches listed are those the predictors missed most often in total.
+ *
+ * @param os Stream to write to.
+ * @param hdr Prefix for each line.
+ */
+void branch_unit::report(std::ostream &os, const std::string &hdr) const
+{
+    auto percent = [](uint64_t n, uint64_t d) { return d ? 100.0 * n / d : 0; };
+    os << std::fixed << std::setprecision(2);
+    os << hdr << "Branches: " << branches << " conditional, " << percent(taken, branches) << "% taken" << std::endl;
+    for(size_t i = 0; i < predictors.size(); ++i)
+    {
+        os << hdr << "  " << std::setw(14) << std::left << predictors[i]->get_name() << std::right << std::setw(12) << mispredicts[i];
+        os << " mispredicted, " << std::setw(6) << percent(branches - mispredicts[i], branches) << "% accurate" << std::endl;
+    }
+    os << hdr << "Returns: " << returns << ", " << ras_hits << " predicted by a " << ras.size() << " entry return address stack (";
+    os << percent(ras_hits, returns) << "%), " << indirect << " other indirect jumps" << std::endl;
+
+    std::vector<std::pair<uint64_t, uint32_t>> worst; //Total mispredictions and pc.
+    for(const std::pair<const uint32_t, site> &s : sites)
+    {
+        uint64_t total = 0;
+        for(uint64_t m : s.second.mispredicts)
+        {
+            total += m;
+        }
+        worst.emplace_back(total, s.first);
+    }
+    size_t n = worst.size() < max_sites ? worst.size() : max_sites;
+    std::partial_sort(worst.begin(), worst.begin() + n, worst.end(), [](const std::pair<uint64_t, uint32_t> &a, const std::pair<uint64_t, uint32_t> &b)
+    {
+        return a.first != b.first ? a.first > b.first : a.second < b.second;
+    });
+
+    if(n > 0)
+    {
+        os << hdr << "  address        count   taken";
+        for(const std::unique_ptr<branch_predictor> &p : predictors)
+        {
+            os << std::setw(15) << p->get_name();
+        }
+        os << std::endl;
+    }
+    for(size_t i = 0; i < n; ++i)
+    {
+        const site &s = sites.at(worst[i].second);
+        os << hdr << "  " << to_hex32(worst[i].second) << std::setw(12) << s.executed << std::setw(7) << percent(s.taken, s.executed) << "%";
+        for(uint64_t m : s.mispredicts)
+        {
+            os << std::setw(14) << percent(s.executed - m, s.executed) << "%";
+        }
+        os << std::endl;
+    }
+    os << std::defaultfloat;
+}
+
+/**
+ * @brief Check if an xregister holds return addresses.
+ *
+ * @param r xregister number.
+ * @return true for ra (x1) and the alternate link register t0 (x5).
+ */
+bool branch_unit::is_link(uint32_t r)
+{
+    return r == 1 || r == 5;
+}
+
+/**
+ * @brief Push a return address, overwriting the oldest when full.
+ *
+ * @param link Return address.
+ */
+void branch_unit::push(uint32_t link)
+{
+    ras[ras_top] = link;
+    ras_top = (ras_top + 1) % ras.size();
+    ras_used = std::min<uint32_t>(ras_used + 1, ras.size());
+}
@@ -0,0 +1,197 @@
+#ifndef H_BRANCH_PREDICTOR
+#define H_BRANCH_PREDICTOR
+
+//***************************************************************************
+//
+//  Matt Borek
+//  z1951125
+//  CSCI463-1
+//
+//  I certify that this is my own work and where appropriate an extension
+//  of the starter code provided for the assignment.
+//
+//***************************************************************************
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include <ostream>
+#include "hex.h"
+
+/**
+ * @brief Conditional Branch Predictor Class
+ *
+ * Base of the direction predictors a branch_unit can be given. A predictor is asked for the direction of
+ * a branch before it resolves and is then told the real direction.
+ *
+ */
+class branch_predictor : public hex
+{
+public:
+    /**
+     * @brief Predictor kinds.
+     */
+    enum kind
+    {
+        kind_static,      //Backward taken, forward not taken.
+        kind_bimodal,     //Two bit counter per pc.
+        kind_gshare,      //Two bit counter per pc xor global history.
+        kind_tournament   //Bimodal and gshare with a per pc chooser.
+    };
+
+    /**
+     * @brief Predictor Description
+     */
+    struct config
+    {
+        kind k = { kind_bimodal };  //Kind of predictor.
+        uint32_t bits = { 12 };     //Log2 of the entries per table, also the global history length.
+    };
+
+    static std::unique_ptr<branch_predictor> create(const config &c);  //Construct the predictor a config describes.
+
+    branch_predictor(const config &c) : cfg(c) {}  //Constructor
+    virtual ~branch_predictor() = default;         //Destructor
+
+    virtual bool predict(uint32_t pc, uint32_t target) const = 0;  //Predict if the branch at pc is taken.
+    virtual void update(uint32_t pc, bool taken) = 0;              //Train on the direction the branch at pc went.
+    std::string get_name() const;                                  //Get the kind and size, such as gshare:12.
+
+protected:
+    static uint32_t index(uint32_t pc, uint32_t bits) { return (pc >> 2) & ((1u << bits) - 1); } //Table entry for a pc, RV32C branches in one word share it.
+    static void train(uint8_t &counter, bool taken);  //Move a two bit saturating counter towards a direction.
+
+    config cfg;  //Kind and size.
+};
+
+/**
+ * @brief Static Predictor
+ *
+ * Predicts backward branches, which are usually loops, as taken and forward branches as not taken.
+ */
+class static_predictor : public branch_predictor
+{
+public:
+    static_predictor(const config &c) : branch_predictor(c) {}  //Constructor
+
+    bool predict(uint32_t pc, uint32_t target) const override;
+    void update(uint32_t pc, bool taken) override;
+};
+
+/**
+ * @brief Bimodal Predictor
+ *
+ * A table of two bit saturating counters indexed by pc.
+ */
+class bimodal_predictor : public branch_predictor
+{
+public:
+    bimodal_predictor(const config &c) : branch_predictor(c), counters(1u << c.bits, 1) {}  //Constructor
+
+    bool predict(uint32_t pc, uint32_t target) const override;
+    void update(uint32_t pc, bool taken) override;
+
+private:
+    std::vector<uint8_t> counters;  //Counters, 2 and 3 predict taken.
+};
+
+/**
+ * @brief Gshare Predictor
+ *
+ * A table of two bit saturating counters indexed by pc xor the directions of the most recent branches.
+ */
+class gshare_predictor : public branch_predictor
+{
+public:
+    gshare_predictor(const config &c) : branch_predictor(c), counters(1u << c.bits, 1) {}  //Constructor
+
+    bool predict(uint32_t pc, uint32_t target) const override;
+    void update(uint32_t pc, bool taken) override;
+
+private:
+    std::vector<uint8_t> counters;  //Counters, 2 and 3 predict taken.
+    uint32_t history = { 0 };       //Directions of the most recent branches, newest in bit 0.
+};
+
+/**
+ * @brief Tournament Predictor
+ *
+ * Runs a bimodal and a gshare predictor side by side, with a per pc table of two bit counters choosing
+ * whichever has been right more often for that branch.
+ */
+class tournament_predictor : public branch_predictor
+{
+public:
+    tournament_predictor(const config &c) : branch_predictor(c), local(c), global(c), chooser(1u << c.bits, 1) {}  //Constructor
+
+    bool predict(uint32_t pc, uint32_t target) const override;
+    void update(uint32_t pc, bool taken) override;
+
+private:
+    bimodal_predictor local;        //Per pc component.
+    gshare_predictor global;        //Global history component.
+    std::vector<uint8_t> chooser;   //Counters, 2 and 3 pick gshare.
+};
+
+/**
+ * @brief Branch Prediction Model Class
+ *
+ * Feeds every conditional branch to any number of direction predictors side by side and every jump to
+ * a return address stack, counting how often each one is right overall and for each branch.
+ *
+ */
+class branch_unit : public hex
+{
+public:
+    /**
+     * @brief Branch Unit Description
+     */
+    struct config
+    {
+        std::vector<branch_predictor::config> predictors;  //Direction predictors to compare.
+        uint32_t ras_depth = { 16 };                         //Entries in the return address stack.
+    };
+
+    static bool parse(const std::string &s, config &c);  //Parse a comma separated list of predictors.
+
+    branch_unit(const config &c);  //Constructor
+
+    void branch(uint32_t pc, uint32_t target, bool taken);                                //Predict and train on a conditional branch.
+    void jal(uint32_t rd, uint32_t link);                                                 //Push the return address of a call.
+    void jalr(uint32_t rd, uint32_t rs1, uint32_t target, uint32_t link);                 //Predict a return, or push the return address of a call.
+    bool get_mispredicted() const;                                                        //Check if the last branch or jump was mispredicted.
+    void report(std::ostream &os, const std::string &hdr) const;                          //Write the accuracy of each predictor and the worst branches.
+
+private:
+    /**
+     * @brief Branch Site
+     *
+     * Counts for one conditional branch instruction.
+     */
+    struct site
+    {
+        uint64_t executed = { 0 };          //Times the branch ran.
+        uint64_t taken = { 0 };             //Times it was taken.
+        std::vector<uint64_t> mispredicts;  //Times each predictor was wrong.
+    };
+
+    static bool is_link(uint32_t r);  //Check if an xregister holds return addresses.
+    void push(uint32_t link);         //Push a return address, overwriting the oldest when full.
+
+    static constexpr size_t max_sites = 10;  //Branches listed in the report.
+
+    std::vector<std::unique_ptr<branch_predictor>> predictors;  //Direction predictors.
+    std::vector<uint64_t> mispredicts;                           //Times each predictor was wrong.
+    std::unordered_map<uint32_t, site> sites;                   //Counts for each branch, by pc.
+    uint64_t branches = { 0 };                                   //Conditional branches executed.
+    uint64_t taken = { 0 };                                      //Conditional branches taken.
+    bool mispredicted = { false };                               //Set when the first predictor, or the return address stack, missed the last transfer.
+
+    std::vector<uint32_t> ras;        //Return address stack, a ring.
+    uint32_t ras_top = { 0 };         //Slot the next push goes in.
+    uint32_t ras_used = { 0 };        //Valid entries.
+    uint64_t returns = { 0 };         //Returns executed.
+    uint64_t ras_hits = { 0 };        //Returns whose target was on top of the stack.
+    uint64_t indirect = { 0 };        //Other jalr jumps, which no predictor here covers.
+};
+
+#endif
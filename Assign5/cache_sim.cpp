@@ -0,0 +1,144 @@
+//***************************************************************************
+//
+//  Matt Borek
+//  z1951125
+//  CSCI463-1
+//
+//  I certify that this is my own work and where appropriate an extension
+//  of the starter code provided for the assignment.
+//
+//***************************************************************************
+#include <iomanip>
+#include <sstream>
+#include "cache_sim.h"
+
+/**
+ * @brief Construct a new cache model.
+ *
+ * @param c Geometry, as checked by parse().
+ */
+cache_sim::cache_sim(const config &c) : cfg(c), line_bits(0)
+{
+    while((1u << line_bits) < cfg.line)
+    {
+        ++line_bits;
+    }
+    set_mask = cfg.size / (cfg.ways * cfg.line) - 1;
+    tags.resize(cfg.size / cfg.line);
+    stamps.resize(cfg.size / cfg.line);
+}
+
+/**
+ * @brief Parse a size:ways:line[:policy] description.
+ *
+ * The sizes are decimal bytes and must all be powers of two, with at least one set and lines of at
+ * least 4 bytes. The policy is lru (the default), fifo or random.
+ *
+ * @param s Description, such as 16384:4:64:lru.
+ * @param c Geometry to fill in.
+ * @return true if s describes a cache.
+ */
+bool cache_sim::parse(const std::string &s, config &c)
+{
+    std::istringstream iss(s);
+    char sep1, sep2;
+    if(!(iss >> c.size >> sep1 >> c.ways >> sep2 >> c.line) || sep1 != ':' || sep2 != ':')
+    {
+        return false;
+    }
+
+    std::string policy = "lru";
+    if(iss.peek() == ':')
+    {
+        iss.get();
+        std::getline(iss, policy);
+    }
+    if(policy == "lru")
+        c.policy = replace_lru;
+    else if(policy == "fifo")
+        c.policy = replace_fifo;
+    else if(policy == "random")
+        c.policy = replace_random;
+    else
+        return false;
+
+    auto pow2 = [](uint32_t v) { return v != 0 && (v & (v - 1)) == 0; };
+    return pow2(c.size) && pow2(c.ways) && pow2(c.line) && c.line >= 4 && c.size >= c.ways * c.line && iss.eof();
+}
+
+/**
+ * @brief Look up every line an access touches.
+ *
+ * @param addr First byte accessed.
+ * @param len Bytes accessed.
+ * @return Lines missed.
+ */
+uint32_t cache_sim::access(uint32_t addr, uint32_t len)
+{
+    uint32_t first = addr >> line_bits;
+    uint32_t last = (addr + len - 1) >> line_bits;
+    uint32_t missed = access_line(first);
+    if(last != first) //Straddles two lines.
+    {
+        missed += access_line(last);
+    }
+    return missed;
+}
+
+/**
+ * @brief Write the geometry and hit and miss counts.
+ *
+ * @param os Stream to write to.
+ * @param name Name of the cache, such as L1I.
+ */
+void cache_sim::report(std::ostream &os, const std::string &name) const
+{
+    static const char *policies[] = { "lru", "fifo", "random" };
+    double rate = accesses ? 100.0 * misses / accesses : 0;
+    os << name << ": " << cfg.size << " bytes, " << cfg.ways << "-way, " << cfg.line << " byte lines, " << policies[cfg.policy] << ": ";
+    os << accesses << " accesses, " << accesses - misses << " hits, " << misses << " misses (";
+    os << std::fixed << std::setprecision(2) << rate << "% miss rate)" << std::defaultfloat << std::endl;
+}
+
+/**
+ * @brief Look up one line, filling it on a miss.
+ *
+ * An empty way is filled before anything is evicted.
+ *
+ * @param line_addr Address of the line, shifted right by the line size.
+ * @return 1 on a miss, 0 on a hit.
+ */
+uint32_t cache_sim::access_line(uint32_t line_addr)
+{
+    ++accesses;
+    ++clock;
+    uint32_t base = (line_addr & set_mask) * cfg.ways;
+    uint32_t victim = base;
+    for(uint32_t w = base; w < base + cfg.ways; ++w)
+    {
+        if(stamps[w] != 0 && tags[w] == line_addr) //Hit.
+        {
+            if(cfg.policy == replace_lru)
+            {
+                stamps[w] = clock;
+            }
+            return 0;
+        }
+        if(stamps[w] < stamps[victim]) //Oldest so far, and any empty way is older than all the rest.
+        {
+            victim = w;
+        }
+    }
+
+    ++misses;
+    if(cfg.policy == replace_random && stamps[victim] != 0) //Full set, pick any way.
+    {
+        seed ^= seed << 13; //xorshift32
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        victim = base + (seed & (cfg.ways - 1));
+    }
+    tags[victim] = line_addr;
+    stamps[victim] = clock;
+    return 1;
+}
@@ -0,0 +1,69 @@
+#ifndef H_CACHE_SIM
+#define H_CACHE_SIM
+
+//***************************************************************************
+//
+//  Matt Borek
+//  z1951125
+//  CSCI463-1
+//
+//  I certify that this is my own work and where appropriate an extension
+//  of the starter code provided for the assignment.
+//
+//***************************************************************************
+#include <vector>
+#include <ostream>
+#include "hex.h"
+
+/**
+ * @brief Set-Associative Cache Model Class
+ *
+ * Models the tags of one cache to count hits and misses. No data is held, memory stays the only copy,
+ * so the model only has to be told the address and size of every access.
+ *
+ */
+class cache_sim : public hex
+{
+public:
+    /**
+     * @brief Replacement policies.
+     */
+    enum replacement
+    {
+        replace_lru,     //Evict the least recently used line.
+        replace_fifo,    //Evict the line filled longest ago.
+        replace_random   //Evict any line.
+    };
+
+    /**
+     * @brief Cache Geometry
+     */
+    struct config
+    {
+        uint32_t size = { 0 };                   //Bytes of data the cache holds.
+        uint32_t ways = { 1 };                   //Lines per set.
+        uint32_t line = { 32 };                  //Bytes per line.
+        replacement policy = { replace_lru };    //Line to evict from a full set.
+    };
+
+    cache_sim(const config &c);  //Constructor
+
+    static bool parse(const std::string &s, config &c);       //Parse a size:ways:line[:policy] description.
+    uint32_t access(uint32_t addr, uint32_t len);             //Look up every line an access touches.
+    void report(std::ostream &os, const std::string &name) const;  //Write the geometry and hit and miss counts.
+
+private:
+    uint32_t access_line(uint32_t line_addr);   //Look up one line, filling it on a miss.
+
+    config cfg;                          //Geometry.
+    uint32_t line_bits;                  //Log2 of the line size.
+    uint32_t set_mask;                   //Sets - 1.
+    std::vector<uint32_t> tags;          //Line address held by each way of each set.
+    std::vector<uint64_t> stamps;        //Last use (LRU) or fill (FIFO) time of each way, zero when empty.
+    uint64_t clock = { 0 };              //Time of the last access.
+    uint32_t seed = { 2463534242u };     //Random replacement state.
+    uint64_t accesses = { 0 };           //Lines looked up.
+    uint64_t misses = { 0 };             //Lines not found.
+};
+
+#endif
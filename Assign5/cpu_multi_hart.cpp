@@ -0,0 +1,370 @@
+//***************************************************************************
+//
+//  Matt Borek
+//  z1951125
+//  CSCI463-1
+//
+//  I certify that this is my own work and where appropriate an extension
+//  of the starter code provided for the assignment.
+//
+//***************************************************************************
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <chrono>
+#include "cpu_multi_hart.h"
+
+/**
+ * @brief Construct a new cpu with several hardware threads.
+ *
+ * Hart n gets mhartid n and a stack pointer n slices below the top of memory, each slice being an
+ * equal, 16 byte aligned share of the memory size.
+ *
+ * @param mem Memory shared by every hart.
+ * @param hart_count Number of harts, at least one.
+ */
+cpu_multi_hart::cpu_multi_hart(memory &mem, uint32_t hart_count)
+{
+    hart_count = std::max<uint32_t>(hart_count, 1);
+    uint32_t slice = (mem.get_size() / hart_count) & ~15u;
+    for(uint32_t i = 0; i < hart_count; ++i)
+    {
+        harts.emplace_back(new cpu_single_hart(mem));
+        harts[i]->set_mhartid(i);
+        harts[i]->set_reset_sp(mem.get_size() - i * slice);
+    }
+}
+
+/**
+ * @brief Reset every hardware thread.
+ *
+ */
+void cpu_multi_hart::reset()
+{
+    for(std::unique_ptr<cpu_single_hart> &h : harts)
+    {
+        h->reset();
+    }
+}
+
+/**
+ * @brief Set the address every hart starts at.
+ *
+ * @param addr Address reset() starts execution at.
+ */
+void cpu_multi_hart::set_reset_pc(uint32_t addr)
+{
+    for(std::unique_ptr<cpu_single_hart> &h : harts)
+    {
+        h->set_reset_pc(addr);
+    }
+}
+
+/**
+ * @brief Set the show instructions flag.
+ *
+ * Traced output is prefixed with the hart number and the harts take turns on one host thread.
+ *
+ * @param b Whether to show each instruction executed.
+ */
+void cpu_multi_hart::set_show_instructions(bool b)
+{
+    for(uint32_t i = 0; i < harts.size(); ++i)
+    {
+        harts[i]->set_show_instructions(b);
+        harts[i]->set_trace_header("[" + std::to_string(i) + "] ");
+    }
+    tracing = tracing || b;
+}
+
+/**
+ * @brief Set the show registers flag.
+ *
+ * @param b Whether to dump the registers before each instruction.
+ */
+void cpu_multi_hart::set_show_registers(bool b)
+{
+    for(uint32_t i = 0; i < harts.size(); ++i)
+    {
+        harts[i]->set_show_registers(b);
+        harts[i]->set_trace_header("[" + std::to_string(i) + "] ");
+    }
+    tracing = tracing || b;
+}
+
+/**
+ * @brief Show only the registers that changed.
+ *
+ * @param b Whether the register dumps list only the registers changed since the previous one.
+ */
+void cpu_multi_hart::set_show_register_changes(bool b)
+{
+    for(uint32_t i = 0; i < harts.size(); ++i)
+    {
+        harts[i]->set_show_register_changes(b);
+    }
+}
+
+/**
+ * @brief Select the execution engine.
+ *
+ * @param e Engine every hart uses.
+ */
+void cpu_multi_hart::set_engine(cpu_single_hart::exec_engine e)
+{
+    engine = e;
+    for(std::unique_ptr<cpu_single_hart> &h : harts)
+    {
+        h->set_engine(e);
+    }
+}
+
+/**
+ * @brief Set the timing report flag.
+ *
+ * @param b Whether run() reports its execution time and speed.
+ */
+void cpu_multi_hart::set_show_timing(bool b)
+{
+    show_timing = b;
+}
+
+/**
+ * @brief Set the instructions each hart runs between synchronizations.
+ *
+ * Smaller quanta keep the harts closer in step, larger ones spend less time waiting.
+ *
+ * @param insns Instructions per quantum, at least one.
+ */
+void cpu_multi_hart::set_quantum(uint64_t insns)
+{
+    quantum = std::max<uint64_t>(insns, 1);
+}
+
+/**
+ * @brief Enable RV32C compressed instructions.
+ *
+ * @param b Whether every hart fetches compressed instructions.
+ */
+void cpu_multi_hart::set_rvc(bool b)
+{
+    for(std::unique_ptr<cpu_single_hart> &h : harts)
+    {
+        h->set_rvc(b);
+    }
+}
+
+/**
+ * @brief Give every hart its own L1 instruction cache model.
+ *
+ * @param c Geometry of each cache.
+ */
+void cpu_multi_hart::set_l1i(const cache_sim::config &c)
+{
+    for(std::unique_ptr<cpu_single_hart> &h : harts)
+    {
+        h->set_l1i(c);
+    }
+}
+
+/**
+ * @brief Give every hart its own L1 data cache model.
+ *
+ * @param c Geometry of each cache.
+ */
+void cpu_multi_hart::set_l1d(const cache_sim::config &c)
+{
+    for(std::unique_ptr<cpu_single_hart> &h : harts)
+    {
+        h->set_l1d(c);
+    }
+}
+
+/**
+ * @brief Give every hart its own branch prediction model.
+ *
+ * @param c Predictors to compare and the return address stack depth.
+ */
+void cpu_multi_hart::set_branch_unit(const branch_unit::config &c)
+{
+    for(std::unique_ptr<cpu_single_hart> &h : harts)
+    {
+        h->set_branch_unit(c);
+    }
+}
+
+/**
+ * @brief Give every hart its own pipeline timing model.
+ *
+ * @param c Stall penalties.
+ */
+void cpu_multi_hart::set_timing(const pipeline_model::config &c)
+{
+    for(std::unique_ptr<cpu_single_hart> &h : harts)
+    {
+        h->set_timing(c);
+    }
+}
+
+/**
+ * @brief Run simulated CPU.
+ *
+ * Run every hart until all of them halt or reach the execution limit, then report each one.
+ *
+ * @param exec_limit Limit of instructions each hart may execute, zero for no limit.
+ */
+void cpu_multi_hart::run(uint64_t exec_limit)
+{
+    auto start = std::chrono::steady_clock::now();
+    if(tracing || harts.size() == 1) //Keep traced output in order.
+    {
+        run_traced(exec_limit);
+    }
+    else
+    {
+        finished = false;
+        std::vector<std::thread> threads;
+        for(uint32_t i = 0; i < harts.size(); ++i)
+        {
+            threads.emplace_back(&cpu_multi_hart::run_hart, this, i, exec_limit);
+        }
+        for(std::thread &t : threads)
+        {
+            t.join();
+        }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    uint64_t total = 0;
+    for(uint32_t i = 0; i < harts.size(); ++i)
+    {
+        const cpu_single_hart &h = *harts[i];
+        std::string hdr = "[" + std::to_string(i) + "] ";
+        if(h.is_halted())
+        {
+            std::cout << hdr << "Execution terminated. Reason: " << h.get_halt_reason() << std::endl;
+        }
+        std::cout << hdr << h.get_insn_counter() << " instructions executed" << std::endl;
+        if(engine == cpu_single_hart::engine_jit)
+        {
+            std::cout << hdr << h.get_native_insn_counter() << " translated, " << h.get_insn_counter() - h.get_native_insn_counter() << " interpreted" << std::endl;
+        }
+        h.report_caches(hdr);
+        h.report_branches(hdr);
+        h.report_timing(hdr);
+        total += h.get_insn_counter();
+    }
+
+    if(show_timing)
+    {
+        double mips = elapsed.count() > 0 ? total / elapsed.count() / 1e6 : 0;
+        std::cout << "Execution time: " << std::fixed << std::setprecision(3) << elapsed.count() << " s, ";
+        std::cout << std::setprecision(1) << mips << " MIPS" << std::defaultfloat << std::endl;
+    }
+}
+
+/**
+ * @brief Dump every hardware thread.
+ *
+ */
+void cpu_multi_hart::dump() const
+{
+    for(uint32_t i = 0; i < harts.size(); ++i)
+    {
+        harts[i]->dump("[" + std::to_string(i) + "] ");
+    }
+}
+
+/**
+ * @brief Check if a hart has anything left to execute.
+ *
+ * @param h Hart to check.
+ * @param exec_limit Limit of instructions each hart may execute, zero for no limit.
+ * @return true if the hart is neither halted nor at the limit.
+ */
+bool cpu_multi_hart::can_run(const cpu_single_hart &h, uint64_t exec_limit) const
+{
+    return !h.is_halted() && (exec_limit == 0 || h.get_insn_counter() < exec_limit);
+}
+
+/**
+ * @brief Body of each hart's host thread.
+ *
+ * Wait for the other harts to start, then run a quantum, wait for the other harts, pick up their
+ * writes to cached instructions and repeat.
+ * A hart that is done keeps taking part in the synchronization until every hart is done.
+ *
+ * @param id Hart to run.
+ * @param exec_limit Limit of instructions each hart may execute, zero for no limit.
+ */
+void cpu_multi_hart::run_hart(uint32_t id, uint64_t exec_limit)
+{
+    cpu_single_hart &h = *harts[id];
+    h.bind_thread();
+    bool more = sync(exec_limit); //Every hart is bound before any of them writes memory.
+    while(more)
+    {
+        if(can_run(h, exec_limit))
+        {
+            uint64_t until = h.get_insn_counter() + quantum;
+            h.execute(exec_limit == 0 ? until : std::min(until, exec_limit));
+        }
+        more = sync(exec_limit);
+        h.apply_invalidations(); //Every other hart's writes from the last quantum are queued by now.
+    }
+}
+
+/**
+ * @brief Wait for every hart to finish its quantum.
+ *
+ * The last hart to arrive checks whether any hart can still run while the others are blocked.
+ *
+ * @param exec_limit Limit of instructions each hart may execute, zero for no limit.
+ * @return true if there is another quantum to run.
+ */
+bool cpu_multi_hart::sync(uint64_t exec_limit)
+{
+    std::unique_lock<std::mutex> lock(sync_lock);
+    if(++arrived == harts.size())
+    {
+        finished = true;
+        for(const std::unique_ptr<cpu_single_hart> &h : harts)
+        {
+            finished = finished && !can_run(*h, exec_limit);
+        }
+        arrived = 0;
+        ++generation;
+        sync_cv.notify_all();
+    }
+    else
+    {
+        uint64_t g = generation;
+        sync_cv.wait(lock, [this, g]() { return generation != g; });
+    }
+    return !finished;
+}
+
+/**
+ * @brief Run the harts in turn on one thread.
+ *
+ * Each hart runs a quantum at a time in mhartid order, so traced output is deterministic.
+ *
+ * @param exec_limit Limit of instructions each hart may execute, zero for no limit.
+ */
+void cpu_multi_hart::run_traced(uint64_t exec_limit)
+{
+    bool more = true;
+    while(more)
+    {
+        more = false;
+        for(std::unique_ptr<cpu_single_hart> &h : harts)
+        {
+            if(can_run(*h, exec_limit))
+            {
+                uint64_t until = h->get_insn_counter() + quantum;
+                h->execute(exec_limit == 0 ? until : std::min(until, exec_limit));
+                more = more || can_run(*h, exec_limit);
+            }
+        }
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef H_CPU_MULTI
+#define H_CPU_MULTI
+
+//***************************************************************************
+//
+//  Matt Borek
+//  z1951125
+//  CSCI463-1
+//
+//  I certify that this is my own work and where appropriate an extension
+//  of the starter code provided for the assignment.
+//
+//***************************************************************************
+#include <condition_variable>
+#include "cpu_single_hart.h"
+
+/**
+ * @brief Simulated Multi-Hart CPU Class
+ *
+ * Facilitates the creation and operation of a simulated CPU with several hardware threads sharing one memory.
+ * Each hart runs on its own host thread for a quantum of instructions at a time, and every hart waits for
+ * the others at the end of each quantum. Each hart gets an equal slice of the top of memory for its stack.
+ *
+ */
+class cpu_multi_hart : public hex
+{
+public:
+    cpu_multi_hart(memory &mem, uint32_t hart_count);  //Constructor
+
+    void run(uint64_t exec_limit);                             //Run simulated CPU.
+    void dump() const;                                         //Dump every hardware thread.
+    void reset();                                              //Reset every hardware thread.
+    void set_reset_pc(uint32_t addr);                          //Set the address every hart starts at.
+    void set_show_instructions(bool b);                        //Set the show instructions flag.
+    void set_show_registers(bool b);                           //Set the show registers flag.
+    void set_show_register_changes(bool b);                    //Show only the registers that changed.
+    void set_engine(cpu_single_hart::exec_engine e);           //Select the execution engine.
+    void set_show_timing(bool b);                              //Report execution time and MIPS after run().
+    void set_quantum(uint64_t insns);                          //Set the instructions each hart runs between synchronizations.
+    void set_rvc(bool b);                                      //Enable RV32C compressed instructions.
+    void set_l1i(const cache_sim::config &c);                  //Give every hart its own L1 instruction cache model.
+    void set_l1d(const cache_sim::config &c);                  //Give every hart its own L1 data cache model.
+    void set_branch_unit(const branch_unit::config &c);        //Give every hart its own branch prediction model.
+    void set_timing(const pipeline_model::config &c);          //Give every hart its own pipeline timing model.
+
+private:
+    bool can_run(const cpu_single_hart &h, uint64_t exec_limit) const;  //Check if a hart has anything left to execute.
+    void run_hart(uint32_t id, uint64_t exec_limit);                    //Body of each hart's host thread.
+    bool sync(uint64_t exec_limit);                                     //Wait for every hart to finish its quantum.
+    void run_traced(uint64_t exec_limit);                               //Run the harts in turn on one thread.
+
+    std::vector<std::unique_ptr<cpu_single_hart>> harts;  //Hardware threads, indexed by mhartid.
+    uint64_t quantum = { 10000 };                         //Instructions between synchronizations.
+    bool show_timing = { false };
+    bool tracing = { false };                             //Set when instructions or registers are shown.
+    cpu_single_hart::exec_engine engine = { cpu_single_hart::engine_step };
+
+    std::mutex sync_lock;                 //Guards the synchronization state below.
+    std::condition_variable sync_cv;      //Signalled when the last hart arrives.
+    uint32_t arrived = { 0 };             //Harts waiting at the current synchronization point.
+    uint64_t generation = { 0 };          //Count of completed synchronization points.
+    bool finished = { false };            //Set once no hart has anything left to execute.
+};
+
+#endif
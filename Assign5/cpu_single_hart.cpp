@@ -9,37 +9,799 @@
 //
 //***************************************************************************
 #include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstring>
+#include <fstream>
 #include "cpu_single_hart.h"
 
 /**
  * @brief Run simulated CPU.
  *
- * Simulate a CPU and run executable program.
+ * Simulate a CPU and run executable program, then report why it stopped.
  * 
  * @param exec_limit Limit of instructions to execute.
  */
 void cpu_single_hart::run(uint64_t exec_limit)
 {
-    regs.set(2, mem.get_size()); //Set register x2 to the maximum memory size.
-    if(exec_limit == 0)
+    auto start = std::chrono::steady_clock::now();
+    execute(exec_limit);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    if(is_halted())
+    {
+        std::cout << "Execution terminated. Reason: " << get_halt_reason() << std::endl;
+    }
+
+    std::cout << get_insn_counter() << " instructions executed" << std::endl;
+    if(engine == engine_jit)
+    {
+        std::cout << native_insn_counter << " translated, " << get_insn_counter() - native_insn_counter << " interpreted" << std::endl;
+    }
+    report_caches();
+    report_branches();
+    report_timing();
+    if(show_timing)
+    {
+        double mips = elapsed.count() > 0 ? get_insn_counter() / elapsed.count() / 1e6 : 0;
+        std::cout << "Execution time: " << std::fixed << std::setprecision(3) << elapsed.count() << " s, ";
+        std::cout << std::setprecision(1) << mips << " MIPS" << std::defaultfloat << std::endl;
+    }
+}
+
+/**
+ * @brief Run without reporting anything.
+ *
+ * Execute with the selected engine until the hart halts or its instruction counter reaches exec_limit.
+ * 
+ * @param exec_limit Limit of instructions to execute, zero for no limit.
+ */
+void cpu_single_hart::execute(uint64_t exec_limit)
+{
+    if(engine == engine_jit && !jit)
+    {
+        jit.reset(new rv32i_jit(mem.get_size()));
+        jit_ctx.regs = regs.data();
+        jit_ctx.mem = mem.data();
+        jit_ctx.watched = mem.watch_flags();
+        jit_ctx.load = jit_load;
+        jit_ctx.store = jit_store;
+        jit_ctx.owner = this;
+        jit_ctx.pc = pc;
+    }
+
+    if(profile && !prof)
+    {
+        prof.reset(new profiler(rvc, sample_period));
+    }
+
+    if(profile && sample_period) //Sampling runs the selected engine between samples.
+    {
+        run_sampled(exec_limit);
+    }
+    else if(profile) //Profiling steps whatever the engine, the other loops never pay for it.
+    {
+        run_profiled(exec_limit);
+    }
+    else
+    {
+        run_engine(exec_limit);
+    }
+}
+
+/**
+ * @brief Run using the selected engine.
+ *
+ * @param exec_limit Limit of instructions to execute, zero for no limit.
+ */
+void cpu_single_hart::run_engine(uint64_t exec_limit)
+{
+    bool stepping = show_instructions || show_registers || l1i || l1d || bpu || timing || tracer; //Tracing and the models only see tick().
+    if(engine == engine_threaded && !stepping)
+    {
+        run_threaded(exec_limit);
+    }
+    else if(engine != engine_step && !stepping) //Tracing always steps so its output is unchanged.
+    {
+        run_blocks(exec_limit);
+    }
+    else if(exec_limit == 0)
     {
         while(!is_halted()) //While the hardware thread isn't halted.
         {
-            tick();
+            tick(trace_hdr);
         }
     }
     else
     {
         while(!is_halted() && (get_insn_counter() < exec_limit)) //While the hardware thread isn't halted and thread isn't as execution limit.
+        {
+            tick(trace_hdr);
+        }
+    }
+}
+
+/**
+ * @brief Select the execution engine.
+ * 
+ * @param e Engine that run() should use.
+ */
+void cpu_single_hart::set_engine(exec_engine e)
+{
+    engine = e;
+}
+
+/**
+ * @brief Set the timing report flag.
+ * 
+ * @param b Whether run() reports its execution time and speed.
+ */
+void cpu_single_hart::set_show_timing(bool b)
+{
+    show_timing = b;
+}
+
+/**
+ * @brief Set the prefix for traced output.
+ * 
+ * @param hdr String printed to the left of each traced instruction and register dump.
+ */
+void cpu_single_hart::set_trace_header(const std::string &hdr)
+{
+    trace_hdr = hdr;
+}
+
+/**
+ * @brief Get the instructions executed by translated code.
+ * 
+ * @return Count of instructions run natively by the jit engine.
+ */
+uint64_t cpu_single_hart::get_native_insn_counter() const
+{
+    return native_insn_counter;
+}
+
+/**
+ * @brief Profile while running.
+ * 
+ * Full profiles count every instruction and call, stepping one instruction at a time whatever engine is
+ * selected. Sampled profiles run the selected engine and record the pc and return address chain every
+ * period instructions instead.
+ * 
+ * @param b Whether run() and execute() profile.
+ * @param period Instructions between samples, zero for a full profile.
+ */
+void cpu_single_hart::set_profile(bool b, uint64_t period)
+{
+    profile = b;
+    sample_period = period;
+}
+
+/**
+ * @brief Get the profile, if profiling.
+ * 
+ * @return The profile gathered so far, or nullptr if nothing has been profiled.
+ */
+const profiler* cpu_single_hart::get_profile() const
+{
+    return prof.get();
+}
+
+/**
+ * @brief Snapshot the hart and memory.
+ * 
+ * Memory pages are write protected afterwards, so restoring this checkpoint only copies back the pages written since.
+ * 
+ * @return The checkpoint.
+ */
+cpu_single_hart::checkpoint cpu_single_hart::save_checkpoint()
+{
+    checkpoint cp;
+    cp.hart = save_state();
+    cp.mem = mem.snapshot();
+    return cp;
+}
+
+/**
+ * @brief Roll the hart and memory back to a checkpoint.
+ * 
+ * @param cp Checkpoint to restore.
+ * @return true if restored, false if the checkpoint's memory is a different size.
+ */
+bool cpu_single_hart::restore_checkpoint(const checkpoint &cp)
+{
+    if(!mem.restore(cp.mem))
+    {
+        return false;
+    }
+    restore_state(cp.hart);
+    return true;
+}
+
+static const char checkpoint_magic[8] = { 'R', 'V', '3', '2', 'C', 'K', 'P', '1' };   //Checkpoint file signature and version.
+
+/**
+ * @brief Save a checkpoint to a file.
+ * 
+ * The file holds the signature, the pc, x0..x31, the instruction counter, the halt status and reason,
+ * all little-endian, followed by the memory snapshot.
+ * 
+ * @param fname Name of the file to write.
+ * @return true if the whole checkpoint was written.
+ */
+bool cpu_single_hart::write_checkpoint(const std::string &fname)
+{
+    checkpoint cp = save_checkpoint();
+    std::ofstream out(fname, std::ios::out|std::ios::binary|std::ios::trunc);
+
+    auto put = [&out](uint64_t v, int bytes) //Write a little-endian value.
+    {
+        for(int i = 0; i < bytes; ++i)
+        {
+            out.put(static_cast<char>(v >> (8 * i)));
+        }
+    };
+
+    out.write(checkpoint_magic, sizeof(checkpoint_magic));
+    put(cp.hart.pc, 4);
+    for(int32_t r : cp.hart.regs)
+    {
+        put(static_cast<uint32_t>(r), 4);
+    }
+    put(cp.hart.insn_counter, 8);
+    put(cp.hart.halt, 1);
+    put(cp.hart.halt_reason.size(), 4);
+    out.write(cp.hart.halt_reason.data(), cp.hart.halt_reason.size());
+    return cp.mem->save(out) && out.flush();
+}
+
+/**
+ * @brief Read a checkpoint from a file.
+ * 
+ * @param fname Name of the file written by write_checkpoint().
+ * @param cp Set to the checkpoint read.
+ * @return true if the file held a whole checkpoint.
+ */
+bool cpu_single_hart::read_checkpoint(const std::string &fname, checkpoint &cp)
+{
+    std::ifstream in(fname, std::ios::in|std::ios::binary);
+
+    auto get = [&in](int bytes) //Read a little-endian value.
+    {
+        uint64_t v = 0;
+        for(int i = 0; i < bytes; ++i)
+        {
+            v |= static_cast<uint64_t>(static_cast<uint8_t>(in.get())) << (8 * i);
+        }
+        return v;
+    };
+
+    char magic[sizeof(checkpoint_magic)];
+    if(!in.read(magic, sizeof(magic)) || std::memcmp(magic, checkpoint_magic, sizeof(magic)) != 0)
+    {
+        return false;
+    }
+    cp.hart.pc = get(4);
+    for(int32_t &r : cp.hart.regs)
+    {
+        r = static_cast<int32_t>(get(4));
+    }
+    cp.hart.insn_counter = get(8);
+    cp.hart.halt = get(1) != 0;
+    uint32_t len = get(4);
+    if(!in || len > 4096)
+    {
+        return false;
+    }
+    cp.hart.halt_reason.resize(len);
+    if(!in.read(&cp.hart.halt_reason[0], len))
+    {
+        return false;
+    }
+    cp.mem = memory_snapshot::load(in);
+    return cp.mem != nullptr;
+}
+
+/**
+ * @brief Run using the basic block engine.
+ *
+ * Execute whole basic blocks at a time, charging the instruction budget per block and following
+ * chained successors directly. Anything a block can not handle, such as a misaligned or out of range
+ * pc or a block that would overrun the execution limit, falls back to tick().
+ * 
+ * @param exec_limit Limit of instructions to execute, zero for no limit.
+ */
+void cpu_single_hart::run_blocks(uint64_t exec_limit)
+{
+    basic_block *b = nullptr;
+    while(!is_halted() && (exec_limit == 0 || get_insn_counter() < exec_limit))
+    {
+        if(code_modified) //Code was overwritten, rebuild every block from the predecode cache.
+        {
+            blocks.clear();
+            if(jit)
+            {
+                jit->reset();
+            }
+            code_modified = false;
+            b = nullptr;
+        }
+
+        if(!b)
+        {
+            b = lookup_block(pc);
+        }
+
+        if(!b || (exec_limit != 0 && get_insn_counter() + b->insns.size() > exec_limit))
         {
             tick();
+            b = nullptr;
+            continue;
+        }
+
+        if(jit && !b->native && b->exec_count++ == jit_threshold) //Translate blocks once they are hot.
+        {
+            translate_block(b);
+        }
+
+        const decoded_insn *d = b->insns.data();
+        const decoded_insn *end = d + b->insns.size();
+        insn_counter += b->insns.size(); //Charge the block up front like tick(), so a CSR read ending it sees the same count.
+        if(b->native) //Run the translated instructions, then interpret whatever could not be translated.
+        {
+            uint32_t n = b->native(&jit_ctx);
+            pc = jit_ctx.pc;
+            native_insn_counter += n;
+            d += n;
+        }
+        while(d != end && !code_modified && !halt) //Execute the block, stopping early if it overwrites code or halts.
+        {
+            (this->*d->handler)(*d, nullptr);
+            ++d;
+        }
+        insn_counter -= end - d; //Refund anything skipped after code was modified or the hart halted.
+
+        int slot = (pc == b->succ_pc[0]) ? 0 : (pc == b->succ_pc[1]) ? 1 : -1;
+        if(slot < 0) //Computed target, go back through the block map.
+        {
+            b = nullptr;
+        }
+        else
+        {
+            if(!b->succ[slot]) //Chain the successor on first use.
+            {
+                b->succ[slot] = lookup_block(pc);
+            }
+            b = b->succ[slot];
         }
     }
+}
 
-    if(is_halted())
+/**
+ * @brief Run using the threaded interpreter.
+ *
+ * Instructions are fetched straight from memory and dispatched through a flat table indexed by
+ * opcode and funct3, with each handler jumping directly to the handler of the next instruction.
+ * Instructions whose funct7 matters test it in their handler. System and illegal instructions, as well
+ * as a misaligned or out of range pc, leave the loop so tick() can handle them.
+ * 
+ * @param exec_limit Limit of instructions to execute, zero for no limit.
+ */
+void cpu_single_hart::run_threaded(uint64_t exec_limit)
+{
+#if defined(__GNUC__)
+    const void *table[1 << 10]; //Handlers by (opcode << 3) | funct3.
+    for(const void *&h : table)
     {
-        std::cout << "Execution terminated. Reason: " << get_halt_reason() << std::endl;
+        h = &&slow;
+    }
+    for(uint32_t f = 0; f < 8; ++f) //These opcodes have no funct3.
+    {
+        table[opcode_lui << 3 | f] = &&op_lui;
+        table[opcode_auipc << 3 | f] = &&op_auipc;
+        table[opcode_jal << 3 | f] = &&op_jal;
     }
+    table[opcode_jalr << 3 | 0] = &&op_jalr;
+    table[opcode_btype << 3 | funct3_beq] = &&op_beq;
+    table[opcode_btype << 3 | funct3_bne] = &&op_bne;
+    table[opcode_btype << 3 | funct3_blt] = &&op_blt;
+    table[opcode_btype << 3 | funct3_bge] = &&op_bge;
+    table[opcode_btype << 3 | funct3_bltu] = &&op_bltu;
+    table[opcode_btype << 3 | funct3_bgeu] = &&op_bgeu;
+    table[opcode_load_imm << 3 | funct3_lb] = &&op_lb;
+    table[opcode_load_imm << 3 | funct3_lh] = &&op_lh;
+    table[opcode_load_imm << 3 | funct3_lw] = &&op_lw;
+    table[opcode_load_imm << 3 | funct3_lbu] = &&op_lbu;
+    table[opcode_load_imm << 3 | funct3_lhu] = &&op_lhu;
+    table[opcode_stype << 3 | funct3_sb] = &&op_sb;
+    table[opcode_stype << 3 | funct3_sh] = &&op_sh;
+    table[opcode_stype << 3 | funct3_sw] = &&op_sw;
+    table[opcode_alu_imm << 3 | funct3_add] = &&op_addi;
+    table[opcode_alu_imm << 3 | funct3_slt] = &&op_slti;
+    table[opcode_alu_imm << 3 | funct3_sltu] = &&op_sltiu;
+    table[opcode_alu_imm << 3 | funct3_xor] = &&op_xori;
+    table[opcode_alu_imm << 3 | funct3_or] = &&op_ori;
+    table[opcode_alu_imm << 3 | funct3_and] = &&op_andi;
+    table[opcode_alu_imm << 3 | funct3_sll] = &&op_slli;
+    table[opcode_alu_imm << 3 | funct3_srx] = &&op_srxi;
+    table[opcode_rtype << 3 | funct3_add] = &&op_add;
+    table[opcode_rtype << 3 | funct3_sll] = &&op_sll;
+    table[opcode_rtype << 3 | funct3_slt] = &&op_slt;
+    table[opcode_rtype << 3 | funct3_sltu] = &&op_sltu;
+    table[opcode_rtype << 3 | funct3_xor] = &&op_xor;
+    table[opcode_rtype << 3 | funct3_srx] = &&op_srx;
+    table[opcode_rtype << 3 | funct3_or] = &&op_or;
+    table[opcode_rtype << 3 | funct3_and] = &&op_and;
 
-    std::cout << get_insn_counter() << " instructions executed" << std::endl;
+    int32_t *r = regs.data();
+    uint8_t *m = mem.data();
+    const uint8_t *watched = mem.watch_flags();
+    const uint32_t size = mem.get_size();
+    const uint32_t last_word = size < 4 ? 0 : size - 4; //Highest address a whole word can be fetched from.
+
+    uint64_t budget;  //Instructions this burst may execute.
+    uint64_t n;       //Instructions this burst has executed.
+    uint32_t insn, rd, addr;
+    int32_t imm;
+
+//Fields of the current instruction.
+#define RD      ((insn >> 7) & 0x1f)
+#define RS1     ((insn >> 15) & 0x1f)
+#define RS2     ((insn >> 20) & 0x1f)
+#define IMM_I   (static_cast<int32_t>(insn) >> 20)
+#define IMM_S   ((static_cast<int32_t>(insn & 0xfe000000) >> 20) | ((insn >> 7) & 0x1f))
+
+//Fetch the instruction at pc and jump to its handler, leaving for tick() when the pc can not be fetched directly.
+#define DISPATCH() \
+    do { \
+        if(size < 4 || (pc & 3) != 0 || pc > last_word) goto slow; \
+        std::memcpy(&insn, m + pc, 4); \
+        goto *table[((insn & 0x7f) << 3) | ((insn >> 12) & 7)]; \
+    } while(0)
+
+//Count the instruction just executed and move on to the next one.
+#define NEXT() \
+    do { \
+        r[0] = 0; \
+        if(++n == budget) goto leave; \
+        DISPATCH(); \
+    } while(0)
+
+//Register-immediate and register-register ALU instructions.
+#define OP_IMM(expr) \
+    do { uint32_t a = r[RS1]; imm = IMM_I; r[RD] = (expr); pc += 4; NEXT(); } while(0)
+#define OP_REG(expr) \
+    do { uint32_t a = r[RS1], b = r[RS2]; r[RD] = (expr); pc += 4; NEXT(); } while(0)
+
+//Register-register instruction that is an RV32M operation when funct7 says so.
+#define OP_REG_M(expr) \
+    do { \
+        if((insn >> 25) == funct7_muldiv) OP_REG(muldiv((insn >> 12) & 7, a, b)); \
+        OP_REG(expr); \
+    } while(0)
+
+//Conditional branch taken when cond holds.
+#define OP_BRANCH(cond) \
+    do { \
+        uint32_t a = r[RS1], b = r[RS2]; \
+        imm = get_imm_b(insn); \
+        pc += (cond) ? imm : 4; \
+        NEXT(); \
+    } while(0)
+
+//Load of len bytes, read through memory when not entirely in range.
+#define OP_LOAD(type, len, slow_get) \
+    do { \
+        addr = r[RS1] + IMM_I; \
+        rd = RD; \
+        if(addr <= size - len && size >= len) { type v; std::memcpy(&v, m + addr, len); r[rd] = v; } \
+        else { r[rd] = mem.slow_get(addr); } \
+        pc += 4; \
+        NEXT(); \
+    } while(0)
+
+//Store of len bytes, written through memory when not entirely in range or when the page is watched.
+#define OP_STORE(type, len, slow_set) \
+    do { \
+        addr = r[RS1] + IMM_S; \
+        type v = r[RS2]; \
+        if(addr <= size - len && size >= len && !watched[addr >> memory::page_bits] && !watched[(addr + len - 1) >> memory::page_bits]) \
+        { std::memcpy(m + addr, &v, len); } \
+        else { mem.slow_set(addr, v); } \
+        pc += 4; \
+        NEXT(); \
+    } while(0)
+
+    while(!is_halted() && (exec_limit == 0 || get_insn_counter() < exec_limit))
+    {
+        budget = (exec_limit == 0) ? UINT64_MAX : exec_limit - get_insn_counter();
+        n = 0;
+        DISPATCH();
+
+    op_lui:     r[RD] = insn & 0xfffff000; pc += 4; NEXT();
+    op_auipc:   r[RD] = pc + (insn & 0xfffff000); pc += 4; NEXT();
+    op_jal:     rd = RD; imm = get_imm_j(insn); r[rd] = pc + 4; pc += imm; NEXT();
+    op_jalr:    rd = RD; addr = (r[RS1] + IMM_I) & 0xfffffffe; r[rd] = pc + 4; pc = addr; NEXT();
+
+    op_beq:     OP_BRANCH(a == b);
+    op_bne:     OP_BRANCH(a != b);
+    op_blt:     OP_BRANCH(static_cast<int32_t>(a) < static_cast<int32_t>(b));
+    op_bge:     OP_BRANCH(static_cast<int32_t>(a) >= static_cast<int32_t>(b));
+    op_bltu:    OP_BRANCH(a < b);
+    op_bgeu:    OP_BRANCH(a >= b);
+
+    op_lb:      OP_LOAD(int8_t, 1, get8_sx);
+    op_lh:      OP_LOAD(int16_t, 2, get16_sx);
+    op_lw:      OP_LOAD(int32_t, 4, get32_sx);
+    op_lbu:     OP_LOAD(uint8_t, 1, get8);
+    op_lhu:     OP_LOAD(uint16_t, 2, get16);
+
+    op_sb:      OP_STORE(uint8_t, 1, set8);
+    op_sh:      OP_STORE(uint16_t, 2, set16);
+    op_sw:      OP_STORE(uint32_t, 4, set32);
+
+    op_addi:    OP_IMM(a + imm);
+    op_slti:    OP_IMM(static_cast<int32_t>(a) < imm);
+    op_sltiu:   OP_IMM(a < static_cast<uint32_t>(imm));
+    op_xori:    OP_IMM(a ^ imm);
+    op_ori:     OP_IMM(a | imm);
+    op_andi:    OP_IMM(a & imm);
+    op_slli:    OP_IMM(a << (imm & 0x1f));
+    op_srxi:
+        switch(get_funct7(insn)) //funct7 is folded into the handler.
+        {
+            case funct7_srl:    OP_IMM(a >> (imm & 0x1f));
+            case funct7_sra:    OP_IMM(static_cast<int32_t>(a) >> (imm & 0x1f));
+            default:            goto slow;
+        }
+
+    op_add:
+        switch(get_funct7(insn))
+        {
+            case funct7_add:    OP_REG(a + b);
+            case funct7_sub:    OP_REG(a - b);
+            case funct7_muldiv: OP_REG(a * b);
+            default:            goto slow;
+        }
+    op_sll:     OP_REG_M(a << (b & 0x1f));
+    op_slt:     OP_REG_M(static_cast<int32_t>(a) < static_cast<int32_t>(b));
+    op_sltu:    OP_REG_M(a < b);
+    op_xor:     OP_REG_M(a ^ b);
+    op_srx:
+        switch(get_funct7(insn))
+        {
+            case funct7_srl:    OP_REG(a >> (b & 0x1f));
+            case funct7_sra:    OP_REG(static_cast<int32_t>(a) >> (b & 0x1f));
+            case funct7_muldiv: OP_REG(muldiv(funct3_divu, a, b));
+            default:            goto slow;
+        }
+    op_or:      OP_REG_M(a | b);
+    op_and:     OP_REG_M(a & b);
+
+    slow: //Let tick() execute, report or halt on this instruction.
+        insn_counter += n;
+        tick();
+        continue;
+
+    leave: //Used up the execution limit.
+        insn_counter += n;
+    }
+
+#undef RD
+#undef RS1
+#undef RS2
+#undef IMM_I
+#undef IMM_S
+#undef DISPATCH
+#undef NEXT
+#undef OP_IMM
+#undef OP_REG
+#undef OP_REG_M
+#undef OP_BRANCH
+#undef OP_LOAD
+#undef OP_STORE
+#else
+    run_blocks(exec_limit); //Computed goto is a GNU extension, fall back to the block engine.
+#endif
+}
+
+/**
+ * @brief Run one instruction at a time, feeding the profiler.
+ *
+ * Each instruction is looked up before tick() executes it so the profiler can see calls and returns.
+ * A pc that tick() will refuse is not looked up, so any warnings are only given once.
+ * 
+ * @param exec_limit Limit of instructions to execute, zero for no limit.
+ */
+void cpu_single_hart::run_profiled(uint64_t exec_limit)
+{
+    while(!is_halted() && (exec_limit == 0 || get_insn_counter() < exec_limit))
+    {
+        uint32_t at = pc;
+        uint32_t insn = 0;
+        if(pc % (rvc ? 2 : 4) == 0 && static_cast<uint64_t>(pc) + 4 <= mem.get_size())
+        {
+            decoded_insn scratch;
+            insn = fetch(pc, scratch).insn;
+        }
+
+        uint64_t before = get_insn_counter();
+        tick(trace_hdr);
+        if(get_insn_counter() != before) //Not refused for alignment.
+        {
+            prof->retire(at, insn, pc);
+        }
+    }
+}
+
+/**
+ * @brief Run the selected engine, sampling the profile between runs.
+ *
+ * The instruction counter is the clock, a sample is taken each time it reaches a multiple of the period.
+ * The samples are aggregated when the run ends.
+ * 
+ * @param exec_limit Limit of instructions to execute, zero for no limit.
+ */
+void cpu_single_hart::run_sampled(uint64_t exec_limit)
+{
+    prof->start(pc);
+    while(!is_halted() && (exec_limit == 0 || get_insn_counter() < exec_limit))
+    {
+        uint64_t until = (get_insn_counter() / sample_period + 1) * sample_period;
+        run_engine(exec_limit == 0 ? until : std::min(until, exec_limit));
+        if(get_insn_counter() == until && !is_halted())
+        {
+            prof->sample(pc, regs.get(8), mem);
+        }
+    }
+    prof->aggregate();
+}
+
+/**
+ * @brief Find or build the block starting at addr.
+ * 
+ * @param addr Address of the first instruction in the block.
+ * @return Pointer to the block, or nullptr if no block can start at addr.
+ */
+cpu_single_hart::basic_block* cpu_single_hart::lookup_block(uint32_t addr)
+{
+    if(addr % (rvc ? 2 : 4) != 0) //Let tick() report the alignment error.
+    {
+        return nullptr;
+    }
+
+    auto it = blocks.find(addr);
+    if(it != blocks.end())
+    {
+        return it->second.get();
+    }
+
+    std::unique_ptr<basic_block> nb(new basic_block);
+    uint32_t insn_addr = addr;  //Address of the last instruction in the block.
+    uint32_t next_addr = addr;  //Address just past it.
+    while(nb->insns.size() < max_block_insns)
+    {
+        decoded_insn scratch;
+        const decoded_insn &d = fetch(next_addr, scratch);
+        if(&d == &scratch) //Not cacheable, leave it to tick().
+        {
+            break;
+        }
+
+        nb->insns.push_back(d);
+        insn_addr = next_addr;
+        next_addr += d.len;
+        if(is_block_end(d))
+        {
+            break;
+        }
+    }
+
+    if(nb->insns.empty())
+    {
+        return nullptr;
+    }
+
+    const decoded_insn &last = nb->insns.back();
+    switch(get_opcode(last.insn)) //Record successors known before execution.
+    {
+        case opcode_btype:
+            nb->succ_pc[0] = next_addr;
+            nb->succ_pc[1] = insn_addr + last.imm;
+            break;
+        case opcode_jal:
+            nb->succ_pc[0] = insn_addr + last.imm;
+            break;
+        case opcode_jalr:
+        case opcode_system:
+            break;
+        case opcode_amo: //Falls through unless it halts.
+            nb->succ_pc[0] = next_addr;
+            break;
+        default:
+            if(!is_block_end(last)) //Ran into the length limit or the end of memory.
+            {
+                nb->succ_pc[0] = next_addr;
+            }
+            break;
+    }
+
+    basic_block *b = nb.get();
+    b->addr = addr;
+    blocks[addr] = std::move(nb);
+    return b;
+}
+
+/**
+ * @brief Translate a hot block to native code.
+ *
+ * Translation covers the block up to the first instruction the translator can not handle, or the first
+ * RV32C instruction, which is left to the interpreter. When the code buffer fills up every block is dropped and rebuilt.
+ * 
+ * @param b Block to translate.
+ */
+void cpu_single_hart::translate_block(basic_block *b)
+{
+    std::vector<uint32_t> words;
+    for(const decoded_insn &d : b->insns)
+    {
+        if(d.len != 4) //The translator assumes 4 byte instructions.
+        {
+            break;
+        }
+        words.push_back(d.insn);
+    }
+
+    uint32_t count;
+    b->native = jit->translate(b->addr, words, count);
+    if(jit->is_full()) //Start over with an empty code buffer, the same way as for modified code.
+    {
+        code_modified = true;
+    }
+}
+
+/**
+ * @brief Slow path load for translated code.
+ *
+ * Used for loads that are not entirely within memory so they warn and read zeros exactly like the interpreter.
+ * 
+ * @param ctx Context of the translated block.
+ * @param addr Address to load from.
+ * @param funct3 Load width and signedness.
+ * @return Loaded value, extended to 32 bits.
+ */
+uint32_t cpu_single_hart::jit_load(rv32i_jit::context *ctx, uint32_t addr, uint32_t funct3)
+{
+    memory &m = static_cast<cpu_single_hart*>(ctx->owner)->mem;
+    switch(funct3)
+    {
+        case funct3_lb:     return m.get8_sx(addr);
+        case funct3_lh:     return m.get16_sx(addr);
+        case funct3_lbu:    return m.get8(addr);
+        case funct3_lhu:    return m.get16(addr);
+        default:            return m.get32(addr);
+    }
+}
+
+/**
+ * @brief Slow path store for translated code.
+ *
+ * Used for stores that are not entirely within memory or that land on a watched page.
+ * 
+ * @param ctx Context of the translated block.
+ * @param addr Address to store to.
+ * @param val Value from rs2.
+ * @param funct3 Store width.
+ * @return Nonzero if the store overwrote a predecoded instruction.
+ */
+uint32_t cpu_single_hart::jit_store(rv32i_jit::context *ctx, uint32_t addr, uint32_t val, uint32_t funct3)
+{
+    cpu_single_hart *cpu = static_cast<cpu_single_hart*>(ctx->owner);
+    switch(funct3)
+    {
+        case funct3_sb:     cpu->mem.set8(addr, val & 0x000000ff); break;
+        case funct3_sh:     cpu->mem.set16(addr, val & 0x0000ffff); break;
+        default:            cpu->mem.set32(addr, val); break;
+    }
+    return cpu->code_modified;
 }
\ No newline at end of file
@@ -11,7 +11,10 @@
 //  of the starter code provided for the assignment.
 //
 //***************************************************************************
+#include <unordered_map>
 #include "rv32i_hart.h"
+#include "rv32i_jit.h"
+#include "profiler.h"
 
 /**
  * @brief Simulated Hardware Thread Class
@@ -22,6 +25,29 @@
 class cpu_single_hart : public rv32i_hart
 {
 public:
+    /**
+     * @brief Execution engines available to run().
+     */
+    enum exec_engine
+    {
+        engine_step,   //Fetch, decode and execute one tick() at a time.
+        engine_block,  //Execute chained basic blocks of predecoded instructions.
+        engine_jit,    //Like engine_block, but hot blocks are translated to native code.
+        engine_threaded //Dispatch each instruction through a flat handler table with computed gotos.
+    };
+
+    /**
+     * @brief Checkpoint
+     * 
+     * Hart state together with a snapshot of memory. The snapshot is shared, so any number of
+     * memories can be forked from one checkpoint.
+     */
+    struct checkpoint
+    {
+        hart_state hart;                                //Architectural hart state.
+        std::shared_ptr<const memory_snapshot> mem;     //Memory contents.
+    };
+
     /**
      * @brief Construct a new cpu with a single hardware thread.
      * 
@@ -29,6 +55,63 @@ public:
      */
     cpu_single_hart(memory &mem) : rv32i_hart(mem) {} //Constructor
     void run(uint64_t exec_limit);                    //Run simulated CPU.
+    void execute(uint64_t exec_limit);                //Run without reporting anything.
+    void set_engine(exec_engine e);                   //Select the execution engine.
+    void set_show_timing(bool b);                     //Report execution time and MIPS after run().
+    void set_trace_header(const std::string &hdr);    //Set the prefix for traced output.
+    uint64_t get_native_insn_counter() const;         //Get the instructions executed by translated code.
+    void set_profile(bool b, uint64_t period = 0);    //Profile while running, every instruction or every period instructions.
+    const profiler* get_profile() const;              //Get the profile, if profiling.
+
+    checkpoint save_checkpoint();                     //Snapshot the hart and memory.
+    bool restore_checkpoint(const checkpoint &cp);    //Roll the hart and memory back to a checkpoint.
+    bool write_checkpoint(const std::string &fname);  //Save a checkpoint to a file.
+    static bool read_checkpoint(const std::string &fname, checkpoint &cp); //Read a checkpoint from a file.
+
+private:
+    /**
+     * @brief Basic Block
+     * 
+     * Straight-line run of predecoded instructions ending at a branch, jump, system or illegal instruction.
+     * Successor blocks with a statically known start address are linked directly once they are first reached.
+     */
+    struct basic_block
+    {
+        uint32_t addr = { 0 };                          //Address of the first instruction.
+        std::vector<decoded_insn> insns;                //Instructions in execution order.
+        uint32_t succ_pc[2] = { no_succ, no_succ };     //Fall-through and taken successor addresses.
+        basic_block *succ[2] = { nullptr, nullptr };    //Chained successor blocks.
+        uint32_t exec_count = { 0 };                    //Times the block has been interpreted.
+        rv32i_jit::block_fn native = { nullptr };       //Translation of the leading instructions, if any.
+    };
+
+    static constexpr uint32_t no_succ = 1;              //Successor address that no pc can ever hold.
+    static constexpr uint32_t max_block_insns = 1024;   //Longest basic block to build.
+    static constexpr uint32_t jit_threshold = 16;       //Interpreted runs before a block is translated.
+
+    void run_blocks(uint64_t exec_limit);               //Run using the basic block engine.
+    void run_threaded(uint64_t exec_limit);             //Run using the threaded interpreter.
+    void run_engine(uint64_t exec_limit);               //Run using the selected engine.
+    void run_profiled(uint64_t exec_limit);             //Run one instruction at a time, feeding the profiler.
+    void run_sampled(uint64_t exec_limit);              //Run the selected engine, sampling the profile between runs.
+    basic_block* lookup_block(uint32_t addr);           //Find or build the block starting at addr.
+    void translate_block(basic_block *b);               //Translate a hot block to native code.
+
+    static uint32_t jit_load(rv32i_jit::context *ctx, uint32_t addr, uint32_t funct3);                 //Slow path load for translated code.
+    static uint32_t jit_store(rv32i_jit::context *ctx, uint32_t addr, uint32_t val, uint32_t funct3);  //Slow path store for translated code.
+
+    exec_engine engine = { engine_step };
+    bool show_timing = { false };
+    std::string trace_hdr;                              //Prefix for traced output.
+    std::unordered_map<uint32_t, std::unique_ptr<basic_block>> blocks; //Built blocks by starting address.
+
+    std::unique_ptr<rv32i_jit> jit;         //Translator, created when the jit engine first runs.
+    rv32i_jit::context jit_ctx;             //Context passed to translated blocks.
+    uint64_t native_insn_counter = { 0 };   //Instructions executed by translated code.
+
+    bool profile = { false };               //Set when run() should profile.
+    uint64_t sample_period = { 0 };         //Instructions between profile samples, zero to count every instruction.
+    std::unique_ptr<profiler> prof;         //Profile, created when a profiled run first starts.
 };
 
 #endif
\ No newline at end of file
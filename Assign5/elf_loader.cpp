@@ -0,0 +1,260 @@
+//***************************************************************************
+//
+//  Matt Borek
+//  z1951125
+//  CSCI463-1
+//
+//  I certify that this is my own work and where appropriate an extension
+//  of the starter code provided for the assignment.
+//
+//***************************************************************************
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <elf.h>
+#include "elf_loader.h"
+
+#ifndef EM_RISCV
+#define EM_RISCV 243
+#endif
+#ifndef EF_RISCV_RVC
+#define EF_RISCV_RVC 0x0001
+#endif
+
+/**
+ * @brief Check if a file starts with the ELF magic number.
+ *
+ * @param fname Name of file within accessible directory.
+ * @return true if the file could be opened and begins with 0x7f 'E' 'L' 'F'.
+ */
+bool elf_loader::is_elf(const std::string &fname)
+{
+    std::ifstream infile(fname, std::ios::in|std::ios::binary);
+    char magic[SELFMAG];
+    return infile.read(magic, SELFMAG) && std::memcmp(magic, ELFMAG, SELFMAG) == 0;
+}
+
+/**
+ * @brief Load an executable into memory.
+ *
+ * Read the whole file, check that it is a little-endian RISC-V ELF32 executable, then place its
+ * segments and read its symbols.
+ *
+ * @param fname Name of file within accessible directory.
+ * @param mem Memory to load the segments into.
+ * @return true if the executable was loaded.
+ * @return false if the file could not be read, is not a usable executable or does not fit in memory.
+ */
+bool elf_loader::load(const std::string &fname, memory &mem)
+{
+    this->fname = fname;
+    std::ifstream infile(fname, std::ios::in|std::ios::binary|std::ios::ate); //Open at the end to find the size.
+    if(!infile.is_open() || infile.tellg() < 0)
+    {
+        return fail("can't open file for reading");
+    }
+
+    std::vector<uint8_t> image(infile.tellg());
+    infile.seekg(0);
+    if(!infile.read(reinterpret_cast<char*>(image.data()), image.size())) //Read the whole file at once.
+    {
+        return fail("can't read file");
+    }
+
+    if(image.size() < sizeof(Elf32_Ehdr))
+    {
+        return fail("file too short for an ELF header");
+    }
+    Elf32_Ehdr eh;
+    std::memcpy(&eh, image.data(), sizeof(eh));
+    if(std::memcmp(eh.e_ident, ELFMAG, SELFMAG) != 0)
+    {
+        return fail("not an ELF file");
+    }
+    if(eh.e_ident[EI_CLASS] != ELFCLASS32 || eh.e_ident[EI_DATA] != ELFDATA2LSB)
+    {
+        return fail("not a little-endian ELF32 file");
+    }
+    if(eh.e_machine != EM_RISCV)
+    {
+        return fail("not a RISC-V executable");
+    }
+    if(eh.e_type != ET_EXEC)
+    {
+        return fail("not an executable");
+    }
+
+    entry = eh.e_entry;
+    rvc = (eh.e_flags & EF_RISCV_RVC) != 0;
+    if(!load_segments(image, mem))
+    {
+        return false;
+    }
+    load_symbols(image);
+    return true;
+}
+
+/**
+ * @brief Place the PT_LOAD segments.
+ *
+ * Copy each segment's file bytes to its virtual address and zero fill the rest of its memory size.
+ *
+ * @param image Contents of the whole file.
+ * @param mem Memory to load the segments into.
+ * @return true if every segment was placed.
+ */
+bool elf_loader::load_segments(const std::vector<uint8_t> &image, memory &mem)
+{
+    Elf32_Ehdr eh;
+    std::memcpy(&eh, image.data(), sizeof(eh));
+    for(uint32_t i = 0; i < eh.e_phnum; ++i)
+    {
+        uint64_t off = eh.e_phoff + static_cast<uint64_t>(i) * eh.e_phentsize;
+        if(eh.e_phentsize < sizeof(Elf32_Phdr) || off + sizeof(Elf32_Phdr) > image.size())
+        {
+            return fail("program header out of range");
+        }
+        Elf32_Phdr ph;
+        std::memcpy(&ph, image.data() + off, sizeof(ph));
+        if(ph.p_type != PT_LOAD || ph.p_memsz == 0)
+        {
+            continue;
+        }
+        if(ph.p_filesz > ph.p_memsz || static_cast<uint64_t>(ph.p_offset) + ph.p_filesz > image.size())
+        {
+            return fail("segment out of range");
+        }
+        if(static_cast<uint64_t>(ph.p_vaddr) + ph.p_memsz > mem.get_size())
+        {
+            return fail("segment at " + to_hex0x32(ph.p_vaddr) + " does not fit in memory");
+        }
+
+        mem.write_block(ph.p_vaddr, image.data() + ph.p_offset, ph.p_filesz);
+        mem.fill_block(ph.p_vaddr + ph.p_filesz, 0, ph.p_memsz - ph.p_filesz); //.bss
+    }
+    return true;
+}
+
+/**
+ * @brief Read the symbol table, if any.
+ *
+ * Keep every named function, object or untyped symbol defined in a section. When several share an
+ * address the first one in the table wins. A missing or malformed table just leaves no symbols.
+ *
+ * @param image Contents of the whole file.
+ */
+void elf_loader::load_symbols(const std::vector<uint8_t> &image)
+{
+    Elf32_Ehdr eh;
+    std::memcpy(&eh, image.data(), sizeof(eh));
+    if(eh.e_shentsize < sizeof(Elf32_Shdr) || eh.e_shoff + static_cast<uint64_t>(eh.e_shnum) * eh.e_shentsize > image.size())
+    {
+        return;
+    }
+
+    auto section = [&](uint32_t i) //Fetch a section header.
+    {
+        Elf32_Shdr sh;
+        std::memcpy(&sh, image.data() + eh.e_shoff + i * eh.e_shentsize, sizeof(sh));
+        return sh;
+    };
+
+    for(uint32_t i = 0; i < eh.e_shnum; ++i)
+    {
+        Elf32_Shdr sh = section(i);
+        if(sh.sh_type != SHT_SYMTAB || sh.sh_link >= eh.e_shnum || sh.sh_entsize < sizeof(Elf32_Sym))
+        {
+            continue;
+        }
+        Elf32_Shdr strtab = section(sh.sh_link);
+        if(static_cast<uint64_t>(sh.sh_offset) + sh.sh_size > image.size() || static_cast<uint64_t>(strtab.sh_offset) + strtab.sh_size > image.size())
+        {
+            continue;
+        }
+
+        for(uint32_t off = 0; off + sizeof(Elf32_Sym) <= sh.sh_size; off += sh.sh_entsize)
+        {
+            Elf32_Sym sym;
+            std::memcpy(&sym, image.data() + sh.sh_offset + off, sizeof(sym));
+            int type = ELF32_ST_TYPE(sym.st_info);
+            if(sym.st_name == 0 || sym.st_name >= strtab.sh_size || sym.st_shndx == SHN_UNDEF || sym.st_shndx >= SHN_LORESERVE)
+            {
+                continue;
+            }
+            if(type != STT_FUNC && type != STT_OBJECT && type != STT_NOTYPE)
+            {
+                continue;
+            }
+
+            const char *name = reinterpret_cast<const char*>(image.data() + strtab.sh_offset + sym.st_name);
+            std::string s(name, strnlen(name, strtab.sh_size - sym.st_name));
+            if(s.compare(0, 2, ".L") != 0 && s[0] != '$') //Skip assembler local labels and mapping symbols such as $x and $d.
+            {
+                symbols.emplace(sym.st_value, s);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Get the entry point address.
+ *
+ * @return Address execution should start at.
+ */
+uint32_t elf_loader::get_entry() const
+{
+    return entry;
+}
+
+/**
+ * @brief Check if the executable uses RV32C instructions.
+ *
+ * @return true if the linker marked it as containing compressed instructions.
+ */
+bool elf_loader::has_rvc() const
+{
+    return rvc;
+}
+
+/**
+ * @brief Get the symbols by address.
+ *
+ * @return Map from address to symbol name.
+ */
+const std::map<uint32_t, std::string>& elf_loader::get_symbols() const
+{
+    return symbols;
+}
+
+/**
+ * @brief Name an address as symbol+offset.
+ *
+ * @param addr Address to name.
+ * @return Name of the closest symbol at or below addr with any offset in hex, or an empty string if there is none.
+ */
+std::string elf_loader::symbolize(uint32_t addr) const
+{
+    auto it = symbols.upper_bound(addr);
+    if(it == symbols.begin())
+    {
+        return "";
+    }
+    --it;
+    if(it->first == addr)
+    {
+        return it->second;
+    }
+    return it->second + "+" + to_hex0x32(addr - it->first);
+}
+
+/**
+ * @brief Report a load error.
+ *
+ * @param msg Description of the problem.
+ * @return false, so callers can return the result directly.
+ */
+bool elf_loader::fail(const std::string &msg) const
+{
+    std::cerr << "Can't load ELF file '" << fname << "': " << msg << "." << std::endl;
+    return false;
+}
@@ -0,0 +1,48 @@
+#ifndef H_ELF
+#define H_ELF
+
+//***************************************************************************
+//
+//  Matt Borek
+//  z1951125
+//  CSCI463-1
+//
+//  I certify that this is my own work and where appropriate an extension
+//  of the starter code provided for the assignment.
+//
+//***************************************************************************
+#include <map>
+#include <vector>
+#include "memory.h"
+
+/**
+ * @brief ELF32 Executable Loader Class
+ *
+ * Loads little-endian RISC-V ELF32 executables into simulated memory by placing each PT_LOAD segment
+ * at its virtual address and zero filling the rest of the segment (.bss). The entry point and the
+ * function and label symbols are kept for the simulator to start at and to name addresses with.
+ *
+ */
+class elf_loader : public hex
+{
+public:
+    static bool is_elf(const std::string &fname);                     //Check if a file starts with the ELF magic number.
+
+    bool load(const std::string &fname, memory &mem);                //Load an executable into memory.
+    uint32_t get_entry() const;                                      //Get the entry point address.
+    bool has_rvc() const;                                            //Check if the executable uses RV32C instructions.
+    const std::map<uint32_t, std::string>& get_symbols() const;      //Get the symbols by address.
+    std::string symbolize(uint32_t addr) const;                      //Name an address as symbol+offset.
+
+private:
+    bool load_segments(const std::vector<uint8_t> &image, memory &mem);  //Place the PT_LOAD segments.
+    void load_symbols(const std::vector<uint8_t> &image);                //Read the symbol table, if any.
+    bool fail(const std::string &msg) const;                             //Report a load error.
+
+    std::string fname;                       //File being loaded, for error messages.
+    uint32_t entry = { 0 };                  //Entry point address.
+    bool rvc = { false };                    //Set when e_flags has EF_RISCV_RVC.
+    std::map<uint32_t, std::string> symbols; //Symbol names by address.
+};
+
+#endif
@@ -9,82 +9,187 @@
 //
 //***************************************************************************
 
-#include <iostream>
-#include <string>
-#include <iomanip>
 #include "hex.h"
 
+/**
+ * @brief Format the low digits of a value, most significant first.
+ * 
+ * Each nibble is looked up in a table of digits, so nothing is allocated and no stream is involved.
+ * 
+ * @param i Value to format.
+ * @param digits Number of hexidecimal digits, up to 8.
+ * @param buf Buffer of at least digits + 1 characters.
+ * @return Pointer to the terminating null written after the digits.
+ */
+char* hex::format(uint32_t i, uint32_t digits, char *buf)
+{
+    static const char nibbles[] = "0123456789abcdef";
+    for(uint32_t d = digits; d > 0; --d, i >>= 4) //Fill from the least significant digit backwards.
+    {
+        buf[d - 1] = nibbles[i & 0xf];
+    }
+    buf[digits] = '\0';
+    return buf + digits;
+}
+
+/**
+ * @brief Format 8 bit in hex.
+ * 
+ * @param i Unsigned 8bit integer to format.
+ * @param buf Buffer of at least 3 characters.
+ * @return Pointer to the terminating null.
+ */
+char* hex::to_hex8(uint8_t i, char *buf)
+{
+    return format(i, 2, buf);
+}
+
+/**
+ * @brief Format 16 bit in hex.
+ * 
+ * @param i Unsigned 16bit integer to format.
+ * @param buf Buffer of at least 5 characters.
+ * @return Pointer to the terminating null.
+ */
+char* hex::to_hex16(uint16_t i, char *buf)
+{
+    return format(i, 4, buf);
+}
+
+/**
+ * @brief Format 32 bit in hex.
+ * 
+ * @param i Unsigned 32bit integer to format.
+ * @param buf Buffer of at least 9 characters.
+ * @return Pointer to the terminating null.
+ */
+char* hex::to_hex32(uint32_t i, char *buf)
+{
+    return format(i, 8, buf);
+}
+
+/**
+ * @brief Format 32 bit in hex with "0x" prefix.
+ * 
+ * @param i Unsigned 32bit integer to format.
+ * @param buf Buffer of at least 11 characters.
+ * @return Pointer to the terminating null.
+ */
+char* hex::to_hex0x32(uint32_t i, char *buf)
+{
+    buf[0] = '0';
+    buf[1] = 'x';
+    return format(i, 8, buf + 2);
+}
+
+/**
+ * @brief Format 20 least significant bits in hex with "0x" prefix.
+ * 
+ * @param i Unsigned 32bit integer to truncate and format.
+ * @param buf Buffer of at least 8 characters.
+ * @return Pointer to the terminating null.
+ */
+char* hex::to_hex0x20(uint32_t i, char *buf)
+{
+    buf[0] = '0';
+    buf[1] = 'x';
+    return format(i, 5, buf + 2); //Only the 20 least significant bits have digits.
+}
+
+/**
+ * @brief Format 12 least significant bits in hex with "0x" prefix.
+ * 
+ * @param i Unsigned 32bit integer to truncate and format.
+ * @param buf Buffer of at least 6 characters.
+ * @return Pointer to the terminating null.
+ */
+char* hex::to_hex0x12(uint32_t i, char *buf)
+{
+    buf[0] = '0';
+    buf[1] = 'x';
+    return format(i, 3, buf + 2); //Only the 12 least significant bits have digits.
+}
+
 /**
  * @brief Print 8 bit in hex.
  * 
- * Creates a stringstream object, formats, then extracts and returns formatted string.
+ * Wraps the buffer overload.
  * 
  * @param i Unsigned 8bit integer to reformat to hexidecimal.
  * @return string representing integer in hexidecimal form.
  */
 std::string hex::to_hex8(uint8_t i)
 {
-    std::ostringstream os;
-    os << std::hex << std::setfill('0') << std::setw(2) << static_cast<uint16_t>(i);
-    return os.str();
+    char buf[3];
+    return std::string(buf, to_hex8(i, buf));
+}
+
+/**
+ * @brief Print 16 bit in hex.
+ * 
+ * Wraps the buffer overload.
+ * 
+ * @param i Unsigned 16bit integer to reformat to hexidecimal.
+ * @return string representing integer in hexidecimal form.
+ */
+std::string hex::to_hex16(uint16_t i)
+{
+    char buf[5];
+    return std::string(buf, to_hex16(i, buf));
 }
 
 /**
  * @brief Print 32 bit in hex.
  * 
- * Creates a stringstream object, formats, then extracts and returns formatted string.
+ * Wraps the buffer overload.
  * 
  * @param i Unsigned 16bit integer to reformat to hexidecimal.
  * @return string representing integer in hexidecimal form. 
  */
 std::string hex::to_hex32(uint32_t i)
 {
-    std::ostringstream os;
-    os << std::hex << std::setfill('0') << std::setw(8) << i;
-    return os.str();
+    char buf[9];
+    return std::string(buf, to_hex32(i, buf));
 }
 
 /**
  * @brief Print 32 bit in hex with "0x" prefix.
  * 
- * Concatonates "0x" with the result of to_hex32().
+ * Wraps the buffer overload.
  * 
  * @param i Unsigned 32bit integer to reformat to hexidecimal.
  * @return string representing integer in hexidecimal form with "0x" prefix.
  */
 std::string hex::to_hex0x32(uint32_t i)
 {
-    return std::string("0x")+to_hex32(i);
+    char buf[11];
+    return std::string(buf, to_hex0x32(i, buf));
 }
 
 /**
  * @brief Print 20 least significant bits in hex with "0x" prefix.
  * 
- * Creates a stringstream object, formats, then extracts and returns formatted string.
+ * Wraps the buffer overload.
  * 
  * @param i Unsigned 32bit integer to truncate and reformat to hexidecimal.
  * @return string representing integer in hexidecimal form with "0x" prefix.
  */
 std::string hex::to_hex0x20(uint32_t i)
 {
-    i &= i & 0x000fffff; //Select 20 least significant bits.
-    std::ostringstream os;
-    os << "0x" << std::hex << std::setfill('0') << std::setw(5) << i;
-    return os.str(); 
+    char buf[8];
+    return std::string(buf, to_hex0x20(i, buf));
 }
 
 /**
  * @brief Print 12 least significant bits in hex with "0x" prefix.
  * 
- * Creates a stringstream object, formats, then extracts and returns formatted string.
+ * Wraps the buffer overload.
  * 
  * @param i Unsigned 32bit integer to truncate and reformat to hexidecimal.
  * @return string representing integer in hexidecimal form with "0x" prefix.
  */
 std::string hex::to_hex0x12(uint32_t i)
 {
-    i &= i & 0x00000fff; //Select 12 least significant bits.
-    std::ostringstream os;
-    os << "0x" << std::hex << std::setfill('0') << std::setw(3) << i;
-    return os.str(); 
+    char buf[6];
+    return std::string(buf, to_hex0x12(i, buf));
 }
\ No newline at end of file
@@ -31,6 +31,18 @@ public:
 
     static std::string to_hex0x20(uint32_t i);  //Print 20 least significant bits  with an "0x" prefix.
     static std::string to_hex0x12(uint32_t i);  //Print 20 least significant bits  with an "0x" prefix.
+
+    //Formatting into a caller's buffer, which must hold the digits, any prefix and a terminating null.
+    //Each returns a pointer to the null so calls can be chained to build a line.
+    static char* to_hex8(uint8_t i, char *buf);      //Format 8 bit in hex.
+    static char* to_hex16(uint16_t i, char *buf);    //Format 16 bit in hex.
+    static char* to_hex32(uint32_t i, char *buf);    //Format 32 bit in hex.
+    static char* to_hex0x32(uint32_t i, char *buf);  //Format 32 bit in hex with an "0x" prefix.
+    static char* to_hex0x20(uint32_t i, char *buf);  //Format 20 least significant bits with an "0x" prefix.
+    static char* to_hex0x12(uint32_t i, char *buf);  //Format 12 least significant bits with an "0x" prefix.
+
+private:
+    static char* format(uint32_t i, uint32_t digits, char *buf);  //Format the low digits of a value, most significant first.
 };
 
 #endif
\ No newline at end of file
@@ -10,10 +10,20 @@
 //***************************************************************************
 #include <iostream>
 #include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <algorithm>
 #include <getopt.h>
 #include "memory.h"
 #include "rv32i_decode.h"
 #include "cpu_single_hart.h"
+#include "cpu_multi_hart.h"
+#include "elf_loader.h"
 
 using std::cerr;
 using std::cout;
@@ -27,29 +37,115 @@ using std::endl;
  */
 static void usage()
 {
-	cerr << "Usage: rv32i [-d] [-i] [-r] [-z] [-l exec-limit] [-m hex-mem-size] infile" << endl;
+	cerr << "Usage: rv32i [-c] [-d] [-f] [-i] [-r] [-s] [-t] [-u] [-z] [-b trace] [-e engine] [-l exec-limit] [-m hex-mem-size] [-p harts] [-q quantum] [-B predictors] [-C checkpoint] [-D l1d] [-I l1i] [-P profile] [-R[period]] [-S checkpoint] [-T timing] infile" << endl;
+	cerr << "    -b record a binary trace of every instruction executed to the file, rv32i_trace prints it like -i" << endl;
+	cerr << "    -B model branch predictors, a list of static, bimodal, gshare or tournament[:bits], all, and ras:depth" << endl;
+	cerr << "    -c fetch RV32C compressed instructions (implied by an ELF executable marked RVC)" << endl;
+	cerr << "    -C continue from a checkpoint file instead of loading infile" << endl;
 	cerr << "    -d show disassembly before program execution" << endl;
+	cerr << "    -D model an L1 data cache, size:ways:line[:lru|fifo|random] in bytes, e.g. 16384:4:64:lru" << endl;
+	cerr << "    -e execution engine: step (default), block, jit or threaded" << endl;
+	cerr << "    -f fold runs of identical lines in the -z memory dump into a single *" << endl;
 	cerr << "    -i show instruction printing during execution" << endl;
+	cerr << "    -I model an L1 instruction cache, described like -D" << endl;
 	cerr << "    -l maximum number of instructions to exec" << endl;
-	cerr << "    -m specify memory size (default = 0x100)" << endl;
+	cerr << "    -m specify memory size (default = 0x100, up to 0xfffffff0)" << endl;
+	cerr << "    -P write a flat profile to the file and collapsed call stacks to the file with .folded added" << endl;
+	cerr << "    -p number of harts, each on its own host thread and with its own stack (default = 1)" << endl;
+	cerr << "    -q instructions each hart runs between synchronizations (default = 10000)" << endl;
 	cerr << "    -r show register printing during execution" << endl;
+	cerr << "    -R sample the -P profile every period instructions (default = 10007) instead of counting every one" << endl;
+	cerr << "    -s skip never touched memory pages in the -z dump" << endl;
+	cerr << "    -S save a checkpoint file after simulation" << endl;
+	cerr << "    -T model pipeline timing, load-use[:branch[:memory]] stall cycles, e.g. 1:2:20 (default 1:2:0)" << endl;
+	cerr << "    -t show load time, and execution time and MIPS after simulation" << endl;
+	cerr << "    -u like -r, but show only the pc and the registers changed since the previous dump" << endl;
 	cerr << "    -z show a dump of the regs & memory after simulation" << endl;
+	cerr << "    infile is a flat binary loaded at address 0 or a RISC-V ELF32 executable" << endl;
 	exit(1); //Terminate program.
 }
 
 /**
- * @brief Disassemble memory.
+ * @brief Disassemble part of memory.
+ * 
+ * With RV32C each instruction is decoded at its own length, 16-bit ones shown right aligned under the words.
  * 
  * @param mem vector object to access and disassemble.
+ * @param rvc Whether compressed instructions are decoded.
+ * @param begin Address of the first instruction.
+ * @param end Address the range stops before.
+ * @param out String the lines are appended to.
  */
-static void disassemble(const memory &mem)
+static void disassemble_range(const memory &mem, bool rvc, uint32_t begin, uint32_t end, std::string &out)
 {
-	for(uint32_t addr = 0; addr < mem.get_size(); addr+=4)
+	char buf[9];
+	for(uint32_t addr = begin; addr < end; addr+=4)
 	{
+		bool compressed = rvc && rv32i_decode::is_compressed(mem.get16(addr));
+		if(rvc && !compressed && static_cast<uint64_t>(addr) + 4 > mem.get_size()) //A lone halfword at the end of memory.
+			break;
+		out.append(buf, hex::to_hex32(addr, buf));
+		out += ": ";
+		if(compressed)
+		{
+			uint16_t insn = mem.get16(addr);
+			out += "    ";
+			out.append(buf, hex::to_hex16(insn, buf));
+			out += "  " + rv32i_decode::decode_compressed(addr, insn) + "\n";
+			addr -= 2; //Only a halfword was used.
+			continue;
+		}
 		uint32_t insn = mem.get32(addr);
-		std::cout << hex::to_hex32(addr) << ": ";
-		std::cout << hex::to_hex32(insn) << "  " << rv32i_decode::decode(addr, insn) << std::endl;
+		out.append(buf, hex::to_hex32(insn, buf));
+		out += "  " + rv32i_decode::decode(addr, insn) + "\n";
+	}
+}
+
+/**
+ * @brief Disassemble memory.
+ * 
+ * Memory is split into chunks that start on instruction boundaries, found by a quick pass over the
+ * instruction lengths. Batches of chunks are decoded into their own buffers on every host core, then
+ * written in address order, so the output is the same as decoding one instruction after another.
+ * 
+ * @param mem vector object to access and disassemble.
+ * @param rvc Whether compressed instructions are decoded.
+ */
+static void disassemble(const memory &mem, bool rvc)
+{
+	const uint32_t chunk_bytes = 0x4000; //Roughly four thousand lines a chunk, more with RV32C.
+	std::vector<uint32_t> starts = { 0 };  //First address of each chunk, then the end of memory.
+	for(uint32_t addr = 0; addr < mem.get_size(); addr += (rvc && rv32i_decode::is_compressed(mem.get16(addr))) ? 2 : 4)
+	{
+		if(addr - starts.back() >= chunk_bytes)
+			starts.push_back(addr);
 	}
+	starts.push_back(mem.get_size());
+
+	size_t chunks = starts.size() - 1;
+	size_t workers = std::max(1u, std::thread::hardware_concurrency());
+	for(size_t first = 0; first < chunks; first += workers * 4) //Enough chunks per batch to even out the threads.
+	{
+		size_t count = std::min(chunks - first, workers * 4);
+		std::vector<std::string> out(count);
+		std::atomic<size_t> next(0);
+		auto work = [&]()
+		{
+			for(size_t i = next++; i < count; i = next++)
+				disassemble_range(mem, rvc, starts[first + i], starts[first + i + 1], out[i]);
+		};
+
+		std::vector<std::thread> threads;
+		for(size_t t = 1; t < std::min(workers, count); ++t)
+			threads.emplace_back(work);
+		work(); //This thread takes chunks too.
+		for(std::thread &t : threads)
+			t.join();
+
+		for(const std::string &s : out)
+			std::cout << s;
+	}
+	std::cout.flush();
 }
 
 /**
@@ -68,17 +164,79 @@ int main(int argc, char **argv)
 	bool preDisassembly = false;
 	bool showInstructions = false;
 	bool showRegisters = false;
+	bool showRegisterChanges = false;
 	bool postDump = false;
+	bool showTiming = false;
+	bool skipUntouched = false;
+	bool foldLines = false;
+	bool rvc = false;
+	std::string continueFrom;
+	std::string saveTo;
+	std::string profileTo;
+	std::string traceTo;
+	uint64_t samplePeriod = 0;
+	cache_sim::config l1i, l1d;	// size zero means no cache
+	branch_unit::config branches;	// no predictors means no branch model
+	pipeline_model::config timing;
+	bool timed = false;
+	uint32_t hartCount = 1;
+	uint64_t quantum = 10000;
+	cpu_single_hart::exec_engine engine = cpu_single_hart::engine_step;
 
 	int opt;
-	while ((opt = getopt(argc, argv, "dil:m:rz")) != -1) //Test input arguments.
+	while ((opt = getopt(argc, argv, "b:B:cC:dD:e:fiI:l:m:p:P:q:rR::sS:tT:uz")) != -1) //Test input arguments.
 	{
 		switch(opt) //Switch on command line argument.
 		{
+			case 'b': { traceTo = optarg; } break; //If -b flag specified, record a binary trace of the simulation.
+
+			case 'B': //If -B flag specified, model branch predictors.
+			{
+				if (!branch_unit::parse(optarg, branches))
+					usage();
+			}
+			break;
+
+			case 'c': { rvc = true; } break; //If -c flag specified, fetch RV32C compressed instructions.
+
+			case 'C': { continueFrom = optarg; } break; //If -C flag specified, resume from a checkpoint instead of loading a program.
+
 			case 'd': { preDisassembly = true; } break; //If -d flag specified, show a disassembly of the entire memory before program simulation begins.
 
+			case 'D': //If -D flag specified, model an L1 data cache.
+			{
+				if (!cache_sim::parse(optarg, l1d))
+					usage();
+			}
+			break;
+
+			case 'e': //If -e flag specified, select the execution engine.
+			{
+				std::string name(optarg);
+				if(name == "step")
+					engine = cpu_single_hart::engine_step;
+				else if(name == "block")
+					engine = cpu_single_hart::engine_block;
+				else if(name == "jit")
+					engine = cpu_single_hart::engine_jit;
+				else if(name == "threaded")
+					engine = cpu_single_hart::engine_threaded;
+				else
+					usage();
+			}
+			break;
+
+			case 'f': { foldLines = true; } break; //If -f flag specified, fold runs of identical lines in the memory dump.
+
 			case 'i': { showInstructions = true; } break; //If -i flag specified, show instruction printing during execution.
 
+			case 'I': //If -I flag specified, model an L1 instruction cache.
+			{
+				if (!cache_sim::parse(optarg, l1i))
+					usage();
+			}
+			break;
+
 			case 'l': //If -l flag specified, update maximum limit of instructions to execute. Zero means there is no limit.
 			{
 				std::istringstream iss(optarg);
@@ -93,8 +251,57 @@ int main(int argc, char **argv)
 			}
 			break;
 
+			case 'p': //If -p flag specified, run that many harts over the same memory.
+			{
+				std::istringstream iss(optarg);
+				iss >> hartCount;
+				if (hartCount == 0)
+					usage();
+			}
+			break;
+
+			case 'P': { profileTo = optarg; } break; //If -P flag specified, profile the simulation and write the results.
+
+			case 'q': //If -q flag specified, update the instructions each hart runs between synchronizations.
+			{
+				std::istringstream iss(optarg);
+				iss >> quantum;
+				if (quantum == 0)
+					usage();
+			}
+			break;
+
 			case 'r': { showRegisters = true; } break; //If -r flag specified, show a dump of the hart (GP-registers and pc) status before each instruction is simulated.
 
+			case 'u': { showRegisters = showRegisterChanges = true; } break; //If -u flag specified, show only what changed in the hart status before each instruction.
+
+			case 'R': //If -R flag specified, sample the profile instead of counting every instruction.
+			{
+				samplePeriod = 10007; //Prime, so samples do not keep landing on the same loop iteration.
+				if (optarg)
+				{
+					std::istringstream iss(optarg);
+					iss >> samplePeriod;
+				}
+				if (samplePeriod == 0)
+					usage();
+			}
+			break;
+
+			case 's': { skipUntouched = true; } break; //If -s flag specified, leave pages that were never touched out of the memory dump.
+
+			case 'S': { saveTo = optarg; } break; //If -S flag specified, save a checkpoint after the simulation.
+
+			case 't': { showTiming = true; } break; //If -t flag specified, report execution time and MIPS after simulation.
+
+			case 'T': //If -T flag specified, model pipeline timing.
+			{
+				if (!pipeline_model::parse(optarg, timing))
+					usage();
+				timed = true;
+			}
+			break;
+
 			case 'z': { postDump = true; } break; //If -z flag specified, show a dump of the hart status and memory after the simulation has halted.
 
 		default: /* '?' */
@@ -102,30 +309,145 @@ int main(int argc, char **argv)
 		}
 	}
 
-	if (optind >= argc)
+	if (optind >= argc && continueFrom.empty())
 		usage();	// missing filename
+	if (hartCount > 1 && !(continueFrom.empty() && saveTo.empty()))
+		usage();	// checkpoints hold a single hart
+	if (hartCount > 1 && !profileTo.empty())
+		usage();	// profiles follow a single hart
+	if (hartCount > 1 && !traceTo.empty())
+	{
+		cerr << "Tracing follows a single hart, -b can't be used with -p " << hartCount << "." << endl;
+		return 1;
+	}
+	if (samplePeriod != 0 && profileTo.empty())
+		usage();	// samples need somewhere to go
+
+	auto loadStart = std::chrono::steady_clock::now();
+	cpu_single_hart::checkpoint cp;
+	std::unique_ptr<memory> memPtr;
+	if (!continueFrom.empty()) //Fork memory from the checkpoint, its size replaces -m.
+	{
+		if (!cpu_single_hart::read_checkpoint(continueFrom, cp))
+		{
+			cerr << "Can't read checkpoint file '" << continueFrom << "'." << endl;
+			usage();
+		}
+		memPtr.reset(new memory(cp.mem));
+	}
+	else
+		memPtr.reset(new memory(memory_limit)); //Create and initialize memory by set memory limit.
+	memory &mem = *memPtr;
+
+	uint32_t entry = 0;
+	elf_loader elf;
+	if (continueFrom.empty() && elf_loader::is_elf(argv[optind])) //Load ELF executables at their segment addresses and start at their entry point.
+	{
+		if (!elf.load(argv[optind], mem))
+			usage();
+		entry = elf.get_entry();
+		rvc = rvc || elf.has_rvc();
+	}
+	else if (continueFrom.empty() && !mem.load_file(argv[optind])) //Test if file opened and loaded values.
+		usage();
+	std::chrono::duration<double> loadTime = std::chrono::steady_clock::now() - loadStart;
 
-	memory mem(memory_limit); //Create and initialize memory by set memory limit.
+	if(showTiming) //Report the startup cost apart from execution.
+	{
+		cout << "Load time: " << std::fixed << std::setprecision(3) << loadTime.count() << " s" << std::defaultfloat << endl;
+	}
+
+	if(preDisassembly) //Disassemble if flag specified.
+	{
+		disassemble(mem, rvc);
+	}
+
+	if(hartCount > 1) //Run several harts over the same memory.
+	{
+		cpu_multi_hart cpu(mem, hartCount);
+		cpu.set_reset_pc(entry);
+		cpu.reset();
+		cpu.set_show_instructions(showInstructions);
+		cpu.set_show_registers(showRegisters);
+		cpu.set_show_register_changes(showRegisterChanges);
+		cpu.set_engine(engine);
+		cpu.set_show_timing(showTiming);
+		cpu.set_quantum(quantum);
+		cpu.set_rvc(rvc);
+		if (l1i.size)
+			cpu.set_l1i(l1i);
+		if (l1d.size)
+			cpu.set_l1d(l1d);
+		if (!branches.predictors.empty())
+			cpu.set_branch_unit(branches);
+		if (timed)
+			cpu.set_timing(timing);
+		cpu.run(exec_limit);
+
+		if(postDump) //End with dumps if flag specified.
+		{
+			cpu.dump();
+			mem.dump(skipUntouched, foldLines);
+		}
+		return 0;
+	}
 
 	cpu_single_hart cpu(mem); ////Create a simulated CPU with a single hardware thread, passing in simulated memory.
+	cpu.set_reset_pc(entry);
 	cpu.reset();
 	cpu.set_show_instructions(showInstructions);
 	cpu.set_show_registers(showRegisters);
+	cpu.set_show_register_changes(showRegisterChanges);
+	cpu.set_engine(engine);
+	cpu.set_show_timing(showTiming);
+	cpu.set_rvc(rvc);
+	cpu.set_profile(!profileTo.empty(), samplePeriod);
+	if (l1i.size)
+		cpu.set_l1i(l1i);
+	if (l1d.size)
+		cpu.set_l1d(l1d);
+	if (!branches.predictors.empty())
+		cpu.set_branch_unit(branches);
+	if (timed)
+		cpu.set_timing(timing);
+	if (!continueFrom.empty()) //Pick up exactly where the checkpoint left off.
+		cpu.restore_state(cp.hart);
+	if (!traceTo.empty() && !cpu.set_trace_file(traceTo)) //Start tracing from wherever execution starts.
+	{
+		cerr << "Can't write trace file '" << traceTo << "'." << endl;
+		return 1;
+	}
 
-	if (!mem.load_file(argv[optind])) //Test if file opened and loaded values.
-		usage();
+	cpu.run(exec_limit);
 
-	if(preDisassembly) //Disassemble if flag specified.
+	if(!cpu.close_trace()) //Every record is on disk before anything else is reported.
 	{
-		disassemble(mem);
+		cerr << "Can't write trace file '" << traceTo << "'." << endl;
+		return 1;
 	}
 
-	cpu.run(exec_limit);
+	if(!saveTo.empty() && !cpu.write_checkpoint(saveTo)) //Save the state to continue from later if flag specified.
+	{
+		cerr << "Can't write checkpoint file '" << saveTo << "'." << endl;
+		return 1;
+	}
+
+	if(!profileTo.empty() && cpu.get_profile()) //Write the profile if flag specified.
+	{
+		std::ofstream flat(profileTo), folded(profileTo + ".folded");
+		cpu.get_profile()->write_flat(flat, mem, elf);
+		cpu.get_profile()->write_collapsed(folded, elf);
+		if (!flat || !folded)
+		{
+			cerr << "Can't write profile '" << profileTo << "'." << endl;
+			return 1;
+		}
+	}
 
 	if(postDump) //End with dumps if flag specified.
 	{
 		cpu.dump();
-		mem.dump();
+		mem.dump(skipUntouched, foldLines);
 	}
 
 	return 0;
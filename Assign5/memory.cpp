@@ -11,30 +11,661 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <algorithm>
+#include <new>
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
 #include "memory.h"
 
+memory::region_chunk memory::regions;
+struct sigaction memory::previous_action;
+
+static std::atomic_flag commit_lock = ATOMIC_FLAG_INIT;  //Serializes page commits between threads.
+static uint8_t fill_pattern[1 << 16];                    //Contents of a freshly committed page.
+
+/**
+ * @brief Read a watch flag that harts on other threads may be setting.
+ * 
+ * @param watched Per-page watch flags.
+ * @param page Page number.
+ * @param bits Watch flag bits to test.
+ * @return true if the page is watched for any of bits.
+ */
+static inline bool is_watched(const std::vector<uint8_t> &watched, uint64_t page, uint8_t bits)
+{
+    return (__atomic_load_n(&watched[page], __ATOMIC_SEQ_CST) & bits) != 0;
+}
+
+/**
+ * @brief Read a page flag that the fault handler may be setting on another thread.
+ * 
+ * Pairs with set_flag(), so a thread that sees a page committed also sees it accessible.
+ * 
+ * @param flags Per host page touched or dirty flags.
+ * @param page Host page number.
+ * @return true if the flag is set.
+ */
+static inline bool get_flag(const std::vector<uint8_t> &flags, size_t page)
+{
+    return __atomic_load_n(&flags[page], __ATOMIC_ACQUIRE) != 0;
+}
+
+/**
+ * @brief Set or clear a page flag that other threads may be reading.
+ * 
+ * @param flags Per host page touched or dirty flags.
+ * @param page Host page number.
+ * @param val New value of the flag.
+ */
+static inline void set_flag(std::vector<uint8_t> &flags, size_t page, bool val)
+{
+    __atomic_store_n(&flags[page], val, __ATOMIC_RELEASE);
+}
+
 /**
  * @brief Construct a new memory vector.
  * 
- * Create memory object and resize to rounded value. Initializes to 0xa5.
+ * Create memory object and reserve the rounded size. Every byte reads as 0xa5 until written.
+ * Pages are committed lazily when possible, otherwise the whole memory is committed and filled here.
  * 
- * @param size Given memory size. Will be rounded up to nearest 16th byte.
+ * @param size Given memory size. Will be rounded up to nearest 16th byte, up to 0xfffffff0.
  */
 memory::memory(uint32_t size)
 {
-    size = (size+15)&0xfffffff0; //round the length up, mod-16.
-    mem.resize(size, 0xa5);
+    size = (size > max_size) ? max_size : (size+15)&0xfffffff0; //round the length up, mod-16.
+    reserve(size);
+
+    int file = handler_installed() ? memfd_create("rv32i-memory", MFD_CLOEXEC) : -1;
+    if(file >= 0 && ftruncate(file, map_len) != 0)
+    {
+        close(file);
+        file = -1;
+    }
+    map(file, MAP_SHARED);
+}
+
+/**
+ * @brief Fork a copy-on-write memory from a snapshot.
+ * 
+ * The snapshot's file is mapped privately, so pages are shared with the snapshot and every other fork
+ * of it until they are first written. Writes are tracked against the snapshot from the start.
+ * 
+ * @param snap Snapshot to start from.
+ */
+memory::memory(const std::shared_ptr<const memory_snapshot> &snap)
+{
+    reserve(snap->size);
+    origin = snap;
+    map(handler_installed() ? dup(snap->fd) : -1, MAP_PRIVATE);
+
+    if(fd < 0) //Committed eagerly, copy the snapshot in.
+    {
+        for(size_t page = 0; page < touched.size(); ++page)
+        {
+            if(snap->touched[page])
+            {
+                std::memcpy(mem + page * host_page, snap->data + page * host_page, host_page);
+            }
+        }
+    }
+    else
+    {
+        touched = snap->touched;
+    }
+    track(snap);
+}
+
+/**
+ * @brief Set up the page bookkeeping for a memory of size bytes.
+ * 
+ * @param size Memory size, already rounded.
+ */
+void memory::reserve(uint32_t size)
+{
+    mem_size = size;
+    host_page = sysconf(_SC_PAGESIZE);
+    map_len = std::max<size_t>((static_cast<size_t>(size) + host_page - 1) / host_page, 1) * host_page;
+    touched.resize(map_len / host_page, 0);
+    dirty.resize(map_len / host_page, 0);
+    watched.resize((static_cast<size_t>(size) + page_size - 1) / page_size, 0);
+}
+
+/**
+ * @brief Map the backing store, falling back to committing it eagerly.
+ * 
+ * @param file Anonymous file to map with every page inaccessible, or -1 if there is none. Owned by the memory after the call.
+ * @param flags MAP_SHARED for a memory's own file, MAP_PRIVATE for a snapshot's file.
+ */
+void memory::map(int file, int flags)
+{
+    if(file >= 0)
+    {
+        void *p = mmap(nullptr, map_len, PROT_NONE, flags | MAP_NORESERVE, file, 0);
+        mem = (p == MAP_FAILED) ? nullptr : static_cast<uint8_t*>(p);
+    }
+
+    if(mem)
+    {
+        add_region();
+        fd = file;
+        private_map = (flags == MAP_PRIVATE);
+        return;
+    }
+
+    //No lazy commit available, commit everything now.
+    if(file >= 0)
+    {
+        close(file);
+    }
+    void *p = mmap(nullptr, map_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(p == MAP_FAILED)
+    {
+        throw std::bad_alloc();
+    }
+    mem = static_cast<uint8_t*>(p);
+    std::memset(mem, 0xa5, map_len);
+    std::fill(touched.begin(), touched.end(), 1);
+}
+
+/**
+ * @brief Install the fault handler once.
+ * 
+ * @return true if the handler is installed.
+ */
+bool memory::handler_installed()
+{
+    static bool installed = []() //Install the first touch handler once for every memory.
+    {
+        struct sigaction sa;
+        std::memset(&sa, 0, sizeof(sa));
+        sa.sa_sigaction = fault_handler;
+        sa.sa_flags = SA_SIGINFO;
+        sigemptyset(&sa.sa_mask);
+        std::memset(fill_pattern, 0xa5, sizeof(fill_pattern));
+        return sigaction(SIGSEGV, &sa, &previous_action) == 0;
+    }();
+    return installed;
 }
 
 /**
  * @brief Destroy the memory vector.
  * 
- * @note Redundant, done automatically at end of scope.
+ * Unregister from the fault handler and release the mapping.
  * 
  */
 memory::~memory()
 {
+    remove_region();
+    munmap(mem, map_len);
+    if(fd >= 0)
+    {
+        close(fd);
+    }
+}
+
+/**
+ * @brief Commit pages on first touch.
+ * 
+ * Called for every SIGSEGV. A fault on a reserved but uncommitted page of any memory commits the page,
+ * and a fault on a write protected page records the write. Either way the handler returns so the access
+ * is retried. If the host can not supply the page the simulator reports it and exits, leaving the
+ * disposition alone. Anything else goes to the previous disposition.
+ * 
+ * @param sig Signal number.
+ * @param info Details of the fault, including the faulting address.
+ * @param ucontext Context of the interrupted thread.
+ */
+void memory::fault_handler(int sig, siginfo_t *info, void *ucontext)
+{
+    uint8_t *addr = static_cast<uint8_t*>(info->si_addr);
+    for(region_chunk *c = &regions; c; c = c->next.load())
+    {
+        for(std::atomic<memory*> &r : c->slots)
+        {
+            memory *m = r.load();
+            if(m && addr >= m->mem && addr < m->mem + m->map_len)
+            {
+                if(m->fault_in(addr - m->mem))
+                {
+                    return; //Retry the access.
+                }
+                static const char msg[] = "Out of host memory committing a simulated memory page.\n";
+                ssize_t n = write(STDERR_FILENO, msg, sizeof(msg) - 1); //Only async-signal-safe calls here.
+                (void)n;
+                _exit(1);
+            }
+        }
+    }
+
+    sigaction(sig, &previous_action, nullptr); //Not ours, the access faults again with the old disposition.
+    (void)ucontext;
+}
+
+/**
+ * @brief Register with the fault handler.
+ * 
+ * Takes the first free slot, appending a chunk to the table when every slot is taken, so any number of
+ * memories and forks can be committed lazily at once.
+ */
+void memory::add_region()
+{
+    for(region_chunk *c = &regions; ; )
+    {
+        for(std::atomic<memory*> &r : c->slots)
+        {
+            memory *expected = nullptr;
+            if(r.compare_exchange_strong(expected, this))
+            {
+                return;
+            }
+        }
+        region_chunk *next = c->next.load();
+        if(!next)
+        {
+            region_chunk *added = new region_chunk(); //Value initialized, so every slot starts free.
+            if(c->next.compare_exchange_strong(next, added))
+            {
+                next = added;
+            }
+            else //Another thread appended one first, next now holds it.
+            {
+                delete added;
+            }
+        }
+        c = next;
+    }
+}
+
+/**
+ * @brief Unregister from the fault handler.
+ * 
+ * The slot is freed for reuse, chunks stay in the table.
+ */
+void memory::remove_region()
+{
+    for(region_chunk *c = &regions; c; c = c->next.load())
+    {
+        for(std::atomic<memory*> &r : c->slots)
+        {
+            memory *expected = this;
+            if(r.compare_exchange_strong(expected, nullptr))
+            {
+                return;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Commit or unprotect the host page holding offset.
+ * 
+ * A new page is filled through the file before it becomes accessible, so another thread can never
+ * see it unfilled or have its write clobbered by the fill. A write protected page is made writable
+ * and recorded as dirty.
+ * 
+ * @param offset Byte offset into the mapping.
+ * @return true if the page is now accessible.
+ */
+bool memory::fault_in(size_t offset)
+{
+    size_t page = offset / host_page;
+    while(commit_lock.test_and_set(std::memory_order_acquire)) //Another thread is committing.
+    {
+    }
+
+    bool ok = true; //Already handled by another thread unless one of these applies.
+    if(!get_flag(touched, page))
+    {
+        for(size_t done = 0; ok && done < host_page; done += sizeof(fill_pattern))
+        {
+            size_t n = std::min(sizeof(fill_pattern), host_page - done);
+            ok = pwrite(fd, fill_pattern, n, page * host_page + done) == static_cast<ssize_t>(n);
+        }
+        ok = ok && mprotect(mem + page * host_page, host_page, PROT_READ | PROT_WRITE) == 0;
+        set_flag(touched, page, ok);
+        if(ok && tracking)
+        {
+            mark_dirty(page);
+        }
+    }
+    else if(tracking && !get_flag(dirty, page))
+    {
+        ok = mprotect(mem + page * host_page, host_page, PROT_READ | PROT_WRITE) == 0;
+        if(ok)
+        {
+            mark_dirty(page);
+        }
+    }
+
+    commit_lock.clear(std::memory_order_release);
+    return ok;
+}
+
+/**
+ * @brief Record the first write to a page since the last snapshot.
+ * 
+ * @param page Host page number.
+ */
+void memory::mark_dirty(size_t page)
+{
+    set_flag(dirty, page, true);
+    dirty_pages.push_back(page); //Capacity was reserved by track(), so this never allocates in the handler.
+}
+
+/**
+ * @brief Take a snapshot of memory.
+ * 
+ * Copies every committed page into a new snapshot, then tracks writes against it.
+ * 
+ * @return The snapshot, shared so memories can be forked from it.
+ */
+std::shared_ptr<const memory_snapshot> memory::snapshot()
+{
+    std::shared_ptr<memory_snapshot> snap(new memory_snapshot(mem_size, host_page));
+    for(size_t page = 0; page < touched.size(); ++page)
+    {
+        if(get_flag(touched, page))
+        {
+            if(pwrite(snap->fd, mem + page * host_page, host_page, page * host_page) != static_cast<ssize_t>(host_page))
+            {
+                throw std::bad_alloc();
+            }
+            snap->touched[page] = 1;
+        }
+    }
+    track(snap);
+    return snap;
+}
+
+/**
+ * @brief Write protect committed pages against a snapshot.
+ * 
+ * Memory committed eagerly can not take faults, so it never tracks writes and restores in full.
+ * 
+ * @param snap Snapshot the memory now matches.
+ */
+void memory::track(const std::shared_ptr<const memory_snapshot> &snap)
+{
+    base = snap;
+    for(uint32_t page : dirty_pages)
+    {
+        set_flag(dirty, page, false);
+    }
+    dirty_pages.clear();
+    tracking = (fd >= 0);
+    if(!tracking)
+    {
+        return;
+    }
+
+    dirty_pages.reserve(touched.size());
+    for(size_t page = 0; page < touched.size(); ) //Protect each run of committed pages with one call.
+    {
+        size_t end = page;
+        while(end < touched.size() && get_flag(touched, end))
+        {
+            ++end;
+        }
+        if(end != page)
+        {
+            mprotect(mem + page * host_page, (end - page) * host_page, PROT_READ);
+        }
+        page = end + 1;
+    }
+}
+
+/**
+ * @brief Restore memory to a snapshot.
+ * 
+ * Restoring the snapshot the memory was last taken, restored or forked from only puts back the pages
+ * written since then. Any other snapshot puts back every page committed in either of them.
+ * 
+ * @param snap Snapshot to restore, which must be of a memory the same size.
+ * @return true if the memory was restored.
+ */
+bool memory::restore(const std::shared_ptr<const memory_snapshot> &snap)
+{
+    if(snap->size != mem_size || snap->host_page != host_page)
+    {
+        return false;
+    }
+
+    if(tracking && base == snap)
+    {
+        for(uint32_t page : dirty_pages)
+        {
+            restore_page(*snap, page);
+        }
+    }
+    else
+    {
+        for(size_t page = 0; page < touched.size(); ++page)
+        {
+            if(get_flag(touched, page) || snap->touched[page])
+            {
+                restore_page(*snap, page);
+            }
+        }
+    }
+    track(snap);
+    return true;
+}
+
+/**
+ * @brief Put back one page from a snapshot.
+ * 
+ * Pages that were never touched in the snapshot are released and made inaccessible again. A forked
+ * memory restoring the snapshot it maps just drops its private copy of the page.
+ * 
+ * @param snap Snapshot to copy from.
+ * @param page Host page number.
+ */
+void memory::restore_page(const memory_snapshot &snap, size_t page)
+{
+    uint8_t *p = mem + page * host_page;
+    if(fd < 0) //Committed eagerly, every page stays accessible.
+    {
+        if(snap.touched[page])
+        {
+            std::memcpy(p, snap.data + page * host_page, host_page);
+        }
+        else
+        {
+            std::memset(p, 0xa5, host_page);
+        }
+    }
+    else if(!snap.touched[page])
+    {
+        mprotect(p, host_page, PROT_NONE);
+        madvise(p, host_page, private_map ? MADV_DONTNEED : MADV_REMOVE);
+        set_flag(touched, page, false);
+    }
+    else if(private_map && origin.get() == &snap) //The file already holds the snapshot's page.
+    {
+        mprotect(p, host_page, PROT_READ);
+        madvise(p, host_page, MADV_DONTNEED);
+        set_flag(touched, page, true);
+    }
+    else
+    {
+        mprotect(p, host_page, PROT_READ | PROT_WRITE);
+        std::memcpy(p, snap.data + page * host_page, host_page);
+        set_flag(touched, page, true);
+    }
+
+    if(page * host_page < mem_size)
+    {
+        notify_range(page * host_page, std::min<uint64_t>(host_page, mem_size - page * host_page));
+    }
+}
+
+/**
+ * @brief Construct an empty snapshot.
+ * 
+ * @param size Size of the memory it is for.
+ * @param host_page Page size of that memory.
+ */
+memory_snapshot::memory_snapshot(uint32_t size, size_t host_page) : size(size), host_page(host_page)
+{
+    map_len = std::max<size_t>((static_cast<size_t>(size) + host_page - 1) / host_page, 1) * host_page;
+    touched.resize(map_len / host_page, 0);
+    fd = memfd_create("rv32i-snapshot", MFD_CLOEXEC);
+    void *p = MAP_FAILED;
+    if(fd >= 0 && ftruncate(fd, map_len) == 0)
+    {
+        p = mmap(nullptr, map_len, PROT_READ, MAP_SHARED | MAP_NORESERVE, fd, 0);
+    }
+    if(p == MAP_FAILED)
+    {
+        if(fd >= 0)
+        {
+            close(fd);
+        }
+        throw std::bad_alloc();
+    }
+    data = static_cast<const uint8_t*>(p);
+}
+
+/**
+ * @brief Destroy the snapshot.
+ * 
+ */
+memory_snapshot::~memory_snapshot()
+{
+    munmap(const_cast<uint8_t*>(data), map_len);
+    close(fd);
+}
+
+/**
+ * @brief Get the size of the memory it was taken from.
+ * 
+ * @return Memory size in bytes.
+ */
+uint32_t memory_snapshot::get_size() const
+{
+    return size;
+}
+
+/**
+ * @brief Write a little-endian 32-bit value.
+ * 
+ * @param out Stream to write to.
+ * @param v Value to write.
+ */
+static void write_u32(std::ostream &out, uint32_t v)
+{
+    char b[4] = { static_cast<char>(v), static_cast<char>(v >> 8), static_cast<char>(v >> 16), static_cast<char>(v >> 24) };
+    out.write(b, 4);
+}
+
+/**
+ * @brief Read a little-endian 32-bit value.
+ * 
+ * @param in Stream to read from.
+ * @param v Set to the value read.
+ * @return true if four bytes were read.
+ */
+static bool read_u32(std::istream &in, uint32_t &v)
+{
+    unsigned char b[4];
+    if(!in.read(reinterpret_cast<char*>(b), 4))
+    {
+        return false;
+    }
+    v = b[0] | (b[1] << 8) | (b[2] << 16) | (static_cast<uint32_t>(b[3]) << 24);
+    return true;
+}
+
+/**
+ * @brief Write the committed pages to a stream.
+ * 
+ * The format is the memory size followed by one (address, length, bytes) record for each run of
+ * committed pages and a zero length record, so only touched memory takes up space.
+ * 
+ * @param out Stream to write to.
+ * @return true if everything was written.
+ */
+bool memory_snapshot::save(std::ostream &out) const
+{
+    write_u32(out, size);
+    for(size_t page = 0; page < touched.size(); )
+    {
+        size_t end = page;
+        while(end < touched.size() && touched[end])
+        {
+            ++end;
+        }
+        uint64_t addr = page * host_page;
+        uint64_t len = std::min<uint64_t>(end * host_page, size) - std::min<uint64_t>(addr, size);
+        if(end != page && len != 0)
+        {
+            write_u32(out, addr);
+            write_u32(out, len);
+            out.write(reinterpret_cast<const char*>(data + addr), len);
+        }
+        page = end + 1;
+    }
+    write_u32(out, 0);
+    write_u32(out, 0);
+    return static_cast<bool>(out);
+}
+
+/**
+ * @brief Read a snapshot written by save().
+ * 
+ * Pages only partly covered by a record, which happens when the host page size differs from the one
+ * the snapshot was saved with, read as 0xa5 outside of it.
+ * 
+ * @param in Stream to read from.
+ * @return The snapshot, or nullptr if the stream is not a valid snapshot.
+ */
+std::shared_ptr<memory_snapshot> memory_snapshot::load(std::istream &in)
+{
+    uint32_t size;
+    if(!read_u32(in, size) || size > max_size || size % 16 != 0)
+    {
+        return nullptr;
+    }
+
+    std::shared_ptr<memory_snapshot> snap(new memory_snapshot(size, sysconf(_SC_PAGESIZE)));
+    std::vector<char> buf;
+    uint32_t addr, len;
+    while(read_u32(in, addr) && read_u32(in, len))
+    {
+        if(len == 0)
+        {
+            return snap;
+        }
+        if(static_cast<uint64_t>(addr) + len > size)
+        {
+            return nullptr;
+        }
+        buf.resize(len);
+        if(!in.read(buf.data(), len))
+        {
+            return nullptr;
+        }
 
+        size_t hp = snap->host_page;
+        for(uint64_t page = addr / hp; page * hp < static_cast<uint64_t>(addr) + len; ++page)
+        {
+            if(!snap->touched[page]) //Start each newly held page out as 0xa5.
+            {
+                std::vector<uint8_t> fill(hp, 0xa5);
+                if(pwrite(snap->fd, fill.data(), hp, page * hp) != static_cast<ssize_t>(hp))
+                {
+                    return nullptr;
+                }
+                snap->touched[page] = 1;
+            }
+        }
+        if(pwrite(snap->fd, buf.data(), len, addr) != static_cast<ssize_t>(len))
+        {
+            return nullptr;
+        }
+    }
+    return nullptr; //Missing the final record.
 }
 
 /**
@@ -48,7 +679,7 @@ memory::~memory()
  */
 bool memory::check_illegal(uint32_t addr) const
 {
-    if(addr < mem.size())
+    if(addr < mem_size)
     {
         return false;
     }
@@ -59,6 +690,20 @@ bool memory::check_illegal(uint32_t addr) const
     }
 }
 
+/**
+ * @brief Check a whole access is within memory.
+ * 
+ * Quietly tests every byte of an access at once, without printing any warnings.
+ * 
+ * @param addr First address of the access.
+ * @param len Number of bytes in the access.
+ * @return true if every byte from addr to addr+len-1 is within the simulated memory.
+ */
+bool memory::in_range(uint32_t addr, uint32_t len) const
+{
+    return addr < mem_size && mem_size - addr >= len;
+}
+
 /**
  * @brief Get memory size.
  * 
@@ -66,7 +711,7 @@ bool memory::check_illegal(uint32_t addr) const
  */
 uint32_t memory::get_size() const
 {
-    return mem.size();
+    return mem_size;
 }
 
 /**
@@ -92,26 +737,36 @@ uint8_t memory::get8(uint32_t addr) const
 /**
  * @brief Get 16bits of memory.
  * 
- * Call get8() twice to retrieve two bytes then concatenate in little endian order.
+ * Read both bytes directly when they are in range. Otherwise call get8() twice to retrieve two bytes
+ * then concatenate in little endian order, so each out of range byte warns and reads as zero.
  *
  * @param addr Index address to access.
  * @return 16bit integer for contents of address bytes.
  */
 uint16_t memory::get16(uint32_t addr) const
 {
+    if(in_range(addr, 2)) //One check for the whole access.
+    {
+        return mem[addr] | (static_cast<uint16_t>(mem[addr+1]) << 8);
+    }
     return get8(addr) | (static_cast<uint16_t>(get8(addr+1)) << 8);
 }
 
 /**
  * @brief Get 32bits of memory.
  * 
- * Call get16() twice to retrieve four bytes then concatenate in little endian order.
+ * Read all four bytes directly when they are in range. Otherwise call get16() twice to retrieve four bytes
+ * then concatenate in little endian order, so each out of range byte warns and reads as zero.
  * 
  * @param addr Index address to access.
  * @return 32bit integer for contents of address bytes.
  */
 uint32_t memory::get32(uint32_t addr) const
 {
+    if(in_range(addr, 4)) //One check for the whole access.
+    {
+        return mem[addr] | (static_cast<uint32_t>(mem[addr+1]) << 8) | (static_cast<uint32_t>(mem[addr+2]) << 16) | (static_cast<uint32_t>(mem[addr+3]) << 24);
+    }
     return get16(addr) | (static_cast<uint32_t>(get16(addr+2)) << 16);;
 }
 
@@ -168,20 +823,31 @@ void memory::set8(uint32_t addr, uint8_t val)
 {
     if(!check_illegal(addr)) //Check validity of index before accessing.
     {
+        bool held = begin_store(addr, 1);
         mem[addr] = val;
+        end_store(addr, 1, held);
     } 
 }
 
 /**
  * @brief Set 16bits of memory.
  * 
- * Logically shift left and right to isolate target bytes then call set8() to write values.
+ * Write both bytes directly when they are in range. Otherwise logically shift left and right to isolate
+ * target bytes then call set8() to write values, so each out of range byte warns and is dropped.
  * 
  * @param addr Index address to write to.
  * @param val 16bit value to write to memory.
  */
 void memory::set16(uint32_t addr, uint16_t val)
 {
+    if(in_range(addr, 2)) //One check for the whole access.
+    {
+        bool held = begin_store(addr, 2);
+        mem[addr] = val;
+        mem[addr+1] = val >> 8;
+        end_store(addr, 2, held);
+        return;
+    }
     set8(addr+1, val >> 8); //Shift right to cut off right byte.
     set8(addr, (val << 8) >> 8); //Shift left then right to cut off left byte.
 }
@@ -189,55 +855,380 @@ void memory::set16(uint32_t addr, uint16_t val)
 /**
  * @brief Set 32bits of memory.
  * 
- * Logically shift left and right to isolate target bytes then call set16() to write values.
+ * Write all four bytes directly when they are in range. Otherwise logically shift left and right to isolate
+ * target bytes then call set16() to write values, so each out of range byte warns and is dropped.
  * 
  * @param addr Index address to write to.
  * @param val 32bit value to write to memory.
  */
 void memory::set32(uint32_t addr, uint32_t val)
 {
+    if(in_range(addr, 4)) //One check for the whole access.
+    {
+        bool held = begin_store(addr, 4);
+        mem[addr] = val;
+        mem[addr+1] = val >> 8;
+        mem[addr+2] = val >> 16;
+        mem[addr+3] = val >> 24;
+        end_store(addr, 4, held);
+        return;
+    }
     set16(addr+2, val >> 16); //Shift right to cut off right bytes.
     set16(addr, (val << 16) >> 16); //Shift left then right to cut off left bytes.
 }
 
 /**
- * @brief Print memory dump.
+ * @brief Atomically get an aligned word.
+ * 
+ * Words out of range are read with get32(), warnings and all.
+ * 
+ * @param addr Index address to read, a multiple of 4.
+ * @return 32bit contents of the word.
+ */
+uint32_t memory::get32_atomic(uint32_t addr) const
+{
+    if(in_range(addr, 4))
+    {
+        return __atomic_load_n(reinterpret_cast<const uint32_t*>(mem + addr), __ATOMIC_SEQ_CST); //Host is little-endian like the guest.
+    }
+    return get32(addr);
+}
+
+/**
+ * @brief Atomically read-modify-write an aligned word.
+ * 
+ * Each operation is a single host atomic on the backing store, so harts on other threads never see
+ * it half done. min and max, which have no host instruction, retry a compare and swap. Words out of
+ * range fall back to get32() and set32(), warnings and all.
+ * 
+ * @param addr Index address to update, a multiple of 4.
+ * @param op Operation combining the old contents with val.
+ * @param val Operand.
+ * @return The old contents of the word.
+ */
+uint32_t memory::amo32(uint32_t addr, amo_op op, uint32_t val)
+{
+    if(!in_range(addr, 4))
+    {
+        uint32_t old = get32(addr);
+        switch(op)
+        {
+            case amo_swap:  set32(addr, val); break;
+            case amo_add:   set32(addr, old + val); break;
+            case amo_xor:   set32(addr, old ^ val); break;
+            case amo_and:   set32(addr, old & val); break;
+            case amo_or:    set32(addr, old | val); break;
+            case amo_min:   set32(addr, std::min<int32_t>(old, val)); break;
+            case amo_max:   set32(addr, std::max<int32_t>(old, val)); break;
+            case amo_minu:  set32(addr, std::min(old, val)); break;
+            case amo_maxu:  set32(addr, std::max(old, val)); break;
+        }
+        return old;
+    }
+
+    uint32_t *p = reinterpret_cast<uint32_t*>(mem + addr);
+    uint32_t old;
+    bool held = begin_store(addr, 4);
+    switch(op)
+    {
+        case amo_swap:  old = __atomic_exchange_n(p, val, __ATOMIC_SEQ_CST); break;
+        case amo_add:   old = __atomic_fetch_add(p, val, __ATOMIC_SEQ_CST); break;
+        case amo_xor:   old = __atomic_fetch_xor(p, val, __ATOMIC_SEQ_CST); break;
+        case amo_and:   old = __atomic_fetch_and(p, val, __ATOMIC_SEQ_CST); break;
+        case amo_or:    old = __atomic_fetch_or(p, val, __ATOMIC_SEQ_CST); break;
+        default:
+        {
+            old = __atomic_load_n(p, __ATOMIC_RELAXED);
+            uint32_t result;
+            do
+            {
+                switch(op)
+                {
+                    case amo_min:   result = std::min<int32_t>(old, val); break;
+                    case amo_max:   result = std::max<int32_t>(old, val); break;
+                    case amo_minu:  result = std::min(old, val); break;
+                    default:        result = std::max(old, val); break;
+                }
+            } while(!__atomic_compare_exchange_n(p, &old, result, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+        }
+        break;
+    }
+
+    end_store(addr, 4, held);
+    return old;
+}
+
+/**
+ * @brief Atomically get an aligned word and reserve it.
+ * 
+ * The page is flagged so every later store to it, including those of the inline engines, goes through
+ * begin_store() and advances the word's write counter. The ticket is that counter as of the read.
+ * Words out of range are read with get32(), warnings and all, and get a ticket that never matches.
+ * 
+ * @param addr Index address to read, a multiple of 4.
+ * @param ticket Set to the word's write counter, for store_conditional().
+ * @return 32bit contents of the word.
+ */
+uint32_t memory::load_reserved(uint32_t addr, uint32_t &ticket)
+{
+    if(!in_range(addr, 4))
+    {
+        ticket = 1; //Odd, a free counter is always even.
+        return get32(addr);
+    }
+    any_reserved.store(true);
+    __atomic_fetch_or(&watched[addr >> page_bits], watch_reserved, __ATOMIC_SEQ_CST);
+    std::atomic<uint32_t> &slot = reservations[(addr >> 2) % reservation_slots];
+    for(;;)
+    {
+        uint32_t count = slot.load(std::memory_order_acquire);
+        uint32_t val = __atomic_load_n(reinterpret_cast<const uint32_t*>(mem + addr), __ATOMIC_SEQ_CST);
+        if(!(count & 1) && slot.load(std::memory_order_acquire) == count) //No store was part way through the read.
+        {
+            ticket = count;
+            return val;
+        }
+    }
+}
+
+/**
+ * @brief Store to a reserved word nothing has written since.
+ * 
+ * The word's write counter is taken from the ticket with a compare and swap and held across the store,
+ * so a store by any hart since load_reserved() fails it even if it put the same value back. Words that
+ * share a counter can fail it as well, which sc.w is allowed to do. Words out of range warn and are
+ * never stored.
+ * 
+ * @param addr Index address to update, a multiple of 4.
+ * @param ticket Write counter from load_reserved().
+ * @param val New contents.
+ * @return true if the word was stored.
+ */
+bool memory::store_conditional(uint32_t addr, uint32_t ticket, uint32_t val)
+{
+    if(!in_range(addr, 4))
+    {
+        check_illegal(addr);
+        return false;
+    }
+    std::atomic<uint32_t> &slot = reservations[(addr >> 2) % reservation_slots];
+    if(!slot.compare_exchange_strong(ticket, ticket + 1, std::memory_order_acquire, std::memory_order_relaxed))
+    {
+        return false;
+    }
+    __atomic_store_n(reinterpret_cast<uint32_t*>(mem + addr), val, __ATOMIC_SEQ_CST);
+    slot.fetch_add(1, std::memory_order_release);
+    notify_range(addr, 4);
+    return true;
+}
+
+/**
+ * @brief Hold the write counters of a range on reserved pages.
+ * 
+ * Called before every store. Stores to pages no word was ever reserved on skip the counters.
+ * 
+ * @param addr First address to be written.
+ * @param len Number of bytes to be written.
+ * @return true if the counters are held and end_store() must release them.
+ */
+bool memory::begin_store(uint32_t addr, uint64_t len)
+{
+    if(len == 0)
+    {
+        return false;
+    }
+    for(uint64_t page = addr >> page_bits; page <= (addr + len - 1) >> page_bits; ++page)
+    {
+        if(is_watched(watched, page, watch_reserved))
+        {
+            step_slots(addr, len, true);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Advance the write counters of a range and notify observers.
+ * 
+ * Called after every store. Once anything has been reserved, a store that found its pages unreserved
+ * checks again, in case an lr.w on another hart reserved one while it was being written, and advances
+ * the counters then. Only an sc.w completing in that window, or one following the very first lr.w on
+ * this memory, can miss the store.
+ * 
+ * @param addr First address that was written.
+ * @param len Number of bytes written.
+ * @param held Whether begin_store() is holding the counters.
+ */
+void memory::end_store(uint32_t addr, uint64_t len, bool held)
+{
+    if(!held && any_reserved.load(std::memory_order_relaxed))
+    {
+        __atomic_thread_fence(__ATOMIC_SEQ_CST); //Order the store before checking the flags again.
+        held = begin_store(addr, len);
+    }
+    if(held)
+    {
+        step_slots(addr, len, false);
+    }
+    notify_range(addr, len);
+}
+
+/**
+ * @brief Lock or release every write counter of a range.
  * 
- * Print contents of memory to human-readable text output.
+ * A counter is locked by making it odd and released by making it even again. Counters are always taken
+ * in ascending order, so two stores sharing counters can not deadlock.
  * 
+ * @param addr First address of the range.
+ * @param len Number of bytes in the range, at least one.
+ * @param lock true to lock the counters, false to release them.
  */
-void memory::dump() const
+void memory::step_slots(uint32_t addr, uint64_t len, bool lock)
 {
-    uint32_t printCount = 0; //Number of bytes printed.
-    for(uint32_t i = 0; i < get_size() / 16; ++i) //Number of printlines is the total memory size divided into 16 byte lines.
+    uint64_t words = ((addr + len - 1) >> 2) - (addr >> 2) + 1;
+    uint32_t first = (addr >> 2) % reservation_slots;
+    uint32_t last = first + std::min<uint64_t>(words, reservation_slots) - 1; //May run past the last slot and wrap.
+    for(uint32_t i = 0; i < reservation_slots; ++i)
     {
-        std::cout << hex::to_hex32(printCount) << ": ";
-        for(uint32_t j = 0; j < 16; ++j) //Print memory byte by byte for current line.
+        if((i >= first && i <= last) || i + reservation_slots <= last)
         {
-            std::cout << hex::to_hex8(get8(printCount)) << " ";
-            if((printCount + 1) % 16 == 0) //If the final byte in printline.
-            {   std::cout << "*";
-                for(uint32_t i = printCount - 15; i < printCount + 1; ++i) //Append character printmap.
+            if(lock)
+            {
+                uint32_t count = reservations[i].load(std::memory_order_relaxed);
+                while((count & 1) || !reservations[i].compare_exchange_weak(count, count + 1, std::memory_order_acquire, std::memory_order_relaxed))
                 {
-                    uint8_t ch = get8(i);
-                    ch = isprint(ch) ? ch : '.'; //Store "." if not printable char.
-                    std::cout << ch;
+                    count = reservations[i].load(std::memory_order_relaxed);
                 }
-                std::cout << "*" << std::endl;
             }
-            else if(j != 0 && (j + 1) % 8 == 0) //Space out each 8 bytes.
+            else
+            {
+                reservations[i].fetch_add(1, std::memory_order_release);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Print memory dump.
+ * 
+ * Print contents of memory to human-readable text output. Printing never commits a page. Whole lines are
+ * formatted straight from the backing store into a buffer that is written out a block at a time.
+ * 
+ * With fold, a run of lines identical to the line before it is shown as a single line holding *, as hexdump
+ * does, and the line before the end of memory or a skipped page is always shown so each run's extent is clear.
+ * 
+ * @param skip_untouched Leave out lines in pages that have never been touched.
+ * @param fold Collapse runs of identical lines.
+ */
+void memory::dump(bool skip_untouched, bool fold) const
+{
+    static const uint8_t untouched[16] = { 0xa5, 0xa5, 0xa5, 0xa5, 0xa5, 0xa5, 0xa5, 0xa5, 0xa5, 0xa5, 0xa5, 0xa5, 0xa5, 0xa5, 0xa5, 0xa5 };
+    char out[64 * dump_line_len + 1]; //Lines waiting to be written, with room for format_line's null.
+    char *p = out;
+    const uint8_t *prev = nullptr; //Bytes of the line before, nullptr after a gap.
+    bool folding = false;          //Set once a * has been written for the current run.
+
+    for(uint64_t line = 0; line < get_size(); line += 16) //Print the memory in 16 byte lines.
+    {
+        if(skip_untouched && !is_touched(line)) //Skip the rest of the page, every byte in it is still 0xa5.
+        {
+            line = (line / host_page + 1) * host_page - 16;
+            prev = nullptr;
+            folding = false;
+            continue;
+        }
+
+        const uint8_t *bytes = is_touched(line) ? mem + line : untouched; //Lines never straddle a host page.
+        bool last = line + 16 >= get_size() || (skip_untouched && !is_touched(line + 16)); //Before the end or a skipped gap.
+        if(fold && !last && prev && std::memcmp(prev, bytes, 16) == 0)
+        {
+            if(!folding)
             {
-                std::cout << " ";
+                *p++ = '*';
+                *p++ = '\n';
+                folding = true;
             }
-            ++printCount; //Increment bytes printed.
         }
+        else
+        {
+            p = format_line(line, bytes, p);
+            folding = false;
+        }
+        prev = bytes;
+
+        if(p > out + sizeof(out) - dump_line_len - 1) //No room for another line.
+        {
+            std::cout.write(out, p - out);
+            p = out;
+        }
+    }
+    std::cout.write(out, p - out);
+}
+
+/**
+ * @brief Format one 16 byte dump line.
+ * 
+ * The line is the address, the bytes in hex in two groups of 8, and the bytes as characters between
+ * stars, with any that are not printable shown as a period.
+ * 
+ * @param addr Address of the first byte.
+ * @param bytes The 16 bytes.
+ * @param buf Buffer of at least dump_line_len + 1 characters.
+ * @return Pointer to the null after the line break.
+ */
+char* memory::format_line(uint32_t addr, const uint8_t *bytes, char *buf)
+{
+    char *p = hex::to_hex32(addr, buf);
+    *p++ = ':';
+    *p++ = ' ';
+    for(uint32_t j = 0; j < 16; ++j)
+    {
+        p = hex::to_hex8(bytes[j], p);
+        *p++ = ' ';
+        if(j == 7) //Space out each 8 bytes.
+        {
+            *p++ = ' ';
+        }
+    }
+    *p++ = '*';
+    for(uint32_t j = 0; j < 16; ++j) //Append character printmap.
+    {
+        *p++ = isprint(bytes[j]) ? bytes[j] : '.'; //Store "." if not printable char.
     }
+    *p++ = '*';
+    *p++ = '\n';
+    *p = '\0';
+    return p;
+}
+
+/**
+ * @brief Check if the page holding addr has been committed.
+ * 
+ * @param addr Any address within the page to check.
+ * @return true if the page has been touched since the memory was created.
+ */
+bool memory::is_touched(uint32_t addr) const
+{
+    return addr < mem_size && get_flag(touched, addr / host_page);
+}
+
+/**
+ * @brief Read a byte without committing its page.
+ * 
+ * @param addr Index address to read, must be within memory.
+ * @return Contents of the byte, 0xa5 for a page that has never been touched.
+ */
+uint8_t memory::peek(uint32_t addr) const
+{
+    return is_touched(addr) ? mem[addr] : 0xa5;
 }
 
 /**
  * @brief Load file into simulated memory.
  * 
- * Attempt to load files into memory.
+ * Attempt to load files into memory. The file size is checked first so an image that does not fit
+ * fails before anything is loaded, then the whole image is brought in with one read.
  * 
  * @param fname Name of file within accessible directory.
  * @return true if file loading was successful and values could be written to memory.
@@ -245,29 +1236,187 @@ void memory::dump() const
  */
 bool memory::load_file(const std::string &fname)
 {
-    std::ifstream infile(fname, std::ios::in|std::ios::binary); //Create file object and open file in binary mode.
+    std::ifstream infile(fname, std::ios::in|std::ios::binary|std::ios::ate); //Create file object and open file in binary mode, positioned at the end.
 
-    if(infile.is_open())
+    if(infile.is_open() && infile.tellg() >= 0)
     {
-        uint8_t i;
-        infile >> std::noskipws; //Prep stream extraction.
-        for(uint32_t addr = 0; infile >> i; ++addr)
+        std::streamoff len = infile.tellg(); //Size of the image.
+        if(static_cast<uint64_t>(len) > get_size()) //Check the whole image fits before loading any of it.
         {
-            if(!check_illegal(addr)) //Check validity of index address before writing vlaues.
-            {
-                set8(addr, i); //Write byte to memory.
-            }
-            else
-            {
-                std::cerr << "Program too big." << std::endl;
-                infile.close(); //Close the file.
-                return false;
-            }
+            check_illegal(get_size()); //Warn about the first byte that does not fit.
+            std::cerr << "Program too big." << std::endl;
+            infile.close(); //Close the file.
+            return false;
         }
+
+        commit_range(0, len); //The read can not fault pages in itself.
+        infile.seekg(0);
+        infile.read(reinterpret_cast<char*>(mem), len); //Read the whole image at once.
+        notify_range(0, len);
+        bool ok = infile.gcount() == len;
         infile.close(); //Close the file.
-        return true;
+        return ok;
     }
 
     std::cerr << "Can't open file '"  << fname << "' for reading." << std::endl;
     return false;
+}
+
+/**
+ * @brief Copy bytes into memory.
+ * 
+ * Bulk write for loaders. The whole block must be within memory, nothing is written otherwise.
+ * 
+ * @param addr First address to write to.
+ * @param src Bytes to copy.
+ * @param len Number of bytes to copy.
+ * @return true if the block was written.
+ */
+bool memory::write_block(uint32_t addr, const uint8_t *src, uint32_t len)
+{
+    if(len != 0 && !in_range(addr, len))
+    {
+        return false;
+    }
+    commit_range(addr, len);
+    bool held = begin_store(addr, len);
+    std::memcpy(mem + addr, src, len);
+    end_store(addr, len, held);
+    return true;
+}
+
+/**
+ * @brief Fill bytes of memory.
+ * 
+ * Bulk fill for loaders. The whole block must be within memory, nothing is written otherwise.
+ * 
+ * @param addr First address to fill.
+ * @param val Value to store in every byte.
+ * @param len Number of bytes to fill.
+ * @return true if the block was filled.
+ */
+bool memory::fill_block(uint32_t addr, uint8_t val, uint32_t len)
+{
+    if(len != 0 && !in_range(addr, len))
+    {
+        return false;
+    }
+    commit_range(addr, len);
+    bool held = begin_store(addr, len);
+    std::memset(mem + addr, val, len);
+    end_store(addr, len, held);
+    return true;
+}
+
+/**
+ * @brief Commit and unprotect every page of a range.
+ * 
+ * Needed before handing memory to anything that can not fault pages in itself, such as a read().
+ * 
+ * @param addr First address of the range.
+ * @param len Number of bytes in the range.
+ */
+void memory::commit_range(uint32_t addr, uint64_t len)
+{
+    for(uint64_t a = addr / host_page * host_page; a < addr + len; a += host_page)
+    {
+        if(!get_flag(touched, a / host_page) || (tracking && !get_flag(dirty, a / host_page)))
+        {
+            fault_in(a);
+        }
+    }
+}
+
+/**
+ * @brief Tell observers about a bulk write if it touched any watched page.
+ * 
+ * @param addr First address that was written.
+ * @param len Number of bytes written.
+ */
+void memory::notify_range(uint32_t addr, uint64_t len)
+{
+    if(len == 0)
+    {
+        return;
+    }
+    for(uint64_t a = addr >> page_bits; a <= (addr + len - 1) >> page_bits; ++a)
+    {
+        if(is_watched(watched, a, watch_code))
+        {
+            notify(addr, len);
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Register an observer of writes to watched memory.
+ * 
+ * @param o Observer to call back when a watched page is written.
+ */
+void memory::add_observer(memory_observer *o)
+{
+    observers.push_back(o);
+}
+
+/**
+ * @brief Unregister an observer.
+ * 
+ * @param o Observer to stop calling back.
+ */
+void memory::remove_observer(memory_observer *o)
+{
+    observers.erase(std::remove(observers.begin(), observers.end(), o), observers.end());
+}
+
+/**
+ * @brief Mark the page holding addr as watched for writes.
+ * 
+ * Once watched, every write that lands in the page is reported to the observers.
+ * 
+ * @param addr Any address within the page to watch.
+ */
+void memory::watch(uint32_t addr)
+{
+    if(addr < mem_size) //Quietly ignore addresses outside of memory.
+    {
+        __atomic_fetch_or(&watched[addr >> page_bits], watch_code, __ATOMIC_SEQ_CST); //Harts on other threads may watch the same page.
+    }
+}
+
+/**
+ * @brief Get the backing store for direct access.
+ * 
+ * Callers that bypass get/set must do their own range checks and must not write to watched pages,
+ * which includes pages holding a reserved word.
+ * 
+ * @return Pointer to the first byte of simulated memory.
+ */
+uint8_t* memory::data()
+{
+    return mem;
+}
+
+/**
+ * @brief Get the per-page watch flags.
+ * 
+ * @return Pointer to one flag byte per page, nonzero when stores to the page must go through set8() and friends.
+ */
+const uint8_t* memory::watch_flags() const
+{
+    return watched.data();
+}
+
+/**
+ * @brief Tell observers that watched memory was written.
+ * 
+ * @param addr First address that was written.
+ * @param len Number of bytes written.
+ */
+void memory::notify(uint32_t addr, uint32_t len)
+{
+    for(memory_observer *o : observers)
+    {
+        o->invalidate(addr, len);
+    }
 }
\ No newline at end of file
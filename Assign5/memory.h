@@ -12,20 +12,81 @@
 //
 //***************************************************************************
 #include <vector>
+#include <memory>
+#include <iosfwd>
+#include <atomic>
+#include <signal.h>
 #include "hex.h"
 
+/**
+ * @brief Memory Write Observer Interface
+ * 
+ * Implemented by anything that caches a view of memory contents (such as predecoded instructions)
+ * and must be told when a watched region is overwritten.
+ * 
+ */
+class memory_observer
+{
+public:
+    virtual ~memory_observer() {}
+    virtual void invalidate(uint32_t addr, uint32_t len) = 0; //Notify that memory at addr has been overwritten.
+};
+
+/**
+ * @brief Memory Snapshot Class
+ * 
+ * Immutable copy of the committed pages of a memory, held in an anonymous file so memories forked
+ * from it can map it copy-on-write. Snapshots are shared by every memory that uses them.
+ * 
+ */
+class memory_snapshot
+{
+public:
+    ~memory_snapshot();  //Destructor
+
+    memory_snapshot(const memory_snapshot&) = delete;
+    memory_snapshot& operator=(const memory_snapshot&) = delete;
+
+    uint32_t get_size() const;                                     //Get the size of the memory it was taken from.
+    bool save(std::ostream &out) const;                            //Write the committed pages to a stream.
+    static std::shared_ptr<memory_snapshot> load(std::istream &in); //Read a snapshot written by save().
+
+private:
+    friend class memory;
+    static constexpr uint32_t max_size = 0xfffffff0;   //Largest size a memory can have.
+    memory_snapshot(uint32_t size, size_t host_page);   //Constructor, used by memory and load().
+
+    uint32_t size = { 0 };              //Size of the memory it was taken from.
+    size_t map_len = { 0 };             //Bytes in the file, whole host pages.
+    size_t host_page = { 0 };           //Page size the touched flags are kept in.
+    int fd = { -1 };                    //Anonymous file holding the pages.
+    const uint8_t *data = { nullptr };  //Read only mapping of the file.
+    std::vector<uint8_t> touched;       //Per host page flags marking pages held by the snapshot.
+};
+
 /**
  * @brief Simulated Memory Class
  * 
  * Facilitates the creation and operation of simulated memory, allowing reading and writing of simulated byte data.
  * 
+ * The backing store is reserved up front as one inaccessible anonymous mapping without committing any of it.
+ * Each host page is committed and filled with 0xa5 the first time anything touches it, so memory sized anywhere
+ * up to the full 32-bit address space only costs the pages a program actually uses.
+ * 
+ * After a snapshot is taken or restored, committed pages are write protected so the first write to each
+ * one can be recorded. Restoring the same snapshot again then only has to put back the dirtied pages.
+ * 
  */
 class memory : public hex
 {
 public:
     memory(uint32_t size); //Constructor
+    memory(const std::shared_ptr<const memory_snapshot> &snap); //Fork a copy-on-write memory from a snapshot.
     ~memory();             //Destructor
 
+    memory(const memory&) = delete;             //Owns its mapping, not copyable.
+    memory& operator=(const memory&) = delete;
+
     bool check_illegal(uint32_t addr) const;  //Check index validity.
     uint32_t get_size() const;                //Get memory size.
     uint8_t get8(uint32_t addr) const;        //Get 8bits of memory.
@@ -40,12 +101,96 @@ public:
     void set16(uint32_t addr, uint16_t val);  //Set 16bits of memory.
     void set32(uint32_t addr, uint32_t val);  //Set 32bits of memory.
 
-    void dump() const;  //Print memory dump.
+    /**
+     * @brief Atomic read-modify-write operations.
+     */
+    enum amo_op
+    {
+        amo_swap, amo_add, amo_xor, amo_and, amo_or, amo_min, amo_max, amo_minu, amo_maxu
+    };
+
+    uint32_t get32_atomic(uint32_t addr) const;                      //Atomically get an aligned word.
+    uint32_t amo32(uint32_t addr, amo_op op, uint32_t val);          //Atomically read-modify-write an aligned word.
+    uint32_t load_reserved(uint32_t addr, uint32_t &ticket);         //Atomically get an aligned word and reserve it.
+    bool store_conditional(uint32_t addr, uint32_t ticket, uint32_t val);  //Store to a reserved word nothing has written since.
+
+    void dump(bool skip_untouched = false, bool fold = false) const;  //Print memory dump.
+    bool is_touched(uint32_t addr) const;           //Check if the page holding addr has been committed.
 
     bool load_file(const std::string &fname);  //Load file into simulated memory.
+    bool write_block(uint32_t addr, const uint8_t *src, uint32_t len); //Copy bytes into memory.
+    std::shared_ptr<const memory_snapshot> snapshot();                  //Take a snapshot of memory.
+    bool restore(const std::shared_ptr<const memory_snapshot> &snap);   //Restore memory to a snapshot.
+    bool fill_block(uint32_t addr, uint8_t val, uint32_t len);         //Fill bytes of memory.
+
+    void add_observer(memory_observer *o);     //Register an observer of writes to watched memory.
+    void remove_observer(memory_observer *o);  //Unregister an observer.
+    void watch(uint32_t addr);                 //Mark the page holding addr as watched for writes.
+
+    uint8_t* data();                           //Get the backing store for direct access.
+    const uint8_t* watch_flags() const;        //Get the per-page watch flags.
+
+    static constexpr uint32_t page_bits = 12;              //Log2 of the watch granularity.
+    static constexpr uint32_t page_size = 1 << page_bits;  //Bytes per watched page.
 
 private:
-    std::vector<uint8_t> mem; //Vector to simulate memory.
+    static constexpr uint32_t max_size = 0xfffffff0;   //Largest mod-16 size that fits the 32-bit address space.
+    static constexpr int region_slots = 64;            //Memories registered in each chunk of the fault handler's table.
+
+    /**
+     * @brief Chunk of the table of memories the fault handler serves.
+     *
+     * Chunks are only ever appended and never freed, so the handler can walk them at any time without locking.
+     */
+    struct region_chunk
+    {
+        std::atomic<memory*> slots[region_slots];  //Registered memories, nullptr where free.
+        std::atomic<region_chunk*> next;            //Chunk added once this one filled up.
+    };
+    static constexpr uint32_t dump_line_len = 78;      //Characters in a dump line, with its line break.
+    static constexpr uint8_t watch_code = 1;           //Watch flag bit for pages observers are caching.
+    static constexpr uint8_t watch_reserved = 2;       //Watch flag bit for pages holding a word lr.w has reserved.
+    static constexpr uint32_t reservation_slots = 256; //Write counters shared by the words of memory, a power of 2.
+
+    bool in_range(uint32_t addr, uint32_t len) const;  //Check a whole access is within memory.
+    void notify(uint32_t addr, uint32_t len);  //Tell observers that watched memory was written.
+    void reserve(uint32_t size);               //Set up the page bookkeeping for a memory of size bytes.
+    void map(int file, int flags);             //Map the backing store, falling back to committing it eagerly.
+    bool fault_in(size_t offset);              //Commit or unprotect the host page holding offset.
+    void add_region();                         //Register with the fault handler.
+    void remove_region();                      //Unregister from the fault handler.
+    void mark_dirty(size_t page);              //Record the first write to a page since the last snapshot.
+    void track(const std::shared_ptr<const memory_snapshot> &snap);  //Write protect committed pages against a snapshot.
+    void restore_page(const memory_snapshot &snap, size_t page);     //Put back one page from a snapshot.
+    static bool handler_installed();           //Install the fault handler once.
+    uint8_t peek(uint32_t addr) const;         //Read a byte without committing its page.
+    static char* format_line(uint32_t addr, const uint8_t *bytes, char *buf);  //Format one 16 byte dump line.
+    void commit_range(uint32_t addr, uint64_t len);  //Commit and unprotect every page of a range.
+    void notify_range(uint32_t addr, uint64_t len);  //Tell observers about a bulk write if it touched any watched page.
+    bool begin_store(uint32_t addr, uint64_t len);   //Hold the write counters of a range on reserved pages.
+    void end_store(uint32_t addr, uint64_t len, bool held);  //Advance the write counters of a range and notify observers.
+    void step_slots(uint32_t addr, uint64_t len, bool lock);  //Lock or release every write counter of a range.
+
+    static void fault_handler(int sig, siginfo_t *info, void *ucontext); //Commit pages on first touch.
+    static region_chunk regions;                       //Memories whose pages are committed on first touch.
+    static struct sigaction previous_action;           //Disposition for faults outside of any memory.
+
+    uint8_t *mem = { nullptr };                //Mapping to simulate memory.
+    uint32_t mem_size = { 0 };                 //Simulated memory size in bytes.
+    size_t map_len = { 0 };                    //Bytes reserved for the mapping, whole host pages.
+    size_t host_page = { 0 };                  //Commit granularity.
+    int fd = { -1 };                           //Anonymous file holding committed pages, -1 when committed eagerly.
+    bool private_map = { false };              //Set when the file is a snapshot mapped copy-on-write.
+    bool tracking = { false };                 //Set when writes to committed pages are being recorded.
+    std::vector<uint8_t> touched;              //Per host page flags marking committed pages.
+    std::vector<uint8_t> dirty;                //Per host page flags marking pages written since the last snapshot.
+    std::vector<uint32_t> dirty_pages;         //Pages written since the last snapshot.
+    std::shared_ptr<const memory_snapshot> base;    //Snapshot the dirty pages are relative to.
+    std::shared_ptr<const memory_snapshot> origin;  //Snapshot whose file is mapped, for forked memories.
+    std::vector<uint8_t> watched;              //Per-page flags marking pages that observers are caching.
+    std::vector<memory_observer*> observers;   //Observers to notify of writes to watched pages.
+    std::atomic<uint32_t> reservations[reservation_slots] = {};  //Write counters by word, odd while a store holds one.
+    std::atomic<bool> any_reserved = { false };  //Set by the first lr.w, after which stores check their pages twice.
 };
 
 #endif
\ No newline at end of file
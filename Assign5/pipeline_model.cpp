@@ -0,0 +1,123 @@
+//***************************************************************************
+//
+//  Matt Borek
+//  z1951125
+//  CSCI463-1
+//
+//  I certify that this is my own work and where appropriate an extension
+//  of the starter code provided for the assignment.
+//
+//***************************************************************************
+#include <iomanip>
+#include <sstream>
+#include "pipeline_model.h"
+
+/**
+ * @brief Parse a load-use[:branch[:memory]] description.
+ *
+ * Each field is a decimal number of cycles, any left off keep their defaults.
+ *
+ * @param s Description, such as 1:2:20.
+ * @param c Penalties to fill in.
+ * @return true if s describes a model.
+ */
+bool pipeline_model::parse(const std::string &s, config &c)
+{
+    std::istringstream iss(s);
+    uint32_t *fields[] = { &c.load_use, &c.branch, &c.memory };
+    for(uint32_t i = 0; i < 3; ++i)
+    {
+        if(i > 0 && iss.get() != ':')
+        {
+            return false;
+        }
+        if(!(iss >> *fields[i]))
+        {
+            return false;
+        }
+        if(iss.peek() == EOF)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Time an executed instruction.
+ *
+ * Loads, including lr.w and the atomics, make the next instruction stall if it reads their destination.
+ *
+ * @param insn The instruction, the 32-bit expansion for RV32C.
+ * @param redirect Whether fetch had to be redirected after it, a taken branch or jump without a predictor
+ * or a misprediction with one.
+ */
+void pipeline_model::retire(uint32_t insn, bool redirect)
+{
+    ++insns;
+
+    uint32_t opcode = get_opcode(insn);
+    bool reads_rs1 = false;
+    bool reads_rs2 = false;
+    switch(opcode)
+    {
+        case opcode_rtype:
+        case opcode_btype:
+        case opcode_stype:
+        case opcode_amo:        reads_rs1 = true; reads_rs2 = true; break;
+        case opcode_jalr:
+        case opcode_load_imm:
+        case opcode_alu_imm:    reads_rs1 = true; break;
+        case opcode_system:     reads_rs1 = (get_funct3(insn) & 0b100) == 0; break;   //csrrw, csrrs and csrrc.
+    }
+    if(load_rd != 0 && ((reads_rs1 && get_rs1(insn) == load_rd) || (reads_rs2 && get_rs2(insn) == load_rd)))
+    {
+        load_use_stalls += cfg.load_use;
+    }
+
+    load_rd = (opcode == opcode_load_imm || opcode == opcode_amo) ? get_rd(insn) : 0;
+
+    if(redirect)
+    {
+        branch_stalls += cfg.branch;
+    }
+}
+
+/**
+ * @brief Stall for accesses that go to memory.
+ *
+ * @param accesses Cache misses, or accesses when there is no cache.
+ */
+void pipeline_model::memory_wait(uint32_t accesses)
+{
+    memory_stalls += static_cast<uint64_t>(accesses) * cfg.memory;
+}
+
+/**
+ * @brief Get the cycles taken so far.
+ *
+ * @return Cycles from the first fetch to the writeback of the last instruction retired.
+ */
+uint64_t pipeline_model::get_cycles() const
+{
+    return (insns ? insns + fill_cycles : 0) + load_use_stalls + branch_stalls + memory_stalls;
+}
+
+/**
+ * @brief Write the cycles, CPI and stall breakdown.
+ *
+ * @param os Stream to write to.
+ * @param hdr Prefix for each line.
+ */
+void pipeline_model::report(std::ostream &os, const std::string &hdr) const
+{
+    uint64_t cycles = get_cycles();
+    auto percent = [cycles](uint64_t n) { return cycles ? 100.0 * n / cycles : 0; };
+    os << std::fixed << std::setprecision(2);
+    os << hdr << "Pipeline: " << cycles << " cycles, CPI " << (insns ? static_cast<double>(cycles) / insns : 0);
+    os << " (load-use " << cfg.load_use << ", branch " << cfg.branch << ", memory " << cfg.memory << ")" << std::endl;
+    os << hdr << "  load-use stalls " << std::setw(12) << load_use_stalls << " cycles " << std::setw(6) << percent(load_use_stalls) << "%" << std::endl;
+    os << hdr << "  branch stalls   " << std::setw(12) << branch_stalls << " cycles " << std::setw(6) << percent(branch_stalls) << "%" << std::endl;
+    os << hdr << "  memory stalls   " << std::setw(12) << memory_stalls << " cycles " << std::setw(6) << percent(memory_stalls) << "%" << std::endl;
+    os << std::defaultfloat;
+}
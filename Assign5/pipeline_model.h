@@ -0,0 +1,59 @@
+#ifndef H_PIPELINE_MODEL
+#define H_PIPELINE_MODEL
+
+//***************************************************************************
+//
+//  Matt Borek
+//  z1951125
+//  CSCI463-1
+//
+//  I certify that this is my own work and where appropriate an extension
+//  of the starter code provided for the assignment.
+//
+//***************************************************************************
+#include <ostream>
+#include "rv32i_decode.h"
+
+/**
+ * @brief In-Order Pipeline Timing Model Class
+ *
+ * Approximates the cycles a classic five stage (fetch, decode, execute, memory, writeback) in-order pipeline
+ * with full forwarding takes. Every instruction takes one cycle once the pipeline has filled, plus stalls for
+ * a use of a loaded value by the next instruction, for redirected fetches after taken or mispredicted control
+ * transfers, and for waits on memory.
+ *
+ */
+class pipeline_model : public rv32i_decode
+{
+public:
+    /**
+     * @brief Stall Penalties
+     */
+    struct config
+    {
+        uint32_t load_use = { 1 };  //Cycles an instruction waits for a value loaded by the one before it.
+        uint32_t branch = { 2 };    //Cycles fetched down the wrong path before a control transfer redirects fetch.
+        uint32_t memory = { 0 };    //Cycles each access that misses in, or has no, cache waits on memory.
+    };
+
+    static bool parse(const std::string &s, config &c);  //Parse a load-use[:branch[:memory]] description.
+
+    pipeline_model(const config &c) : cfg(c) {}  //Constructor
+
+    void retire(uint32_t insn, bool redirect);         //Time an executed instruction.
+    void memory_wait(uint32_t accesses);               //Stall for accesses that go to memory.
+    uint64_t get_cycles() const;                       //Get the cycles taken so far.
+    void report(std::ostream &os, const std::string &hdr) const;  //Write the cycles, CPI and stall breakdown.
+
+private:
+    static constexpr uint32_t fill_cycles = 4;  //Cycles before the first instruction reaches writeback.
+
+    config cfg;                        //Penalties.
+    uint32_t load_rd = { 0 };          //Destination of the previous instruction if it was a load, else x0.
+    uint64_t insns = { 0 };            //Instructions retired.
+    uint64_t load_use_stalls = { 0 };  //Cycles lost to load-use hazards.
+    uint64_t branch_stalls = { 0 };    //Cycles lost to redirected fetches.
+    uint64_t memory_stalls = { 0 };    //Cycles lost waiting on memory.
+};
+
+#endif
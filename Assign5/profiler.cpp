@@ -0,0 +1,367 @@
+//***************************************************************************
+//
+//  Matt Borek
+//  z1951125
+//  CSCI463-1
+//
+//  I certify that this is my own work and where appropriate an extension
+//  of the starter code provided for the assignment.
+//
+//***************************************************************************
+#include <iomanip>
+#include <algorithm>
+#include <map>
+#include "profiler.h"
+
+/**
+ * @brief Construct a new profiler.
+ *
+ * @param rvc Whether instructions may start on any halfword.
+ * @param period Instructions between samples, zero to count every instruction with retire().
+ */
+profiler::profiler(bool rvc, uint64_t period) : slot_bits(rvc ? 1 : 2), period(period), nodes(1)
+{
+}
+
+/**
+ * @brief Count an instruction and follow any call or return.
+ *
+ * A jal or jalr that links through ra or t0 is a call, a jalr through ra or t0 that does not link is a return,
+ * the same hints a return address stack predictor uses.
+ *
+ * @param pc Address the instruction was fetched from.
+ * @param insn The instruction, the 32-bit expansion for RV32C.
+ * @param next_pc Address of the instruction executed after it.
+ */
+void profiler::retire(uint32_t pc, uint32_t insn, uint32_t next_pc)
+{
+    if(total++ == 0) //The root is wherever execution starts.
+    {
+        nodes[0].func = pc;
+    }
+    ++count_of(pc);
+    ++nodes[current].self;
+
+    switch(get_opcode(insn))
+    {
+        case opcode_jal:
+        if(is_link(get_rd(insn)))
+        {
+            current = call(current, next_pc);
+        }
+        break;
+
+        case opcode_jalr:
+        if(is_link(get_rd(insn)))
+        {
+            current = call(current, next_pc);
+        }
+        else if(get_rd(insn) == 0 && is_link(get_rs1(insn)))
+        {
+            current = nodes[current].parent;
+        }
+        break;
+    }
+}
+
+/**
+ * @brief Read a word without committing its page.
+ *
+ * @param mem Memory to read.
+ * @param addr Address of the word.
+ * @param val Set to the word.
+ * @return false if the word is out of memory or on a page never touched.
+ */
+static bool peek32(const memory &mem, uint32_t addr, uint32_t &val)
+{
+    if(mem.get_size() < 4 || addr > mem.get_size() - 4 || !mem.is_touched(addr) || !mem.is_touched(addr + 3))
+    {
+        return false;
+    }
+    val = mem.get32(addr);
+    return true;
+}
+
+/**
+ * @brief Set the function sampled execution starts in.
+ *
+ * Samples hang their call chains off it, as a full profile hangs them off the first instruction it counts.
+ *
+ * @param pc Address execution starts at, ignored once anything has been sampled.
+ */
+void profiler::start(uint32_t pc)
+{
+    if(total == 0 && samples.empty())
+    {
+        nodes[0].func = pc;
+    }
+}
+
+/**
+ * @brief Record the pc and the functions on the call stack.
+ *
+ * The return addresses are found by walking the frame pointer, with the return address at fp-4 and the
+ * caller's frame pointer at fp-8 as GCC lays out frames. Each is turned into the entry of the function it
+ * returns from, as a full profile names calls. The walk stops at the first frame pointer that is misaligned,
+ * out of memory or not above the last, or return address that is not an instruction address in memory, such
+ * as the reset contents of ra, so code built without frame pointers gives samples of the pc alone. The stack
+ * is only read from pages already touched, so sampling never changes memory.
+ *
+ * @param pc Address of the next instruction.
+ * @param fp Contents of s0/fp.
+ * @param mem Memory holding the stack.
+ */
+void profiler::sample(uint32_t pc, uint32_t fp, const memory &mem)
+{
+    size_t start = samples.size();
+    samples.push_back(1);
+    samples.push_back(pc);
+    uint32_t inner = pc; //Address in the function the next return address returns from.
+    uint32_t ra, caller_fp;
+    for(uint32_t depth = 0; depth < max_frames && fp % 4 == 0 && fp >= 8 && peek32(mem, fp - 4, ra) && peek32(mem, fp - 8, caller_fp); ++depth)
+    {
+        if(ra < 4 || ra >= mem.get_size() || ra % (1u << slot_bits) != 0)
+        {
+            break;
+        }
+        samples.push_back(callee(ra, inner, mem));
+        ++samples[start];
+        inner = ra;
+        if(caller_fp <= fp) //Frames only ever get older going up the stack.
+        {
+            break;
+        }
+        fp = caller_fp;
+    }
+
+    if(samples.size() >= max_buffered)
+    {
+        aggregate();
+    }
+}
+
+/**
+ * @brief Fold the recorded samples into the profile.
+ *
+ * Each sample counts once against its pc and against the chain of calls from the root down to the function
+ * the pc is in.
+ *
+ */
+void profiler::aggregate()
+{
+    for(size_t i = 0; i < samples.size(); i += samples[i] + 1)
+    {
+        uint32_t words = samples[i];
+        ++count_of(samples[i + 1]);
+        uint32_t node = 0;
+        for(uint32_t f = words; f > 1; --f) //Outermost first, the pc is in the innermost.
+        {
+            node = call(node, samples[i + f]);
+        }
+        ++nodes[node].self;
+        ++total;
+    }
+    samples.clear();
+}
+
+/**
+ * @brief Get the instructions or samples counted.
+ *
+ * @return Total of every pc's count.
+ */
+uint64_t profiler::get_total() const
+{
+    return total;
+}
+
+/**
+ * @brief Write the counts sorted by count.
+ *
+ * One line per pc that retired anything, busiest first, with its share of the total, its disassembly
+ * and the symbol it is in.
+ *
+ * @param os Stream to write to.
+ * @param mem Memory to disassemble the instructions from.
+ * @param elf Loader holding any symbols.
+ */
+void profiler::write_flat(std::ostream &os, const memory &mem, const elf_loader &elf) const
+{
+    std::vector<std::pair<uint64_t, uint32_t>> hot; //Count and pc.
+    for(uint32_t page = 0; page < counts.size(); ++page)
+    {
+        for(uint32_t i = 0; counts[page] && i < (memory::page_size >> slot_bits); ++i)
+        {
+            if(counts[page][i])
+            {
+                hot.emplace_back(counts[page][i], page << memory::page_bits | i << slot_bits);
+            }
+        }
+    }
+    std::sort(hot.begin(), hot.end(), [](const std::pair<uint64_t, uint32_t> &a, const std::pair<uint64_t, uint32_t> &b)
+    {
+        return a.first != b.first ? a.first > b.first : a.second < b.second;
+    });
+
+    if(period)
+    {
+        os << "Flat profile: " << total << " samples, one every " << period << " instructions" << std::endl;
+    }
+    else
+    {
+        os << "Flat profile: " << total << " instructions" << std::endl;
+    }
+    os << std::setw(12) << "count" << "  " << std::setw(7) << "%" << "  address   instruction" << std::endl;
+    for(const std::pair<uint64_t, uint32_t> &h : hot)
+    {
+        uint32_t addr = h.second;
+        std::string insn;
+        if(slot_bits == 1 && is_compressed(mem.get16(addr)))
+        {
+            insn = decode_compressed(addr, mem.get16(addr));
+        }
+        else
+        {
+            insn = decode(addr, mem.get32(addr));
+        }
+        os << std::setw(12) << std::right << h.first << "  " << std::setw(6) << std::fixed << std::setprecision(2) << 100.0 * h.first / total << "%  ";
+        os << to_hex32(addr) << ": " << std::setw(35) << std::left << insn << elf.symbolize(addr) << std::right << std::defaultfloat << std::endl;
+    }
+}
+
+/**
+ * @brief Write the call tree as collapsed stacks.
+ *
+ * One line per call chain that retired anything, the function names from the root down separated by
+ * semicolons followed by the count, the format flame graph tools read. Chains that name the same functions
+ * are merged. Full and sampled profiles name functions by the same entry addresses.
+ *
+ * @param os Stream to write to.
+ * @param elf Loader holding any symbols, functions without one are named by address.
+ */
+void profiler::write_collapsed(std::ostream &os, const elf_loader &elf) const
+{
+    std::map<std::string, uint64_t> stacks;
+    for(uint32_t n = 0; n < nodes.size(); ++n)
+    {
+        if(nodes[n].self == 0)
+        {
+            continue;
+        }
+        std::string stack = name(nodes[n].func, elf);
+        for(uint32_t p = n; p != 0; ) //Prepend each caller.
+        {
+            p = nodes[p].parent;
+            stack = name(nodes[p].func, elf) + ";" + stack;
+        }
+        stacks[stack] += nodes[n].self;
+    }
+    for(const std::pair<const std::string, uint64_t> &s : stacks)
+    {
+        os << s.first << " " << s.second << std::endl;
+    }
+}
+
+/**
+ * @brief Get the counter for a pc.
+ *
+ * @param pc Address of an instruction.
+ * @return Reference to its counter, allocated along with the rest of its page on first use.
+ */
+uint64_t& profiler::count_of(uint32_t pc)
+{
+    uint32_t page = pc >> memory::page_bits;
+    if(page >= counts.size())
+    {
+        counts.resize(page + 1);
+    }
+    if(!counts[page])
+    {
+        counts[page].reset(new uint64_t[memory::page_size >> slot_bits]());
+    }
+    return counts[page][(pc % memory::page_size) >> slot_bits];
+}
+
+/**
+ * @brief Find or add the node for a call from node to func.
+ *
+ * @param node Index of the calling node.
+ * @param func Address called.
+ * @return Index of the called node.
+ */
+uint32_t profiler::call(uint32_t node, uint32_t func)
+{
+    auto it = nodes[node].children.find(func);
+    if(it != nodes[node].children.end())
+    {
+        return it->second;
+    }
+    uint32_t n = nodes.size();
+    nodes[node].children[func] = n;
+    nodes.emplace_back();
+    nodes[n].func = func;
+    nodes[n].parent = node;
+    return n;
+}
+
+/**
+ * @brief Name a function address.
+ *
+ * @param addr Address in the function, normally its entry.
+ * @param elf Loader holding any symbols.
+ * @return The symbol addr is in, or addr in hex if there is none.
+ */
+std::string profiler::name(uint32_t addr, const elf_loader &elf) const
+{
+    std::string s = elf.symbolize(addr);
+    return s.empty() ? to_hex0x32(addr) : s.substr(0, s.find('+'));
+}
+
+/**
+ * @brief Find the function a return address returns from.
+ *
+ * The call just before the return address gives the entry, whether a jal, an auipc and jalr pair or an RV32C
+ * c.jal. Other indirect calls can not be followed, so an address inside the function stands in for its entry.
+ * It names the function just the same when there are symbols.
+ *
+ * @param ra Return address.
+ * @param inner Address sampled inside the function.
+ * @param mem Memory holding the code.
+ * @return Entry of the function, or inner if it can not be found.
+ */
+uint32_t profiler::callee(uint32_t ra, uint32_t inner, const memory &mem) const
+{
+    uint32_t insn, prev;
+    if(!peek32(mem, ra - 4, insn))
+    {
+        return inner;
+    }
+    if(get_opcode(insn) == opcode_jal && is_link(get_rd(insn)))
+    {
+        return ra - 4 + get_imm_j(insn);
+    }
+    if(get_opcode(insn) == opcode_jalr && is_link(get_rd(insn)) && ra >= 8 && peek32(mem, ra - 8, prev) &&
+       get_opcode(prev) == opcode_auipc && get_rd(prev) == get_rs1(insn))
+    {
+        return ra - 8 + get_imm_u(prev) + get_imm_i(insn);
+    }
+    if(slot_bits == 1 && is_compressed(insn >> 16)) //The call may be the halfword just before ra.
+    {
+        uint32_t call = expand_compressed(insn >> 16);
+        if(get_opcode(call) == opcode_jal && is_link(get_rd(call)))
+        {
+            return ra - 2 + get_imm_j(call);
+        }
+    }
+    return inner;
+}
+
+/**
+ * @brief Check if an xregister holds return addresses.
+ *
+ * @param r xregister number.
+ * @return true for ra (x1) and the alternate link register t0 (x5).
+ */
+bool profiler::is_link(uint32_t r)
+{
+    return r == 1 || r == 5;
+}
@@ -0,0 +1,79 @@
+#ifndef H_PROFILER
+#define H_PROFILER
+
+//***************************************************************************
+//
+//  Matt Borek
+//  z1951125
+//  CSCI463-1
+//
+//  I certify that this is my own work and where appropriate an extension
+//  of the starter code provided for the assignment.
+//
+//***************************************************************************
+#include <map>
+#include <memory>
+#include <vector>
+#include <ostream>
+#include "memory.h"
+#include "rv32i_decode.h"
+#include "elf_loader.h"
+
+/**
+ * @brief Guest Execution Profiler Class
+ *
+ * Counts the instructions retired at each pc and builds a call tree by following jal/jalr calls and
+ * returns, attributing every instruction to the call stack it ran under. The counts can be written as a
+ * flat profile with the disassembly of each instruction, and the call tree as collapsed stacks for
+ * flame graph tools.
+ * A sampling profiler instead records the pc and the entries of the functions on the call stack every so many
+ * instructions into a compact buffer, and aggregates them into the same counts and tree.
+ *
+ */
+class profiler : public rv32i_decode
+{
+public:
+    profiler(bool rvc, uint64_t period = 0);  //Constructor
+
+    void retire(uint32_t pc, uint32_t insn, uint32_t next_pc);  //Count an instruction and follow any call or return.
+    void start(uint32_t pc);                                    //Set the function sampled execution starts in.
+    void sample(uint32_t pc, uint32_t fp, const memory &mem);   //Record the pc and the functions on the call stack.
+    void aggregate();                                           //Fold the recorded samples into the profile.
+    uint64_t get_total() const;                                 //Get the instructions or samples counted.
+
+    void write_flat(std::ostream &os, const memory &mem, const elf_loader &elf) const;  //Write the counts sorted by count.
+    void write_collapsed(std::ostream &os, const elf_loader &elf) const;               //Write the call tree as collapsed stacks.
+
+private:
+    /**
+     * @brief Call Tree Node
+     *
+     * One function as reached through one particular chain of calls.
+     */
+    struct frame_node
+    {
+        uint32_t func = { 0 };                     //Address the function was called at.
+        uint32_t parent = { 0 };                   //Index of the calling node, the root is its own parent.
+        uint64_t self = { 0 };                     //Instructions retired in this function under this chain.
+        std::map<uint32_t, uint32_t> children;     //Indexes of called nodes, by function address.
+    };
+
+    uint64_t& count_of(uint32_t pc);                          //Get the counter for a pc.
+    uint32_t call(uint32_t node, uint32_t func);              //Find or add the node for a call from node to func.
+    std::string name(uint32_t addr, const elf_loader &elf) const;  //Name a function address.
+    uint32_t callee(uint32_t ra, uint32_t inner, const memory &mem) const;  //Find the function a return address returns from.
+    static bool is_link(uint32_t r);                          //Check if an xregister holds return addresses.
+
+    static constexpr uint32_t max_frames = 64;          //Deepest return address chain a sample records.
+    static constexpr size_t max_buffered = 1 << 20;     //Words of samples recorded before they are aggregated.
+
+    uint32_t slot_bits;                                //Log2 of the bytes per counter, 1 with RV32C.
+    uint64_t period;                                   //Instructions between samples, zero when every instruction is counted.
+    std::vector<uint32_t> samples;                     //Recorded samples, each a word count then the pc and function entries, innermost first.
+    std::vector<std::unique_ptr<uint64_t[]>> counts;   //Instructions retired per pc, one lazily allocated array per memory page.
+    std::vector<frame_node> nodes;                     //Call tree, the root is the function execution started in.
+    uint32_t current = { 0 };                          //Node of the function being executed, or the root when sampling.
+    uint64_t total = { 0 };                            //Instructions or samples counted.
+};
+
+#endif
@@ -9,7 +9,6 @@
 //
 //***************************************************************************
 #include <iostream>
-#include <iomanip>
 #include "registerfile.h"
 
 /**
@@ -45,6 +44,7 @@ void registerfile::reset()
 {
     regs.assign(32, 0xf0f0f0f0);
     regs.at(0) = 0; //Initialize register x0 to zero,
+    shadow_valid = false;
 }
 
 /**
@@ -74,35 +74,89 @@ int32_t registerfile::get(uint32_t reg) const
     return regs.at(reg);
 }
 
+/**
+ * @brief Get the register storage for direct access.
+ * 
+ * Writers must never store to x0.
+ * 
+ * @return Pointer to the 32 register values, x0 first.
+ */
+int32_t* registerfile::data()
+{
+    return regs.data();
+}
+
 /**
  * @brief Dump register contents.
  * 
+ * Each line is formatted into a local buffer and written at once, nothing is allocated.
+ * 
  * @param hdr String to be printed to the left of any output.
  */
 void registerfile::dump(const std::string &hdr) const
 {
-    uint32_t regCount = 0; //Number of registers printed.
+    char line[5 + 8 * 9 + 1]; //Label, 8 values with their spaces, the extra space and a null.
     for(uint32_t i = 0; i < regs.size(); i+=8) //Iterate once per line for a set of 8 registers.
     {
-        if(hdr != "") //If prefix string isn't blank.
-        {
-            std::cout << hdr;
-        }
-        std::cout << std::right << std::setw(3) << "x" + std::to_string(regCount) << " ";
+        char *p = line;
+        *p++ = i < 10 ? ' ' : 'x'; //Label right aligned in 3 columns.
+        *p++ = i < 10 ? 'x' : static_cast<char>('0' + i / 10);
+        *p++ = static_cast<char>('0' + i % 10);
         for(uint32_t j = 0; j < 8; ++j) //Iterate each register.
         {
-            std::cout << hex::to_hex32(get(regCount)); //Print the register value.
-            if(j < 7)  
+            *p++ = ' ';
+            if(j == 4) //Add a space every 4 registers.
             {
-                std::cout  << " ";
-                if(j != 0 && (j + 1) % 4 == 0) //Add a space every 4 registers.
-                {
-                    std::cout  << " ";
-                }
+                *p++ = ' ';
             }
-            ++regCount; 
+            p = hex::to_hex32(get(i + j), p); //Format the register value.
+        }
+        std::cout << hdr << line << std::endl;
+    }
+}
+    
+
+/**
+ * @brief Get a mask of the registers changed since the last dump_changes().
+ *
+ * Compares against a shadow copy rather than tracking writes, so values stored through data() are caught too.
+ *
+ * @return Bit n set if xn changed, every bit set before the first dump_changes() after reset().
+ */
+uint32_t registerfile::get_changed() const
+{
+    if(!shadow_valid)
+    {
+        return 0xffffffff;
+    }
+    uint32_t mask = 0;
+    for(uint32_t i = 1; i < regs.size(); ++i) //x0 never changes.
+    {
+        mask |= static_cast<uint32_t>(regs[i] != shadow[i]) << i;
+    }
+    return mask;
+}
+
+/**
+ * @brief Dump only the registers changed since the last call.
+ *
+ * Writes each changed register as a space separated xn value pair, with no line break. The first call after
+ * reset() writes every register, so applying the pairs in order rebuilds the full register state.
+ *
+ * @param os Stream to write to.
+ */
+void registerfile::dump_changes(std::ostream &os)
+{
+    uint32_t mask = get_changed();
+    for(uint32_t i = 0; mask != 0; ++i, mask >>= 1)
+    {
+        if(mask & 1)
+        {
+            char buf[9];
+            hex::to_hex32(regs[i], buf);
+            os << " x" << i << " " << buf;
         }
-        std::cout << std::endl;
     }
+    shadow = regs;
+    shadow_valid = true;
 }
-    
\ No newline at end of file
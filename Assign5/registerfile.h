@@ -12,6 +12,7 @@
 //
 //***************************************************************************
 #include <vector>
+#include <ostream>
 #include "hex.h"
 
 /**
@@ -29,10 +30,15 @@ public:
     void reset();                              //Reset and initialize registers.
     void set(uint32_t reg, int32_t val);       //Set register value.
     int32_t get(uint32_t reg) const;           //Return register value.
+    int32_t* data();                           //Get the register storage for direct access.
     void dump(const std::string &hdr) const;   //Dump register contents.
+    uint32_t get_changed() const;              //Get a mask of the registers changed since the last dump_changes().
+    void dump_changes(std::ostream &os);       //Dump only the registers changed since the last call.
     
 private:
     std::vector<int32_t> regs; //Vector to simulate registers.
+    std::vector<int32_t> shadow; //Register values at the last dump_changes().
+    bool shadow_valid = { false }; //Clear until dump_changes() has run since reset(), so it starts with every register.
 };
 
 #endif
\ No newline at end of file
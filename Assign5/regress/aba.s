@@ -0,0 +1,20 @@
+# Hart 0 reserves the word at 0x200 and hart 1 stores back the value it
+# already holds before hart 0's sc.w. Run with -p2 -q1 -i so the harts take
+# turns an instruction at a time. The sc.w must fail, leaving 1 at 0x210.
+    .text
+    .globl _start
+_start:
+    csrr a0, mhartid
+    li   a1, 0x200
+    bnez a0, other
+    lr.w t0, (a1)
+    nop
+    nop
+    nop
+    sc.w t1, t0, (a1)
+    sw   t1, 0x10(a1)
+    ebreak
+other:
+    lw   t0, 0(a1)
+    sw   t0, 0(a1)
+    ebreak
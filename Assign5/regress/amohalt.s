@@ -0,0 +1,13 @@
+# A misaligned amoadd.w halts the hart in the middle of what would
+# otherwise be one basic block. Every engine must stop there, leaving
+# x8, x9 and m[0x80] untouched and 3 instructions executed.
+    .text
+    .globl _start
+_start:
+    addi x5, x0, 0x101
+    addi x7, x0, 5
+    amoadd.w x6, x7, (x5)
+    addi x8, x0, 1
+    addi x9, x0, 2
+    sw   x9, 0x80(x0)
+    ebreak
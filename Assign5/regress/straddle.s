@@ -0,0 +1,29 @@
+# A hot loop stores to a data page until iteration 150, when its misaligned
+# sw moves to 0x1ffe and runs onto the code page after it, rewriting the
+# loop's first instruction so the rest of the run increments a1 instead of
+# a0. Every engine must end with a0 = 0x96 and a1 = 0x97.
+    .text
+    .globl _start
+_start:
+    li   s0, 200
+    li   s1, 150
+    li   t3, 0x1ff0
+    lui  t5, 0x05930        # upper halfword is the low halfword of addi a1,a0,1
+    li   a0, 0
+    li   a1, 0
+    li   s2, 0
+    li   t0, 0x2000
+    jr   t0
+    .org 0x2000
+loop:
+    addi a0, a0, 1          # becomes addi a1,a0,1 once patched
+    addi s2, s2, 1
+    slt  t1, s2, s1
+    xori t1, t1, 1
+    slli t2, t1, 4
+    slli t1, t1, 1
+    sub  t1, t2, t1
+    add  t6, t3, t1         # 0x1ff0, then 0x1ffe from iteration 150 on
+    sw   t5, 0(t6)          # at 0x1ffe straddles the data page and the code page at 0x2000
+    blt  s2, s0, loop
+    ebreak
@@ -10,6 +10,8 @@
 //***************************************************************************
 #include <iomanip>
 #include <cassert>
+#include <vector>
+#include <algorithm>
 #include "rv32i_decode.h"
 
 /**
@@ -90,6 +92,21 @@ std::string rv32i_decode::decode(uint32_t addr, uint32_t insn)
         assert(0 && "unrecognized funct3 code"); //It should be impossible to ever get here!
 
         case opcode_rtype:
+        if(get_funct7(insn) == funct7_muldiv) //RV32M
+        {
+            switch(get_funct3(insn)) //Discriminate further by funct3.
+            {
+                case funct3_mul:    return render_rtype(insn, "mul");     //Multiply
+                case funct3_mulh:   return render_rtype(insn, "mulh");    //Multiply High
+                case funct3_mulhsu: return render_rtype(insn, "mulhsu");  //Multiply High Signed Unsigned
+                case funct3_mulhu:  return render_rtype(insn, "mulhu");   //Multiply High Unsigned
+                case funct3_div:    return render_rtype(insn, "div");     //Divide
+                case funct3_divu:   return render_rtype(insn, "divu");    //Divide Unsigned
+                case funct3_rem:    return render_rtype(insn, "rem");     //Remainder
+                case funct3_remu:   return render_rtype(insn, "remu");    //Remainder Unsigned
+            }
+            assert(0 && "unrecognized funct3 code"); //It should be impossible to ever get here!
+        }
         switch(get_funct3(insn)) //Discriminate further by funct3.
         {
             default:                return render_illegal_insn(insn);
@@ -142,10 +159,317 @@ std::string rv32i_decode::decode(uint32_t addr, uint32_t insn)
             case funct3_csrrci:     return render_csrrxi(insn, "csrrci");  //Atomic Read and Clear Immediate
         }
         assert(0 && "unrecognized funct3 code"); //It should be impossible to ever get here!
+
+        case opcode_amo:
+        if(get_funct3(insn) != funct3_amo_w) //Only word sized atomics exist in RV32A.
+        {
+            return render_illegal_insn(insn);
+        }
+        switch(get_funct5(insn)) //Discriminate further by funct5.
+        {
+            default:                return render_illegal_insn(insn);
+            case funct5_lr:         return get_rs2(insn) == 0 ? render_amo(insn, "lr.w") : render_illegal_insn(insn);  //Load Reserved
+            case funct5_sc:         return render_amo(insn, "sc.w");        //Store Conditional
+            case funct5_amoswap:    return render_amo(insn, "amoswap.w");   //Atomic Swap
+            case funct5_amoadd:     return render_amo(insn, "amoadd.w");    //Atomic Add
+            case funct5_amoxor:     return render_amo(insn, "amoxor.w");    //Atomic Exclusive Or
+            case funct5_amoand:     return render_amo(insn, "amoand.w");    //Atomic And
+            case funct5_amoor:      return render_amo(insn, "amoor.w");     //Atomic Or
+            case funct5_amomin:     return render_amo(insn, "amomin.w");    //Atomic Minimum
+            case funct5_amomax:     return render_amo(insn, "amomax.w");    //Atomic Maximum
+            case funct5_amominu:    return render_amo(insn, "amominu.w");   //Atomic Minimum Unsigned
+            case funct5_amomaxu:    return render_amo(insn, "amomaxu.w");   //Atomic Maximum Unsigned
+        }
+        assert(0 && "unrecognized funct5 code"); //It should be impossible to ever get here!
     }
     assert(0 && "unrecognized opcode"); //It should be impossible to ever get here!
 }
 
+/**
+ * @brief Encode an R Type instruction.
+ * 
+ * @return Instruction word with the given fields.
+ */
+static uint32_t encode_rtype(uint32_t opcode, uint32_t rd, uint32_t funct3, uint32_t rs1, uint32_t rs2, uint32_t funct7)
+{
+    return funct7 << 25 | rs2 << 20 | rs1 << 15 | funct3 << 12 | rd << 7 | opcode;
+}
+
+/**
+ * @brief Encode an I Type instruction.
+ * 
+ * @return Instruction word with the given fields and the low 12 bits of imm.
+ */
+static uint32_t encode_itype(uint32_t opcode, uint32_t rd, uint32_t funct3, uint32_t rs1, int32_t imm)
+{
+    return (imm & 0x00000fff) << 20 | rs1 << 15 | funct3 << 12 | rd << 7 | opcode;
+}
+
+/**
+ * @brief Encode an S Type instruction.
+ * 
+ * @return Instruction word with the given fields and the low 12 bits of imm.
+ */
+static uint32_t encode_stype(uint32_t opcode, uint32_t funct3, uint32_t rs1, uint32_t rs2, int32_t imm)
+{
+    return (imm & 0x00000fe0) << (25-5) | rs2 << 20 | rs1 << 15 | funct3 << 12 | (imm & 0x0000001f) << 7 | opcode;
+}
+
+/**
+ * @brief Encode a B Type instruction.
+ * 
+ * @return Instruction word with the given fields and the 13 bit branch offset imm.
+ */
+static uint32_t encode_btype(uint32_t opcode, uint32_t funct3, uint32_t rs1, uint32_t rs2, int32_t imm)
+{
+    uint32_t insn = (imm & 0x00001000) << (31-12); //Sign bit.
+    insn |= (imm & 0x000007e0) << (25-5);          //imm[10:5]
+    insn |= (imm & 0x0000001e) << (8-1);           //imm[4:1]
+    insn |= (imm & 0x00000800) >> (11-7);          //imm[11]
+    return insn | rs2 << 20 | rs1 << 15 | funct3 << 12 | opcode;
+}
+
+/**
+ * @brief Encode a U Type instruction.
+ * 
+ * @return Instruction word with the given fields and the upper 20 bits of imm.
+ */
+static uint32_t encode_utype(uint32_t opcode, uint32_t rd, int32_t imm)
+{
+    return (imm & 0xfffff000) | rd << 7 | opcode;
+}
+
+/**
+ * @brief Encode a J Type instruction.
+ * 
+ * @return Instruction word with the given fields and the 21 bit jump offset imm.
+ */
+static uint32_t encode_jtype(uint32_t opcode, uint32_t rd, int32_t imm)
+{
+    uint32_t insn = (imm & 0x00100000) << (31-20); //Sign bit.
+    insn |= (imm & 0x000007fe) << (21-1);          //imm[10:1]
+    insn |= (imm & 0x00000800) << (20-11);         //imm[11]
+    insn |= (imm & 0x000ff000);                    //imm[19:12]
+    return insn | rd << 7 | opcode;
+}
+
+/**
+ * @brief Check if an instruction is a 16-bit RV32C instruction.
+ * 
+ * @param insn Instruction, only the low 2 bits are looked at.
+ * @return true unless the low 2 bits are both set, which marks a 32-bit instruction.
+ */
+bool rv32i_decode::is_compressed(uint32_t insn)
+{
+    return (insn & 0x00000003) != 0x00000003;
+}
+
+/**
+ * @brief Expand an RV32C instruction to its 32-bit equivalent.
+ * 
+ * Every RV32C instruction without floating point operands has a 32-bit RV32I instruction that does exactly
+ * the same thing, so compressed code can be executed and rendered by the 32-bit paths once expanded.
+ * Reserved encodings and RV64/RV128 only encodings are illegal.
+ * 
+ * @param insn 16-bit instruction to expand, in the low half.
+ * @param mnemonic Set to the compressed mnemonic when the instruction is legal, if not null.
+ * @return The equivalent 32-bit instruction, or zero (an illegal instruction) if insn is illegal.
+ */
+uint32_t rv32i_decode::expand_compressed(uint32_t insn, const char **mnemonic)
+{
+    auto bits = [insn](int hi, int lo) { return (insn >> lo) & ((1u << (hi - lo + 1)) - 1); }; //Select insn[hi:lo].
+
+    uint32_t rd = bits(11, 7);          //Full register fields.
+    uint32_t rs2 = bits(6, 2);
+    uint32_t rd_p = bits(4, 2) + 8;     //Three bit register fields, x8..x15.
+    uint32_t rs1_p = bits(9, 7) + 8;
+    int32_t imm6 = static_cast<int32_t>((bits(12, 12) << 5 | bits(6, 2)) << 26) >> 26; //Sign-extended imm[5:0], shared by several formats.
+    uint32_t uimm_w = bits(12, 10) << 3 | bits(6, 6) << 2 | bits(5, 5) << 6;           //c.lw and c.sw word offset.
+
+    const char *name = nullptr;
+    uint32_t out = 0;
+
+    switch(bits(1, 0) << 3 | bits(15, 13)) //Discriminate by quadrant and funct3.
+    {
+        default: break; //Floating point, reserved and RV64/RV128 encodings.
+
+        case 0b00000: //Quadrant 0.
+        {
+            uint32_t nzuimm = bits(12, 11) << 4 | bits(10, 7) << 6 | bits(6, 6) << 2 | bits(5, 5) << 3;
+            if(nzuimm != 0)
+            {
+                name = "c.addi4spn"; out = encode_itype(opcode_alu_imm, rd_p, funct3_add, 2, nzuimm);  //Add Immediate to Stack Pointer
+            }
+        }
+        break;
+        case 0b00010:   name = "c.lw"; out = encode_itype(opcode_load_imm, rd_p, funct3_lw, rs1_p, uimm_w); break;   //Load Word
+        case 0b00110:   name = "c.sw"; out = encode_stype(opcode_stype, funct3_sw, rs1_p, rd_p, uimm_w); break;      //Store Word
+
+        case 0b01000:   name = (rd == 0) ? "c.nop" : "c.addi"; out = encode_itype(opcode_alu_imm, rd, funct3_add, rd, imm6); break;  //Add Immediate
+        case 0b01001:   //Jump And Link
+        case 0b01101:   //Jump
+        {
+            int32_t imm = bits(12, 12) << 11 | bits(11, 11) << 4 | bits(10, 9) << 8 | bits(8, 8) << 10;
+            imm |= bits(7, 7) << 6 | bits(6, 6) << 7 | bits(5, 3) << 1 | bits(2, 2) << 5;
+            imm = static_cast<int32_t>(imm << 20) >> 20; //Sign extend from bit 11.
+            bool link = bits(15, 13) == 0b001;
+            name = link ? "c.jal" : "c.j"; out = encode_jtype(opcode_jal, link ? 1 : 0, imm);
+        }
+        break;
+        case 0b01010:   name = "c.li"; out = encode_itype(opcode_alu_imm, rd, funct3_add, 0, imm6); break;     //Load Immediate
+        case 0b01011:
+        if(rd == 2) //Add Immediate to Stack Pointer, in multiples of 16.
+        {
+            int32_t nzimm = bits(12, 12) << 9 | bits(6, 6) << 4 | bits(5, 5) << 6 | bits(4, 3) << 7 | bits(2, 2) << 5;
+            nzimm = static_cast<int32_t>(nzimm << 22) >> 22; //Sign extend from bit 9.
+            if(nzimm != 0)
+            {
+                name = "c.addi16sp"; out = encode_itype(opcode_alu_imm, 2, funct3_add, 2, nzimm);
+            }
+        }
+        else if(imm6 != 0) //Load Upper Immediate
+        {
+            name = "c.lui"; out = encode_utype(opcode_lui, rd, imm6 << 12);
+        }
+        break;
+        case 0b01100:
+        switch(bits(11, 10)) //Discriminate further by funct2.
+        {
+            case 0b00:  if(bits(12, 12) == 0) { name = "c.srli"; out = encode_itype(opcode_alu_imm, rs1_p, funct3_srx, rs1_p, rs2); } break;   //Shift Right Logical Immediate
+            case 0b01:  if(bits(12, 12) == 0) { name = "c.srai"; out = encode_itype(opcode_alu_imm, rs1_p, funct3_srx, rs1_p, funct7_sra << 5 | rs2); } break; //Shift Right Arithmetic Immediate
+            case 0b10:  name = "c.andi"; out = encode_itype(opcode_alu_imm, rs1_p, funct3_and, rs1_p, imm6); break;  //And Immediate
+            case 0b11:
+            if(bits(12, 12) == 0) //The rest are RV64 only.
+            {
+                switch(bits(6, 5)) //Discriminate further by funct2.
+                {
+                    case 0b00:  name = "c.sub"; out = encode_rtype(opcode_rtype, rs1_p, funct3_add, rs1_p, rd_p, funct7_sub); break;  //Subtract
+                    case 0b01:  name = "c.xor"; out = encode_rtype(opcode_rtype, rs1_p, funct3_xor, rs1_p, rd_p, funct7_add); break;  //Exclusive Or
+                    case 0b10:  name = "c.or"; out = encode_rtype(opcode_rtype, rs1_p, funct3_or, rs1_p, rd_p, funct7_add); break;    //Or
+                    case 0b11:  name = "c.and"; out = encode_rtype(opcode_rtype, rs1_p, funct3_and, rs1_p, rd_p, funct7_add); break;  //And
+                }
+            }
+            break;
+        }
+        break;
+        case 0b01110:   //Branch Equal to Zero
+        case 0b01111:   //Branch Not Equal to Zero
+        {
+            int32_t imm = bits(12, 12) << 8 | bits(11, 10) << 3 | bits(6, 5) << 6 | bits(4, 3) << 1 | bits(2, 2) << 5;
+            imm = static_cast<int32_t>(imm << 23) >> 23; //Sign extend from bit 8.
+            bool ne = bits(15, 13) == 0b111;
+            name = ne ? "c.bnez" : "c.beqz"; out = encode_btype(opcode_btype, ne ? funct3_bne : funct3_beq, rs1_p, 0, imm);
+        }
+        break;
+
+        case 0b10000:   if(bits(12, 12) == 0) { name = "c.slli"; out = encode_itype(opcode_alu_imm, rd, funct3_sll, rd, rs2); } break; //Shift Left Logical Immediate
+        case 0b10010:   //Load Word from Stack Pointer
+        if(rd != 0)
+        {
+            name = "c.lwsp"; out = encode_itype(opcode_load_imm, rd, funct3_lw, 2, bits(12, 12) << 5 | bits(6, 4) << 2 | bits(3, 2) << 6);
+        }
+        break;
+        case 0b10100:
+        if(bits(12, 12) == 0)
+        {
+            if(rs2 == 0 && rd != 0)
+            {
+                name = "c.jr"; out = encode_itype(opcode_jalr, 0, 0, rd, 0);                                 //Jump Register
+            }
+            else if(rs2 != 0)
+            {
+                name = "c.mv"; out = encode_rtype(opcode_rtype, rd, funct3_add, 0, rs2, funct7_add);          //Move
+            }
+        }
+        else if(rs2 == 0)
+        {
+            name = (rd == 0) ? "c.ebreak" : "c.jalr"; out = (rd == 0) ? insn_ebreak : encode_itype(opcode_jalr, 1, 0, rd, 0); //Breakpoint or Jump And Link Register
+        }
+        else
+        {
+            name = "c.add"; out = encode_rtype(opcode_rtype, rd, funct3_add, rd, rs2, funct7_add);            //Add
+        }
+        break;
+        case 0b10110:   name = "c.swsp"; out = encode_stype(opcode_stype, funct3_sw, 2, rs2, bits(12, 9) << 2 | bits(8, 7) << 6); break; //Store Word to Stack Pointer
+    }
+
+    if(mnemonic && out != 0)
+    {
+        *mnemonic = name;
+    }
+    return out;
+}
+
+/**
+ * @brief Decode a 16-bit RV32C instruction.
+ * 
+ * Render the 32-bit equivalent in RV32C assembly syntax.
+ * 
+ * @param addr The memory address where the insn is stored.
+ * @param insn The 16-bit instruction to decode.
+ * @return std::string 
+ */
+std::string rv32i_decode::decode_compressed(uint32_t addr, uint32_t insn)
+{
+    const char *mnemonic = nullptr;
+    uint32_t expanded = expand_compressed(insn, &mnemonic);
+    if(expanded == 0)
+    {
+        return render_illegal_insn(insn);
+    }
+
+    return render_compressed(decode(addr, expanded), mnemonic);
+}
+
+/**
+ * @brief Render an expanded RV32C instruction in RV32C assembly syntax.
+ * 
+ * The compressed forms only leave out operands the expansion spells out: c.j and c.jal the link register,
+ * c.jr and c.jalr everything but the base register, and the two operand forms the register that is either
+ * the destination again or x0, which is always the middle one. c.nop has none at all.
+ * 
+ * @param rendered Rendering of the 32-bit expansion.
+ * @param mnemonic Compressed mnemonic to replace the expansion's with.
+ * @return The compressed mnemonic followed by the operands the compressed instruction names.
+ */
+std::string rv32i_decode::render_compressed(const std::string &rendered, const char *mnemonic)
+{
+    size_t operands = rendered.find_first_not_of(' ', rendered.find(' ')); //Skip the expanded mnemonic and its padding.
+    std::string m(mnemonic);
+    if(operands == std::string::npos || m == "c.nop") //No operands, such as c.ebreak.
+    {
+        return m;
+    }
+
+    std::vector<std::string> ops;
+    for(size_t start = operands; start <= rendered.size(); )
+    {
+        size_t comma = std::min(rendered.find(',', start), rendered.size());
+        ops.push_back(rendered.substr(start, comma - start));
+        start = comma + 1;
+    }
+    if(m == "c.j" || m == "c.jal")
+    {
+        ops.erase(ops.begin());
+    }
+    else if(m == "c.jr" || m == "c.jalr") //Only the base register of 0(rs1).
+    {
+        size_t open = ops[1].find('(');
+        ops = { ops[1].substr(open + 1, ops[1].size() - open - 2) };
+    }
+    else if(ops.size() == 3 && m != "c.addi4spn")
+    {
+        ops.erase(ops.begin() + 1);
+    }
+
+    std::string s = render_mnemonic(m.size() < mnemonic_width ? m : m + " "); //Long names still get a space.
+    for(size_t i = 0; i < ops.size(); ++i)
+    {
+        s += (i ? "," : "") + ops[i];
+    }
+    return s;
+}
+
 /**
  * @brief Retrieve instruction opcode.
  * 
@@ -224,6 +548,19 @@ uint32_t rv32i_decode::get_funct7(uint32_t insn)
     return (insn & 0xfe000000) >> 25; //Select first 7 bits, shift full right.
 }
 
+/**
+ * @brief Retrieve funct5 discriminator. (AMO)
+ * 
+ * Isolate and return the funct5 bitvalue from an atomic instruction, leaving out the aq and rl bits.
+ * 
+ * @param insn Instruction to select funct5 from.
+ * @return uint32_t representing funct5 bitvalue.
+ */
+uint32_t rv32i_decode::get_funct5(uint32_t insn)
+{
+    return (insn & 0xf8000000) >> 27; //Select first 5 bits, shift full right.
+}
+
 /**
  * @brief Retrieve immediate numeric operand. (I Type)
  * 
@@ -473,6 +810,30 @@ std::string rv32i_decode::render_rtype(uint32_t insn, const char *mnemonic)
     return os.str();
 }
 
+/**
+ * @brief Render LR, SC or AMO instruction.
+ * 
+ * Decode and render atomic instructions in rd,(rs1) format for lr.w and rd,rs2,(rs1) format for the rest,
+ * with any .aq, .rl or .aqrl ordering suffix added to the mnemonic.
+ * 
+ * @param insn Instruction to decode and render.
+ * @param mnemonic of instruction to be rendered.
+ * @return string of atomic instruction formatting.
+ */
+std::string rv32i_decode::render_amo(uint32_t insn, const char *mnemonic)
+{
+    static const char *suffix[4] = { "", ".rl", ".aq", ".aqrl" };  //By aq and rl bits.
+    std::ostringstream os;
+    std::string m = std::string(mnemonic) + suffix[(insn >> 25) & 3];
+    os << render_mnemonic(m.size() < mnemonic_width ? m : m + " ") << render_reg(get_rd(insn)) << ","; //Long names still get a space.
+    if(get_funct5(insn) != funct5_lr)
+    {
+        os << render_reg(get_rs2(insn)) << ",";
+    }
+    os << "(" << render_reg(get_rs1(insn)) << ")";
+    return os.str();
+}
+
 /**
  * @brief Render ecall instruction message.
  * 
@@ -23,6 +23,9 @@ class rv32i_decode : public hex
 {
 public:
     static std::string decode(uint32_t addr, uint32_t insn); //Decode memory address instruction.
+    static std::string decode_compressed(uint32_t addr, uint32_t insn);                 //Decode a 16-bit RV32C instruction.
+    static uint32_t expand_compressed(uint32_t insn, const char **mnemonic = nullptr);  //Expand an RV32C instruction to its 32-bit equivalent.
+    static bool is_compressed(uint32_t insn);                                           //Check if an instruction is a 16-bit RV32C instruction.
 
 protected:
     static constexpr int mnemonic_width             = 8;
@@ -37,6 +40,7 @@ protected:
     static constexpr uint32_t opcode_alu_imm        = 0b0010011;
     static constexpr uint32_t opcode_rtype          = 0b0110011;
     static constexpr uint32_t opcode_system         = 0b1110011;
+    static constexpr uint32_t opcode_amo            = 0b0101111;
 
     static constexpr uint32_t funct3_beq            = 0b000;
     static constexpr uint32_t funct3_bne            = 0b001;
@@ -69,6 +73,16 @@ protected:
 
     static constexpr uint32_t funct7_add            = 0b0000000;
     static constexpr uint32_t funct7_sub            = 0b0100000;
+    static constexpr uint32_t funct7_muldiv         = 0b0000001;
+
+    static constexpr uint32_t funct3_mul            = 0b000;
+    static constexpr uint32_t funct3_mulh           = 0b001;
+    static constexpr uint32_t funct3_mulhsu         = 0b010;
+    static constexpr uint32_t funct3_mulhu          = 0b011;
+    static constexpr uint32_t funct3_div            = 0b100;
+    static constexpr uint32_t funct3_divu           = 0b101;
+    static constexpr uint32_t funct3_rem            = 0b110;
+    static constexpr uint32_t funct3_remu           = 0b111;
 
     static constexpr uint32_t eCode                 = 0b000;
     static constexpr uint32_t insn_ecall            = 0x00000073;
@@ -81,12 +95,27 @@ protected:
     static constexpr uint32_t funct3_csrrsi         = 0b110;
     static constexpr uint32_t funct3_csrrci         = 0b111;
 
+    static constexpr uint32_t funct3_amo_w          = 0b010;
+
+    static constexpr uint32_t funct5_lr             = 0b00010;
+    static constexpr uint32_t funct5_sc             = 0b00011;
+    static constexpr uint32_t funct5_amoswap        = 0b00001;
+    static constexpr uint32_t funct5_amoadd         = 0b00000;
+    static constexpr uint32_t funct5_amoxor         = 0b00100;
+    static constexpr uint32_t funct5_amoand         = 0b01100;
+    static constexpr uint32_t funct5_amoor          = 0b01000;
+    static constexpr uint32_t funct5_amomin         = 0b10000;
+    static constexpr uint32_t funct5_amomax         = 0b10100;
+    static constexpr uint32_t funct5_amominu        = 0b11000;
+    static constexpr uint32_t funct5_amomaxu        = 0b11100;
+
     static uint32_t get_opcode(uint32_t insn); //Retrieve instruction opcode.
     static uint32_t get_rd(uint32_t insn);     //Retrieve result xregister.
     static uint32_t get_funct3(uint32_t insn); //Retrieve funct3 discriminator.
     static uint32_t get_rs1(uint32_t insn);    //Retrieve first source operand xregister.
     static uint32_t get_rs2(uint32_t insn);    //Retrieve second source operand xregister.
     static uint32_t get_funct7(uint32_t insn); //Retrieve funct7 discriminator.
+    static uint32_t get_funct5(uint32_t insn); //Retrieve funct5 discriminator. (AMO)
 
     static int32_t get_imm_i(uint32_t insn);   //Retrieve immediate numeric operand. (I Type)
     static int32_t get_imm_u(uint32_t insn);   //Retrieve immediate numeric operand. (U Type)
@@ -112,6 +141,8 @@ protected:
     static std::string render_ebreak(uint32_t insn);                        //Render ebreak instruction message.
     static std::string render_csrrx(uint32_t insn, const char *mnemonic);   //Render csrrx instruction set message.
     static std::string render_csrrxi(uint32_t insn, const char *mnemonic);  //Render csrrxi instruction message.
+    static std::string render_amo(uint32_t insn, const char *mnemonic);     //Render LR, SC or AMO instruction.
+    static std::string render_compressed(const std::string &rendered, const char *mnemonic); //Render an expanded RV32C instruction in RV32C assembly syntax.
 
     static std::string render_reg(int r);                                   //Render xregister formatting.
     static std::string render_base_disp(uint32_t base, int32_t disp);       //Render displacement off of base formatting.
@@ -10,7 +10,9 @@
 //***************************************************************************
 #include <iostream>
 #include <iomanip>
+#include <sstream>
 #include <cassert>
+#include <algorithm>
 #include "rv32i_hart.h"
 
 /**
@@ -37,6 +39,19 @@ void rv32i_hart::set_show_registers(bool b)
     show_registers = b;
 }
 
+/**
+ * @brief Show only the registers that changed instead of all of them.
+ * 
+ * When flag is true, the show registers dump before each instruction lists the pc and only the registers
+ * that changed since the previous one.
+ *
+ * @param b indicating whether the flag should be on or off.
+ */
+void rv32i_hart::set_show_register_changes(bool b)
+{
+    show_register_changes = b;
+}
+
 /**
  * @brief Return halt status.
  * 
@@ -76,6 +91,16 @@ uint64_t rv32i_hart::get_insn_counter() const
     return insn_counter; 
 }
 
+/**
+ * @brief Set the reset address.
+ * 
+ * @param addr Address reset() starts execution at, such as an executable's entry point.
+ */
+void rv32i_hart::set_reset_pc(uint32_t addr)
+{
+    reset_pc = addr;
+}
+
 /**
  * @brief Set mhart ID.
  * 
@@ -86,6 +111,278 @@ void rv32i_hart::set_mhartid(int ID)
     mhartid = ID;
 }
 
+/**
+ * @brief Set the stack pointer reset() starts with.
+ *
+ * @param addr Initial x2, the size of memory unless set.
+ */
+void rv32i_hart::set_reset_sp(uint32_t addr)
+{
+    reset_sp = addr;
+}
+
+/**
+ * @brief Enable RV32C compressed instructions.
+ *
+ * With RV32C the pc only needs to be 2 byte aligned and each fetch looks at the low 2 bits of the first halfword
+ * to tell a 16-bit instruction from a 32-bit one. The predecode cache gets a slot per halfword, so it is dropped.
+ *
+ * @param b Whether compressed instructions are fetched.
+ */
+void rv32i_hart::set_rvc(bool b)
+{
+    rvc = b;
+    slot_bits = rvc ? 1 : 2;
+    icache.clear();
+    code_modified = true;
+}
+
+/**
+ * @brief Model an L1 instruction cache.
+ *
+ * Every instruction tick() fetches is looked up in it. Only stepping feeds the model, the faster engines step instead
+ * while it is present.
+ *
+ * @param c Geometry of the cache.
+ */
+void rv32i_hart::set_l1i(const cache_sim::config &c)
+{
+    l1i.reset(new cache_sim(c));
+}
+
+/**
+ * @brief Model an L1 data cache.
+ *
+ * Every load, store and atomic memory operation is looked up in it.
+ *
+ * @param c Geometry of the cache.
+ */
+void rv32i_hart::set_l1d(const cache_sim::config &c)
+{
+    l1d.reset(new cache_sim(c));
+}
+
+/**
+ * @brief Report the hits and misses of any modeled caches.
+ *
+ * @param hdr String to be printed to the left of any output.
+ */
+void rv32i_hart::report_caches(const std::string &hdr) const
+{
+    if(l1i)
+    {
+        std::cout << hdr;
+        l1i->report(std::cout, "L1I");
+    }
+    if(l1d)
+    {
+        std::cout << hdr;
+        l1d->report(std::cout, "L1D");
+    }
+}
+
+/**
+ * @brief Model branch predictors.
+ *
+ * Every conditional branch is predicted by each of the predictors and every jal and jalr is fed to the return
+ * address stack. Like the cache models, only stepping feeds it.
+ *
+ * @param c Predictors to compare and the return address stack depth.
+ */
+void rv32i_hart::set_branch_unit(const branch_unit::config &c)
+{
+    bpu.reset(new branch_unit(c));
+}
+
+/**
+ * @brief Report the accuracy of any modeled branch predictors.
+ *
+ * @param hdr String to be printed to the left of any output.
+ */
+void rv32i_hart::report_branches(const std::string &hdr) const
+{
+    if(bpu)
+    {
+        bpu->report(std::cout, hdr);
+    }
+}
+
+/**
+ * @brief Model pipeline timing.
+ *
+ * Every instruction tick() executes is timed, with fetches and data accesses waiting on memory when they miss
+ * in a modeled cache, or always when there is none, and control transfers judged by any branch predictors.
+ * While present, mcycle and cycle read the cycles it has counted.
+ *
+ * @param c Stall penalties.
+ */
+void rv32i_hart::set_timing(const pipeline_model::config &c)
+{
+    timing.reset(new pipeline_model(c));
+}
+
+/**
+ * @brief Report the cycles and stalls of any pipeline timing model.
+ *
+ * @param hdr String to be printed to the left of any output.
+ */
+void rv32i_hart::report_timing(const std::string &hdr) const
+{
+    if(timing)
+    {
+        timing->report(std::cout, hdr);
+    }
+}
+
+/**
+ * @brief Record a binary trace of every instruction tick() executes.
+ *
+ * The trace starts from the hart's current state, so call it after reset() or restore_state(). Records
+ * are written by a background thread, the file is complete once close_trace() is called or the hart is
+ * destroyed.
+ *
+ * @param fname Name of the trace file to create.
+ * @return false if the file could not be created.
+ */
+bool rv32i_hart::set_trace_file(const std::string &fname)
+{
+    hart_state s = save_state();
+    trace_writer::header h;
+    h.insn_counter = s.insn_counter;
+    h.mem_size = mem.get_size();
+    h.flags = rvc ? trace_writer::flag_rvc : 0;
+    h.pc = s.pc;
+    std::copy(s.regs, s.regs + 32, h.regs);
+
+    tracer.reset(new trace_writer());
+    if(!tracer->open(fname, h))
+    {
+        tracer.reset();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Finish the trace file.
+ *
+ * Waits for every record to be written and closes the file. Instructions executed afterwards are not traced.
+ *
+ * @return false if any of the trace could not be written.
+ */
+bool rv32i_hart::close_trace()
+{
+    if(!tracer)
+    {
+        return true;
+    }
+    bool ok = tracer->close();
+    tracer.reset();
+    return ok;
+}
+
+/**
+ * @brief Get the address a load, store or atomic is about to access.
+ *
+ * @param d Predecoded instruction about to execute.
+ * @return The effective address, or zero for other instructions.
+ */
+uint32_t rv32i_hart::trace_address(const decoded_insn &d) const
+{
+    switch(get_opcode(d.insn))
+    {
+        case opcode_load_imm:
+        case opcode_stype:      return regs.get(d.rs1) + d.imm;
+        case opcode_amo:        return regs.get(d.rs1);
+        default:                return 0;
+    }
+}
+
+/**
+ * @brief Add an executed instruction to the binary trace.
+ *
+ * @param d Predecoded instruction just executed.
+ * @param insn_pc Address it was fetched from.
+ * @param mem_addr Address it accessed, from trace_address().
+ */
+void rv32i_hart::trace_retire(const decoded_insn &d, uint32_t insn_pc, uint32_t mem_addr)
+{
+    trace_writer::record r;
+    r.pc = insn_pc;
+    r.insn = (d.len == 2) ? d.cinsn : d.insn;
+    r.rd_value = regs.get(d.rd);
+    r.mem_addr = 0;
+    r.mem_value = 0;
+
+    uint32_t width = 0;
+    switch(get_opcode(d.insn))
+    {
+        case opcode_load_imm:   width = 1u << (d.funct3 & 3); break; //funct3 holds log2 of the width.
+        case opcode_stype:      width = 1u << (d.funct3 & 3); break;
+        case opcode_amo:        width = 4; break;
+    }
+    if(width != 0 && mem_addr <= mem.get_size() - width) //Out of range accesses only warned and read zero.
+    {
+        r.mem_addr = mem_addr;
+        r.mem_value = (width == 1) ? mem.get8(mem_addr) : (width == 2) ? mem.get16(mem_addr) : mem.get32(mem_addr);
+    }
+    tracer->put(r);
+}
+
+/**
+ * @brief Feed a memory access to a cache model and the timing model.
+ *
+ * @param cache Cache the access goes through, or nullptr if there is none.
+ * @param addr First byte accessed.
+ * @param len Bytes accessed.
+ */
+void rv32i_hart::model_access(cache_sim *cache, uint32_t addr, uint32_t len)
+{
+    uint32_t misses = cache ? cache->access(addr, len) : 1;
+    if(timing)
+    {
+        timing->memory_wait(misses);
+    }
+}
+
+/**
+ * @brief Run on the calling host thread, sharing memory with other harts.
+ *
+ * Writes this hart makes to its own cached instructions still take effect at once. Writes other harts
+ * make are queued until apply_invalidations() is called on this hart's thread, much like a fence.i.
+ *
+ */
+void rv32i_hart::bind_thread()
+{
+    owner = std::this_thread::get_id();
+    shared = true;
+}
+
+/**
+ * @brief Apply writes other harts made to cached instructions.
+ *
+ * Must be called from the thread the hart is bound to.
+ *
+ */
+void rv32i_hart::apply_invalidations()
+{
+    if(!has_pending.load(std::memory_order_acquire))
+    {
+        return;
+    }
+    std::vector<std::pair<uint32_t, uint32_t>> writes;
+    {
+        std::lock_guard<std::mutex> lock(pending_lock);
+        writes.swap(pending);
+        has_pending.store(false, std::memory_order_relaxed);
+    }
+
+    for(const std::pair<uint32_t, uint32_t> &w : writes)
+    {
+        drop_insns(w.first, w.second);
+    }
+}
+
 /**
  * @brief Tick instruction execution.
  *
@@ -102,10 +399,17 @@ void rv32i_hart::tick(const std::string &hdr)
     
     if(show_registers) //Dump according to set flag.
     {
-        dump(hdr);
+        if(show_register_changes)
+        {
+            dump_changes(hdr);
+        }
+        else
+        {
+            dump(hdr);
+        }
     }
 
-    if(!(pc % 4 == 0)) //Ensure memory is aligned to 4 byte multiple boundaries.
+    if(!(pc % (rvc ? 2 : 4) == 0)) //Ensure memory is aligned to 4 byte multiple boundaries, 2 with RV32C.
     {
         halt = true;
         halt_reason = "PC alignment error";
@@ -114,16 +418,46 @@ void rv32i_hart::tick(const std::string &hdr)
 
     insn_counter++;
 
-    uint32_t insn = mem.get32(pc); //Fetch instruction from memory.
+    uint32_t insn_pc = pc;
+    decoded_insn scratch;
+    const decoded_insn &d = fetch(pc, scratch); //Fetch predecoded instruction from memory.
+    if(l1i || timing)
+    {
+        model_access(l1i.get(), pc, d.len);
+    }
+    uint32_t mem_addr = tracer ? trace_address(d) : 0; //The base register may be overwritten.
 
     if(show_instructions) //Print insn according to set flag.
     {
-        std::cout << hdr << hex::to_hex32(pc) << ": " << hex::to_hex32(insn) << "  ";
-        exec(insn, &std::cout);
+        if(d.len == 2) //Show the halfword actually fetched, right aligned under the words.
+        {
+            std::cout << hdr << hex::to_hex32(pc) << ": " << "    " << hex::to_hex16(d.cinsn) << "  ";
+            trace_compressed(d, &std::cout);
+        }
+        else
+        {
+            std::cout << hdr << hex::to_hex32(pc) << ": " << hex::to_hex32(d.insn) << "  ";
+            (this->*d.trace_handler)(d, &std::cout);
+        }
     }
     else
     {
-        exec(insn, nullptr); //Send any output to null.
+        (this->*d.handler)(d, nullptr); //Run the handler built without any output code.
+    }
+
+    if(timing)
+    {
+        bool redirect = pc != insn_pc + d.len; //Without a predictor fetch runs on past every taken branch and jump.
+        uint32_t opcode = get_opcode(d.insn);
+        if(bpu && (opcode == opcode_btype || opcode == opcode_jal || opcode == opcode_jalr))
+        {
+            redirect = bpu->get_mispredicted();
+        }
+        timing->retire(d.insn, redirect);
+    }
+    if(tracer)
+    {
+        trace_retire(d, insn_pc, mem_addr);
     }
 }
 
@@ -144,19 +478,225 @@ void rv32i_hart::dump(const std::string &hdr) const
     std::cout << " pc " << to_hex32(pc) << std::endl;
 }
 
+/**
+ * @brief Dump the pc and the registers changed since the last call.
+ *
+ * Prints one line, the pc followed by the changed registers. The first line after reset() lists every register,
+ * so the full state can be rebuilt from the lines offline, and dump() gives the full state on demand.
+ * 
+ * @param hdr String to be printed to the left of any output.
+ */
+void rv32i_hart::dump_changes(const std::string &hdr)
+{
+    std::cout << hdr << " pc " << to_hex32(pc);
+    regs.dump_changes(std::cout);
+    std::cout << std::endl;
+}
+
 /**
  * @brief Reset hardware thread.
  *
  * Reset the state of the hardware thread by setting the pc, registers, and hart flags to their initial state.
+ * The pc starts at the reset address, zero unless set_reset_pc() was called, and the stack pointer
+ * starts at the top of memory unless set_reset_sp() was called.
  * 
  */
 void rv32i_hart::reset()
 {
-    pc = 0;
+    pc = reset_pc;
     regs.reset(); //Reset the registers. 
+    regs.set(2, reset_sp); //Set register x2 to the top of the stack, the maximum memory size by default.
     insn_counter = 0; //Reset hart status variables.
+    mcycle_offset = 0;
+    minstret_offset = 0;
     halt = false;
     halt_reason = "none";
+    reservation_valid = false;
+    icache.clear(); //Forget any predecoded instructions.
+    code_modified = true;
+}
+
+/**
+ * @brief Capture the architectural state.
+ *
+ * @return The pc, registers, instruction counter and halt status.
+ */
+rv32i_hart::hart_state rv32i_hart::save_state() const
+{
+    hart_state s;
+    s.pc = pc;
+    for(uint32_t r = 0; r < 32; ++r)
+    {
+        s.regs[r] = regs.get(r);
+    }
+    s.insn_counter = insn_counter;
+    s.halt = halt;
+    s.halt_reason = halt_reason;
+    return s;
+}
+
+/**
+ * @brief Resume from a captured state.
+ *
+ * Memory may have been restored along with the state, so every predecoded instruction is dropped.
+ *
+ * @param s State from save_state().
+ */
+void rv32i_hart::restore_state(const hart_state &s)
+{
+    pc = s.pc;
+    for(uint32_t r = 1; r < 32; ++r) //x0 is always zero.
+    {
+        regs.set(r, s.regs[r]);
+    }
+    insn_counter = s.insn_counter;
+    halt = s.halt;
+    halt_reason = s.halt_reason;
+    reservation_valid = false;
+    icache.clear();
+    code_modified = true;
+}
+
+/**
+ * @brief Fetch a predecoded instruction.
+ *
+ * Look up the instruction at addr in the predecode cache, decoding and caching it on a miss.
+ * Fetches that are not entirely within memory are never cached so their warnings repeat every time.
+ * 
+ * @param addr The memory address of the instruction.
+ * @param scratch Record to decode into when the instruction can not be cached.
+ * @return Reference to the predecoded instruction.
+ */
+const rv32i_hart::decoded_insn& rv32i_hart::fetch(uint32_t addr, decoded_insn &scratch)
+{
+    if(static_cast<uint64_t>(addr) + 4 > mem.get_size()) //Out of range, decode every time.
+    {
+        predecode_at(addr, scratch);
+        return scratch;
+    }
+
+    uint32_t page = addr >> memory::page_bits;
+    if(page >= icache.size())
+    {
+        icache.resize(page + 1);
+    }
+    if(!icache[page]) //First fetch from this page, start watching it for writes.
+    {
+        icache[page].reset(new decoded_insn[memory::page_size >> slot_bits]);
+        mem.watch(addr);
+    }
+
+    decoded_insn &d = icache[page][(addr % memory::page_size) >> slot_bits];
+    if(!d.handler) //Cache miss, decode it once.
+    {
+        predecode_at(addr, d);
+        if((addr + d.len - 1) >> memory::page_bits != page) //Runs into the next page, watch that one too.
+        {
+            mem.watch(addr + d.len - 1);
+        }
+    }
+    return d;
+}
+
+/**
+ * @brief Decode the instruction at an address into a cache record.
+ *
+ * With RV32C a 16-bit instruction is expanded to its 32-bit equivalent and decoded as that, so every
+ * handler works on both.
+ *
+ * @param addr The memory address of the instruction.
+ * @param d Record to fill in.
+ */
+void rv32i_hart::predecode_at(uint32_t addr, decoded_insn &d)
+{
+    if(rvc)
+    {
+        uint16_t half = mem.get16(addr);
+        if(is_compressed(half))
+        {
+            predecode(expand_compressed(half), d);
+            d.cinsn = half;
+            d.len = 2;
+            return;
+        }
+    }
+    predecode(mem.get32(addr), d);
+}
+
+/**
+ * @brief Check if an instruction ends a basic block.
+ *
+ * Branches, jumps, system instructions and illegal instructions can all leave the sequential path or halt the hart,
+ * and atomics halt it when misaligned.
+ * 
+ * @param d Predecoded instruction to check.
+ * @return true if no instruction may follow this one in the same basic block.
+ */
+bool rv32i_hart::is_block_end(const decoded_insn &d)
+{
+    switch(get_opcode(d.insn))
+    {
+        case opcode_btype:
+        case opcode_jal:
+        case opcode_jalr:
+        case opcode_system:
+        case opcode_amo:        return true;
+        default:                return d.handler == &rv32i_hart::exec_illegal_insn<false>;
+    }
+}
+
+/**
+ * @brief Drop predecoded instructions overwritten in memory.
+ *
+ * Called by memory whenever a watched page is written so self-modifying code is decoded again.
+ * Only the handler is cleared, so a record that is still executing stays intact. Clearing a live
+ * record sets code_modified so anything built from the cache (such as basic blocks) can be dropped.
+ * 
+ * @param addr First address that was written.
+ * @param len Number of bytes written.
+ */
+void rv32i_hart::invalidate(uint32_t addr, uint32_t len)
+{
+    if(shared && std::this_thread::get_id() != owner) //Another hart wrote it, queue it for this hart's thread.
+    {
+        std::lock_guard<std::mutex> lock(pending_lock);
+        pending.emplace_back(addr, len);
+        has_pending.store(true, std::memory_order_release);
+        return;
+    }
+    drop_insns(addr, len);
+}
+
+/**
+ * @brief Clear the predecoded instructions in a written range.
+ *
+ * @param addr First address that was written.
+ * @param len Number of bytes written.
+ */
+void rv32i_hart::drop_insns(uint32_t addr, uint32_t len)
+{
+    if(rvc) //An instruction starting in the halfword before the write may overlap it as well.
+    {
+        for(uint64_t a = (addr & ~1u) < 2 ? 0 : (addr & ~1u) - 2; a < static_cast<uint64_t>(addr) + len; a += 2)
+        {
+            uint32_t page = a >> memory::page_bits;
+            if(page < icache.size() && icache[page] && icache[page][(a % memory::page_size) >> 1].handler)
+            {
+                icache[page][(a % memory::page_size) >> 1].handler = nullptr;
+                code_modified = true;
+            }
+        }
+        return;
+    }
+    for(uint64_t a = addr & ~3u; a < static_cast<uint64_t>(addr) + len; a += 4) //Each word touched by the write.
+    {
+        uint32_t page = a >> memory::page_bits;
+        if(page < icache.size() && icache[page] && icache[page][(a % memory::page_size) / 4].handler)
+        {
+            icache[page][(a % memory::page_size) / 4].handler = nullptr;
+            code_modified = true;
+        }
+    }
 }
 
 /**
@@ -168,100 +708,182 @@ void rv32i_hart::reset()
  * @param pos Output to send anything to print.
  */
 void rv32i_hart::exec(uint32_t insn, std::ostream* pos)
+{
+    decoded_insn d;
+    predecode(insn, d);
+    (this->*(pos ? d.trace_handler : d.handler))(d, pos);
+}
+
+/**
+ * @brief Execute and render an RV32C instruction.
+ *
+ * The handler renders the 32-bit expansion, which is then shown in RV32C assembly syntax.
+ *
+ * @param d Predecoded instruction to execute.
+ * @param pos Output to send the rendering to.
+ */
+void rv32i_hart::trace_compressed(const decoded_insn &d, std::ostream* pos)
+{
+    std::ostringstream os;
+    (this->*d.trace_handler)(d, &os);
+    std::string line = os.str();
+
+    const char *mnemonic = nullptr;
+    size_t comment = line.find("//");
+    if(expand_compressed(d.cinsn, &mnemonic) == 0 || comment == std::string::npos) //Illegal, nothing to rename.
+    {
+        *pos << line;
+        return;
+    }
+    std::string s = render_compressed(line.substr(0, line.find_last_not_of(' ', comment - 1) + 1), mnemonic);
+    *pos << std::setw(instruction_width) << std::setfill(' ') << std::left << s << line.substr(comment);
+}
+
+/**
+ * @brief Set the handlers of a cache record.
+ *
+ * @param d Record to update.
+ * @param handler Handler that executes without output.
+ * @param trace_handler Handler that also renders the instruction.
+ * @param mnemonic Mnemonic passed to rendering functions, if the handler needs one.
+ */
+void rv32i_hart::set_exec(decoded_insn &d, exec_handler handler, exec_handler trace_handler, const char *mnemonic)
+{
+    d.handler = handler;
+    d.trace_handler = trace_handler;
+    d.mnemonic = mnemonic;
+}
+
+/**
+ * @brief Decode an instruction into a cache record.
+ *
+ * Extract the operand fields once and select the handler and mnemonic that will execute the instruction.
+ * 
+ * @param insn Instruction to decode.
+ * @param d Record to fill in.
+ */
+void rv32i_hart::predecode(uint32_t insn, decoded_insn &d)
 {
     uint32_t funct3 = get_funct3(insn);
-    switch(get_opcode(insn)) //Render based on determined opcode.
+    d.insn = insn;
+    d.cinsn = 0;
+    d.len = 4;
+    d.rd = get_rd(insn);
+    d.rs1 = get_rs1(insn);
+    d.rs2 = get_rs2(insn);
+    d.funct3 = funct3;
+    d.funct7 = get_funct7(insn);
+    d.imm = get_imm_i(insn); //Most formats use imm_i, the rest are set below.
+
+    switch(get_opcode(insn)) //Decode based on determined opcode.
     {
-        default:                exec_illegal_insn(insn,pos); return;
-        case opcode_lui:        exec_lui(insn, pos); return;             //Load Upper Immediate
-        case opcode_auipc:      exec_auipc(insn, pos); return;           //Add Upper Immediate to PC
-        case opcode_jal:        exec_jal(insn, pos); return;             //Jump And Link
-        case opcode_jalr:       exec_jalr(insn, pos); return;            //Jump And Link Register
+        default:                set_exec(d, &rv32i_hart::exec_illegal_insn<false>, &rv32i_hart::exec_illegal_insn<true>); return;
+        case opcode_lui:        d.imm = get_imm_u(insn); set_exec(d, &rv32i_hart::exec_lui<false>, &rv32i_hart::exec_lui<true>); return;             //Load Upper Immediate
+        case opcode_auipc:      d.imm = get_imm_u(insn); set_exec(d, &rv32i_hart::exec_auipc<false>, &rv32i_hart::exec_auipc<true>); return;           //Add Upper Immediate to PC
+        case opcode_jal:        d.imm = get_imm_j(insn); set_exec(d, &rv32i_hart::exec_jal<false>, &rv32i_hart::exec_jal<true>); return;             //Jump And Link
+        case opcode_jalr:       set_exec(d, &rv32i_hart::exec_jalr<false>, &rv32i_hart::exec_jalr<true>); return;            //Jump And Link Register
         
-        case opcode_btype:      
+        case opcode_btype:
+        d.imm = get_imm_b(insn);
         switch(funct3) //Discriminate further by funct3.
         {
-            default:            exec_illegal_insn(insn, pos); return;
-            case funct3_beq:    exec_btype(insn, pos, funct3, "beq"); return;   //Branch Equal
-            case funct3_bne:    exec_btype(insn, pos, funct3, "bne"); return;   //Branch Not Equal
-            case funct3_blt:    exec_btype(insn, pos, funct3, "blt"); return;   //Branch Less Than
-            case funct3_bge:    exec_btype(insn, pos, funct3, "bge"); return;   //Branch Greater or Equal
-            case funct3_bltu:   exec_btype(insn, pos, funct3, "bltu"); return;  //Branch Less Than Unsigned    
-            case funct3_bgeu:   exec_btype(insn, pos, funct3, "bgeu"); return;  //Branch Greater or Equal Unsigned
+            default:            set_exec(d, &rv32i_hart::exec_illegal_insn<false>, &rv32i_hart::exec_illegal_insn<true>); return;
+            case funct3_beq:    set_exec(d, &rv32i_hart::exec_btype<false>, &rv32i_hart::exec_btype<true>, "beq"); return;   //Branch Equal
+            case funct3_bne:    set_exec(d, &rv32i_hart::exec_btype<false>, &rv32i_hart::exec_btype<true>, "bne"); return;   //Branch Not Equal
+            case funct3_blt:    set_exec(d, &rv32i_hart::exec_btype<false>, &rv32i_hart::exec_btype<true>, "blt"); return;   //Branch Less Than
+            case funct3_bge:    set_exec(d, &rv32i_hart::exec_btype<false>, &rv32i_hart::exec_btype<true>, "bge"); return;   //Branch Greater or Equal
+            case funct3_bltu:   set_exec(d, &rv32i_hart::exec_btype<false>, &rv32i_hart::exec_btype<true>, "bltu"); return;  //Branch Less Than Unsigned    
+            case funct3_bgeu:   set_exec(d, &rv32i_hart::exec_btype<false>, &rv32i_hart::exec_btype<true>, "bgeu"); return;  //Branch Greater or Equal Unsigned
         }
         assert(0 && "unrecognized funct3 code"); //It should be impossible to ever get here!
         
         case opcode_load_imm:   
         switch(funct3) //Discriminate further by funct3.
         {
-            default:                exec_illegal_insn(insn, pos); return;
-            case funct3_lb:         exec_itype_load(insn, pos, funct3, "lb"); return;   //Load Byte
-            case funct3_lh:         exec_itype_load(insn, pos, funct3, "lh"); return;   //Load Halfword
-            case funct3_lw:         exec_itype_load(insn, pos, funct3, "lw"); return;   //Load Word
-            case funct3_lbu:        exec_itype_load(insn, pos, funct3, "lbu"); return;  //Load Byte Unsigned
-            case funct3_lhu:        exec_itype_load(insn, pos, funct3, "lhu"); return;  //Load Halfword Unsigned
+            default:                set_exec(d, &rv32i_hart::exec_illegal_insn<false>, &rv32i_hart::exec_illegal_insn<true>); return;
+            case funct3_lb:         set_exec(d, &rv32i_hart::exec_itype_load<false>, &rv32i_hart::exec_itype_load<true>, "lb"); return;   //Load Byte
+            case funct3_lh:         set_exec(d, &rv32i_hart::exec_itype_load<false>, &rv32i_hart::exec_itype_load<true>, "lh"); return;   //Load Halfword
+            case funct3_lw:         set_exec(d, &rv32i_hart::exec_itype_load<false>, &rv32i_hart::exec_itype_load<true>, "lw"); return;   //Load Word
+            case funct3_lbu:        set_exec(d, &rv32i_hart::exec_itype_load<false>, &rv32i_hart::exec_itype_load<true>, "lbu"); return;  //Load Byte Unsigned
+            case funct3_lhu:        set_exec(d, &rv32i_hart::exec_itype_load<false>, &rv32i_hart::exec_itype_load<true>, "lhu"); return;  //Load Halfword Unsigned
         }
         assert(0 && "unrecognized funct3 code"); //It should be impossible to ever get here!
         
-        case opcode_stype:       
+        case opcode_stype:
+        d.imm = get_imm_s(insn);
         switch(funct3) //Discriminate further by funct3.
         {
-            default:                exec_illegal_insn(insn, pos); return;
-            case funct3_sb:         exec_stype(insn, pos, funct3, "sb"); return;  //Set Byte
-            case funct3_sh:         exec_stype(insn, pos, funct3, "sh"); return;  //Set Halfword
-            case funct3_sw:         exec_stype(insn, pos, funct3, "sw"); return;  //Set Word
+            default:                set_exec(d, &rv32i_hart::exec_illegal_insn<false>, &rv32i_hart::exec_illegal_insn<true>); return;
+            case funct3_sb:         set_exec(d, &rv32i_hart::exec_stype<false>, &rv32i_hart::exec_stype<true>, "sb"); return;  //Set Byte
+            case funct3_sh:         set_exec(d, &rv32i_hart::exec_stype<false>, &rv32i_hart::exec_stype<true>, "sh"); return;  //Set Halfword
+            case funct3_sw:         set_exec(d, &rv32i_hart::exec_stype<false>, &rv32i_hart::exec_stype<true>, "sw"); return;  //Set Word
         }
         assert(0 && "unrecognized funct3 code"); //It should be impossible to ever get here!
 
         case opcode_alu_imm:       
         switch(funct3) //Discriminate further by funct3.
         {
-            default:                exec_illegal_insn(insn, pos); return;
-            case funct3_add:        exec_itype_alu(insn, pos, funct3, "addi"); return;   //Add Immediate
-            case funct3_slt:        exec_itype_alu(insn, pos, funct3, "slti"); return;   //Set Less Than Immediate
-            case funct3_sltu:       exec_itype_alu(insn, pos, funct3, "sltiu"); return;  //Set Less Than Immediate Unsigned
-            case funct3_xor:        exec_itype_alu(insn, pos, funct3, "xori"); return;   //Exclusive Or Immediate
-            case funct3_or:         exec_itype_alu(insn, pos, funct3, "ori"); return;    //Or Immediate
-            case funct3_and:        exec_itype_alu(insn, pos, funct3, "andi"); return;   //And Immediate
-
-            case funct3_sll:        exec_itype_alu(insn, pos, funct3, "slli"); return;   //Shift Left Logical Immediate
+            default:                set_exec(d, &rv32i_hart::exec_illegal_insn<false>, &rv32i_hart::exec_illegal_insn<true>); return;
+            case funct3_add:        set_exec(d, &rv32i_hart::exec_itype_alu<false>, &rv32i_hart::exec_itype_alu<true>, "addi"); return;   //Add Immediate
+            case funct3_slt:        set_exec(d, &rv32i_hart::exec_itype_alu<false>, &rv32i_hart::exec_itype_alu<true>, "slti"); return;   //Set Less Than Immediate
+            case funct3_sltu:       set_exec(d, &rv32i_hart::exec_itype_alu<false>, &rv32i_hart::exec_itype_alu<true>, "sltiu"); return;  //Set Less Than Immediate Unsigned
+            case funct3_xor:        set_exec(d, &rv32i_hart::exec_itype_alu<false>, &rv32i_hart::exec_itype_alu<true>, "xori"); return;   //Exclusive Or Immediate
+            case funct3_or:         set_exec(d, &rv32i_hart::exec_itype_alu<false>, &rv32i_hart::exec_itype_alu<true>, "ori"); return;    //Or Immediate
+            case funct3_and:        set_exec(d, &rv32i_hart::exec_itype_alu<false>, &rv32i_hart::exec_itype_alu<true>, "andi"); return;   //And Immediate
+
+            case funct3_sll:        set_exec(d, &rv32i_hart::exec_itype_alu<false>, &rv32i_hart::exec_itype_alu<true>, "slli"); return;   //Shift Left Logical Immediate
             case funct3_srx:
             switch(get_funct7(insn)) //Discriminate further by funct7.
             {
-                default:            exec_illegal_insn(insn, pos); return;
-                case funct7_sra:    exec_itype_alu(insn, pos, funct3, "srai"); return;  //Shift Right Arithmetic Immediate
-                case funct7_srl:    exec_itype_alu(insn, pos, funct3, "srli"); return;  //Shift Right Logical Immediate
+                default:            set_exec(d, &rv32i_hart::exec_illegal_insn<false>, &rv32i_hart::exec_illegal_insn<true>); return;
+                case funct7_sra:    set_exec(d, &rv32i_hart::exec_itype_alu<false>, &rv32i_hart::exec_itype_alu<true>, "srai"); return;  //Shift Right Arithmetic Immediate
+                case funct7_srl:    set_exec(d, &rv32i_hart::exec_itype_alu<false>, &rv32i_hart::exec_itype_alu<true>, "srli"); return;  //Shift Right Logical Immediate
             }
             assert(0 && "unrecognized funct7 code"); //It should be impossible to ever get here!
         }
         assert(0 && "unrecognized funct3 code"); //It should be impossible to ever get here!
         
         case opcode_rtype:
+        if(d.funct7 == funct7_muldiv) //RV32M
+        {
+            switch(funct3) //Discriminate further by funct3.
+            {
+                case funct3_mul:    set_exec(d, &rv32i_hart::exec_mtype<false>, &rv32i_hart::exec_mtype<true>, "mul"); return;     //Multiply
+                case funct3_mulh:   set_exec(d, &rv32i_hart::exec_mtype<false>, &rv32i_hart::exec_mtype<true>, "mulh"); return;    //Multiply High
+                case funct3_mulhsu: set_exec(d, &rv32i_hart::exec_mtype<false>, &rv32i_hart::exec_mtype<true>, "mulhsu"); return;  //Multiply High Signed Unsigned
+                case funct3_mulhu:  set_exec(d, &rv32i_hart::exec_mtype<false>, &rv32i_hart::exec_mtype<true>, "mulhu"); return;   //Multiply High Unsigned
+                case funct3_div:    set_exec(d, &rv32i_hart::exec_mtype<false>, &rv32i_hart::exec_mtype<true>, "div"); return;     //Divide
+                case funct3_divu:   set_exec(d, &rv32i_hart::exec_mtype<false>, &rv32i_hart::exec_mtype<true>, "divu"); return;    //Divide Unsigned
+                case funct3_rem:    set_exec(d, &rv32i_hart::exec_mtype<false>, &rv32i_hart::exec_mtype<true>, "rem"); return;     //Remainder
+                case funct3_remu:   set_exec(d, &rv32i_hart::exec_mtype<false>, &rv32i_hart::exec_mtype<true>, "remu"); return;    //Remainder Unsigned
+            }
+            assert(0 && "unrecognized funct3 code"); //It should be impossible to ever get here!
+        }
         switch(funct3) //Discriminate further by funct3.
         {
-            default:                exec_illegal_insn(insn, pos); return;
-            case funct3_sll:        exec_rtype(insn, pos, funct3, "sll"); return;    //Shift Left Logical
-            case funct3_slt:        exec_rtype(insn, pos, funct3, "slt"); return;    //Set Less Than
-            case funct3_sltu:       exec_rtype(insn, pos, funct3, "sltu"); return;   //Set Less Than Unsigned
-            case funct3_xor:        exec_rtype(insn, pos, funct3, "xor"); return;    //Exclusive Or
-            case funct3_or:         exec_rtype(insn, pos, funct3, "or"); return;     //Or
-            case funct3_and:        exec_rtype(insn, pos, funct3, "and"); return;    //And
+            default:                set_exec(d, &rv32i_hart::exec_illegal_insn<false>, &rv32i_hart::exec_illegal_insn<true>); return;
+            case funct3_sll:        set_exec(d, &rv32i_hart::exec_rtype<false>, &rv32i_hart::exec_rtype<true>, "sll"); return;    //Shift Left Logical
+            case funct3_slt:        set_exec(d, &rv32i_hart::exec_rtype<false>, &rv32i_hart::exec_rtype<true>, "slt"); return;    //Set Less Than
+            case funct3_sltu:       set_exec(d, &rv32i_hart::exec_rtype<false>, &rv32i_hart::exec_rtype<true>, "sltu"); return;   //Set Less Than Unsigned
+            case funct3_xor:        set_exec(d, &rv32i_hart::exec_rtype<false>, &rv32i_hart::exec_rtype<true>, "xor"); return;    //Exclusive Or
+            case funct3_or:         set_exec(d, &rv32i_hart::exec_rtype<false>, &rv32i_hart::exec_rtype<true>, "or"); return;     //Or
+            case funct3_and:        set_exec(d, &rv32i_hart::exec_rtype<false>, &rv32i_hart::exec_rtype<true>, "and"); return;    //And
 
             case funct3_add:
             switch(get_funct7(insn))
             {
-                default:            exec_illegal_insn(insn, pos); return;
-                case funct7_add:    exec_rtype(insn, pos, funct3, "add"); return;    //Add
-                case funct7_sub:    exec_rtype(insn, pos, funct3, "sub"); return;    //Subtract
+                default:            set_exec(d, &rv32i_hart::exec_illegal_insn<false>, &rv32i_hart::exec_illegal_insn<true>); return;
+                case funct7_add:    set_exec(d, &rv32i_hart::exec_rtype<false>, &rv32i_hart::exec_rtype<true>, "add"); return;    //Add
+                case funct7_sub:    set_exec(d, &rv32i_hart::exec_rtype<false>, &rv32i_hart::exec_rtype<true>, "sub"); return;    //Subtract
             }
             assert(0 && "unrecognized funct7 code"); //It should be impossible to ever get here!
             
             case funct3_srx:
             switch(get_funct7(insn)) //Discriminate further by funct7.
             {
-                default:            exec_illegal_insn(insn, pos); return;
-                case funct7_sra:    exec_rtype(insn, pos, funct3, "sra"); return;    //Shift Right Arithmetic
-                case funct7_srl:    exec_rtype(insn, pos, funct3, "srl"); return;    //Shift Right Logical
+                default:            set_exec(d, &rv32i_hart::exec_illegal_insn<false>, &rv32i_hart::exec_illegal_insn<true>); return;
+                case funct7_sra:    set_exec(d, &rv32i_hart::exec_rtype<false>, &rv32i_hart::exec_rtype<true>, "sra"); return;    //Shift Right Arithmetic
+                case funct7_srl:    set_exec(d, &rv32i_hart::exec_rtype<false>, &rv32i_hart::exec_rtype<true>, "srl"); return;    //Shift Right Logical
             }
             assert(0 && "unrecognized funct7 code"); //It should be impossible to ever get here!
         }
@@ -270,25 +892,52 @@ void rv32i_hart::exec(uint32_t insn, std::ostream* pos)
         case opcode_system:
         switch(funct3) //Discriminate further by funct3.
         {
-            default:                exec_illegal_insn(insn, pos); return;
+            default:                set_exec(d, &rv32i_hart::exec_illegal_insn<false>, &rv32i_hart::exec_illegal_insn<true>); return;
             case eCode:
             switch(insn) //Check if instruction matches system ecodes.            
             {
-                default:            exec_illegal_insn(insn, pos); return;
-                case insn_ecall:    exec_ecall(insn, pos); return;   //Trap to Debugger
-                case insn_ebreak:   exec_ebreak(insn, pos); return;  //Trap to Operating System
+                default:            set_exec(d, &rv32i_hart::exec_illegal_insn<false>, &rv32i_hart::exec_illegal_insn<true>); return;
+                case insn_ecall:    set_exec(d, &rv32i_hart::exec_ecall<false>, &rv32i_hart::exec_ecall<true>); return;   //Trap to Debugger
+                case insn_ebreak:   set_exec(d, &rv32i_hart::exec_ebreak<false>, &rv32i_hart::exec_ebreak<true>); return;  //Trap to Operating System
             }
             assert(0 && "unrecognized code"); //It should be impossible to ever get here!
 
-            case funct3_csrrw:      exec_csrrx(insn, pos, funct3, "csrrw"); return;    //Atomic Read/Write
-            case funct3_csrrs:      exec_csrrx(insn, pos, funct3, "csrrs"); return;    //Atomic Read and Set
-            case funct3_csrrc:      exec_csrrx(insn, pos, funct3, "csrrc"); return;    //Atomic Read and Clear
+            case funct3_csrrw:      set_exec(d, &rv32i_hart::exec_csrrx<false>, &rv32i_hart::exec_csrrx<true>, "csrrw"); return;    //Atomic Read/Write
+            case funct3_csrrs:      set_exec(d, &rv32i_hart::exec_csrrx<false>, &rv32i_hart::exec_csrrx<true>, "csrrs"); return;    //Atomic Read and Set
+            case funct3_csrrc:      set_exec(d, &rv32i_hart::exec_csrrx<false>, &rv32i_hart::exec_csrrx<true>, "csrrc"); return;    //Atomic Read and Clear
 
-            case funct3_csrrwi:     exec_csrrxi(insn, pos, funct3, "csrrwi"); return;  //Atomic Read/Write Immediate
-            case funct3_csrrsi:     exec_csrrxi(insn, pos, funct3, "csrrsi"); return;  //Atomic Read and Set
-            case funct3_csrrci:     exec_csrrxi(insn, pos, funct3, "csrrci"); return;  //Atomic Read and Clear Immediate
+            case funct3_csrrwi:     set_exec(d, &rv32i_hart::exec_csrrxi<false>, &rv32i_hart::exec_csrrxi<true>, "csrrwi"); return;  //Atomic Read/Write Immediate
+            case funct3_csrrsi:     set_exec(d, &rv32i_hart::exec_csrrxi<false>, &rv32i_hart::exec_csrrxi<true>, "csrrsi"); return;  //Atomic Read and Set
+            case funct3_csrrci:     set_exec(d, &rv32i_hart::exec_csrrxi<false>, &rv32i_hart::exec_csrrxi<true>, "csrrci"); return;  //Atomic Read and Clear Immediate
         }
         assert(0 && "unrecognized funct3 code"); //It should be impossible to ever get here!
+
+        case opcode_amo:
+        if(funct3 != funct3_amo_w) //Only word sized atomics exist in RV32A.
+        {
+            set_exec(d, &rv32i_hart::exec_illegal_insn<false>, &rv32i_hart::exec_illegal_insn<true>); return;
+        }
+        switch(get_funct5(insn)) //Discriminate further by funct5.
+        {
+            default:                set_exec(d, &rv32i_hart::exec_illegal_insn<false>, &rv32i_hart::exec_illegal_insn<true>); return;
+            case funct5_lr:
+            if(d.rs2 != 0)
+            {
+                set_exec(d, &rv32i_hart::exec_illegal_insn<false>, &rv32i_hart::exec_illegal_insn<true>); return;
+            }
+            set_exec(d, &rv32i_hart::exec_amo<false>, &rv32i_hart::exec_amo<true>, "lr.w"); return;       //Load Reserved
+            case funct5_sc:         set_exec(d, &rv32i_hart::exec_amo<false>, &rv32i_hart::exec_amo<true>, "sc.w"); return;       //Store Conditional
+            case funct5_amoswap:    set_exec(d, &rv32i_hart::exec_amo<false>, &rv32i_hart::exec_amo<true>, "amoswap.w"); return;  //Atomic Swap
+            case funct5_amoadd:     set_exec(d, &rv32i_hart::exec_amo<false>, &rv32i_hart::exec_amo<true>, "amoadd.w"); return;   //Atomic Add
+            case funct5_amoxor:     set_exec(d, &rv32i_hart::exec_amo<false>, &rv32i_hart::exec_amo<true>, "amoxor.w"); return;   //Atomic Exclusive Or
+            case funct5_amoand:     set_exec(d, &rv32i_hart::exec_amo<false>, &rv32i_hart::exec_amo<true>, "amoand.w"); return;   //Atomic And
+            case funct5_amoor:      set_exec(d, &rv32i_hart::exec_amo<false>, &rv32i_hart::exec_amo<true>, "amoor.w"); return;    //Atomic Or
+            case funct5_amomin:     set_exec(d, &rv32i_hart::exec_amo<false>, &rv32i_hart::exec_amo<true>, "amomin.w"); return;   //Atomic Minimum
+            case funct5_amomax:     set_exec(d, &rv32i_hart::exec_amo<false>, &rv32i_hart::exec_amo<true>, "amomax.w"); return;   //Atomic Maximum
+            case funct5_amominu:    set_exec(d, &rv32i_hart::exec_amo<false>, &rv32i_hart::exec_amo<true>, "amominu.w"); return;  //Atomic Minimum Unsigned
+            case funct5_amomaxu:    set_exec(d, &rv32i_hart::exec_amo<false>, &rv32i_hart::exec_amo<true>, "amomaxu.w"); return;  //Atomic Maximum Unsigned
+        }
+        assert(0 && "unrecognized funct5 code"); //It should be impossible to ever get here!
     }
     assert(0 && "unrecognized opcode"); //It should be impossible to ever get here!
 }
@@ -298,14 +947,16 @@ void rv32i_hart::exec(uint32_t insn, std::ostream* pos)
  * 
  * Output a message indicating the instruction could not execute and halt the hardware thread.
  * 
- * @param insn Instruction that was unable to execute.
- * @param pos Pointer to the output stream (if it exists) to send output.
+ * @param d Predecoded instruction that was unable to execute.
+ * @tparam trace Whether to render the instruction to pos.
+ * @param pos Pointer to the output stream to send output, only used when tracing.
  */
-void rv32i_hart::exec_illegal_insn(uint32_t insn, std::ostream* pos)
+template<bool trace>
+void rv32i_hart::exec_illegal_insn(const decoded_insn &d, std::ostream* pos)
 {
-    if(pos) //If output stream exists.
+    if(trace) //If tracing, pos is the output stream.
     {
-        *pos << render_illegal_insn(insn);
+        *pos << render_illegal_insn(d.insn);
     }
     halt = true;
     halt_reason = "Illegal instruction";
@@ -316,23 +967,25 @@ void rv32i_hart::exec_illegal_insn(uint32_t insn, std::ostream* pos)
  *
  * Execute the lui instruction, setting the register to the imm_u.
  * 
- * @param insn Instruction to decode and execute.
- * @param pos Pointer to the output stream (if it exists) to send output.
+ * @param d Predecoded instruction to execute.
+ * @tparam trace Whether to render the instruction to pos.
+ * @param pos Pointer to the output stream to send output, only used when tracing.
  */
-void rv32i_hart::exec_lui(uint32_t insn, std::ostream* pos)
+template<bool trace>
+void rv32i_hart::exec_lui(const decoded_insn &d, std::ostream* pos)
 {
-    uint32_t rd = get_rd(insn);
-    int32_t val = (get_imm_u(insn)); //Set register rd to the imm_u value.
+    uint32_t rd = d.rd;
+    int32_t val = d.imm; //Set register rd to the imm_u value.
 
-    if(pos) //If output stream exists.
+    if(trace) //If tracing, pos is the output stream.
     {
-        std::string s = render_lui(insn);
+        std::string s = render_lui(d.insn);
         *pos << std::setw(instruction_width) << std::setfill(' ') << std::left << s;
         *pos << "// " << render_reg(rd) << " = " << hex::to_hex0x32(val) << std::endl;
     }
 
     regs.set(rd , val);
-    pc += 4;
+    pc += d.len;
 }
 
 /**
@@ -340,24 +993,26 @@ void rv32i_hart::exec_lui(uint32_t insn, std::ostream* pos)
  *
  * Execute the auipc instruction, adding the instruction address to the imm_u.
  * 
- * @param insn Instruction to decode and execute.
- * @param pos Pointer to the output stream (if it exists) to send output.
+ * @param d Predecoded instruction to execute.
+ * @tparam trace Whether to render the instruction to pos.
+ * @param pos Pointer to the output stream to send output, only used when tracing.
  */
-void rv32i_hart::exec_auipc(uint32_t insn, std::ostream* pos)
+template<bool trace>
+void rv32i_hart::exec_auipc(const decoded_insn &d, std::ostream* pos)
 {
-    uint32_t rd = get_rd(insn);
-    int32_t imm_u = get_imm_u(insn);
+    uint32_t rd = d.rd;
+    int32_t imm_u = d.imm;
     int32_t val = (imm_u + pc); //Add the address of the instruction to the imm_u value and store the result in register rd.
 
-    if(pos) //If output stream exists.
+    if(trace) //If tracing, pos is the output stream.
     {
-        std::string s = render_auipc(insn);
+        std::string s = render_auipc(d.insn);
         *pos << std::setw(instruction_width) << std::setfill(' ') << std::left << s;
         *pos << "// " << render_reg(rd) << " = " << hex::to_hex0x32(pc) << " + " << hex::to_hex0x32(imm_u) << " = " << hex::to_hex0x32(val) << std::endl;
     }
 
     regs.set(rd , val);
-    pc += 4;
+    pc += d.len;
 }
 
 /**
@@ -366,24 +1021,30 @@ void rv32i_hart::exec_auipc(uint32_t insn, std::ostream* pos)
  * Execute the jal instruction, setting register to the address of the next instruction that would otherwise be executed 
  * and jumping to the address given by the sum of the pc register and the imm_j.
  *
- * @param insn Instruction to decode and execute.
- * @param pos Pointer to the output stream (if it exists) to send output.
+ * @param d Predecoded instruction to execute.
+ * @tparam trace Whether to render the instruction to pos.
+ * @param pos Pointer to the output stream to send output, only used when tracing.
  */
-void rv32i_hart::exec_jal(uint32_t insn, std::ostream* pos)
+template<bool trace>
+void rv32i_hart::exec_jal(const decoded_insn &d, std::ostream* pos)
 {
-    uint32_t rd = get_rd(insn);
-    int32_t imm_j = get_imm_j(insn);
+    uint32_t rd = d.rd;
+    int32_t imm_j = d.imm;
     int32_t val = (imm_j + pc); //Set register rd to address of next instruction then jump to address given by sum of the pc register and imm_j.
 
-    if(pos) //If output stream exists.
+    if(trace) //If tracing, pos is the output stream.
     {
-        std::string s = render_jal(pc,insn);
+        std::string s = render_jal(pc, d.insn);
         *pos << std::setw(instruction_width) << std::setfill(' ') << std::left << s;
-        *pos << "// " << render_reg(rd) << " = " << hex::to_hex0x32(pc + 4) << ",  pc = " << hex::to_hex0x32(pc) << " + " << hex::to_hex0x32(imm_j);
+        *pos << "// " << render_reg(rd) << " = " << hex::to_hex0x32(pc + d.len) << ",  pc = " << hex::to_hex0x32(pc) << " + " << hex::to_hex0x32(imm_j);
         *pos << " = " <<  hex::to_hex0x32(val) << std::endl;
     }
 
-    regs.set(rd , pc + 4);
+    if(bpu)
+    {
+        bpu->jal(rd, pc + d.len);
+    }
+    regs.set(rd , pc + d.len);
     pc = val;
 }
 
@@ -393,25 +1054,31 @@ void rv32i_hart::exec_jal(uint32_t insn, std::ostream* pos)
  * Execute the jalr instruction, setting register to the address of the next instruction that would otherwise be executed 
  * and jumping to the address given by the sum of the rs1 register and the imm_i.
  *
- * @param insn Instruction to decode and execute.
- * @param pos Pointer to the output stream (if it exists) to send output.
+ * @param d Predecoded instruction to execute.
+ * @tparam trace Whether to render the instruction to pos.
+ * @param pos Pointer to the output stream to send output, only used when tracing.
  */
-void rv32i_hart::exec_jalr(uint32_t insn, std::ostream* pos)
+template<bool trace>
+void rv32i_hart::exec_jalr(const decoded_insn &d, std::ostream* pos)
 {
-    uint32_t rd = get_rd(insn);
-    uint32_t rs1Con = regs.get(get_rs1(insn)); //Contents of rs1.
-    int32_t imm_i = get_imm_i(insn);
+    uint32_t rd = d.rd;
+    uint32_t rs1Con = regs.get(d.rs1); //Contents of rs1.
+    int32_t imm_i = d.imm;
     int32_t val = ((imm_i + rs1Con) & 0xfffffffe); //Set register rd to address of next instruction, jump to address of rs1 register + imm_i value.
 
-    if(pos) //If output stream exists.
+    if(trace) //If tracing, pos is the output stream.
     {
-        std::string s = render_jalr(insn);
+        std::string s = render_jalr(d.insn);
         *pos << std::setw(instruction_width) << std::setfill(' ') << std::left << s;
-        *pos << "// " << render_reg(rd) << " = " << hex::to_hex0x32(pc + 4) << ",  pc = (" << hex::to_hex0x32(imm_i) << " + " << hex::to_hex0x32(rs1Con);
+        *pos << "// " << render_reg(rd) << " = " << hex::to_hex0x32(pc + d.len) << ",  pc = (" << hex::to_hex0x32(imm_i) << " + " << hex::to_hex0x32(rs1Con);
         *pos << ") & 0xfffffffe = " <<  hex::to_hex0x32(val) << std::endl;
     }
 
-    regs.set(rd , pc + 4);
+    if(bpu)
+    {
+        bpu->jalr(rd, d.rs1, val, pc + d.len);
+    }
+    regs.set(rd , pc + d.len);
     pc = val;
 }
 
@@ -420,45 +1087,48 @@ void rv32i_hart::exec_jalr(uint32_t insn, std::ostream* pos)
  *
  * Execute between several B Type instructions based on funct3 code.
  * 
- * @param insn Instruction to decode and execute.
- * @param pos Pointer to the output stream (if it exists) to send output.
- * @param funct3 Value to discriminate b-type instructions.
- * @param mnemonic String to pass to rendering function.
+ * @param d Predecoded instruction to execute.
+ * @tparam trace Whether to render the instruction to pos.
+ * @param pos Pointer to the output stream to send output, only used when tracing.
  */
-void rv32i_hart::exec_btype(uint32_t insn, std::ostream* pos, uint32_t funct3, const char *mnemonic)
+template<bool trace>
+void rv32i_hart::exec_btype(const decoded_insn &d, std::ostream* pos)
 {
-    uint32_t rs1Con = regs.get(get_rs1(insn)); //Contents of rs1.
-    uint32_t rs2Con = regs.get(get_rs2(insn)); //Contents of rs2.
-    int32_t imm_b = get_imm_b(insn);
+    uint32_t rs1Con = regs.get(d.rs1); //Contents of rs1.
+    uint32_t rs2Con = regs.get(d.rs2); //Contents of rs2.
+    int32_t imm_b = d.imm;
     int32_t val; //Value to adjust pc register.
+    bool taken; //Whether the branch goes to pc + imm_b, which may be the next instruction anyway.
 
-    if(pos) //If output stream exists.
+    if(trace) //If tracing, pos is the output stream.
     {
-        std::string s = render_btype(pc, insn, mnemonic);
+        std::string s = render_btype(pc, d.insn, d.mnemonic);
         *pos << std::setw(instruction_width) << std::setfill(' ') << std::left << s;
     }
     
-    switch(funct3)
+    switch(d.funct3)
     {
-        default:            exec_illegal_insn(insn, pos); return;
+        default:            exec_illegal_insn<trace>(d, pos); return;
         case funct3_beq:  //Branch Equal
         {
-            val = ((rs1Con == rs2Con) ? imm_b : 4); //If rs1 is equal to rs2 then add imm_b to pc register, otherwise 4.
-            if(pos) 
+            taken = (rs1Con == rs2Con);
+            val = (taken ? imm_b : d.len); //If rs1 is equal to rs2 then add imm_b to pc register, otherwise 4.
+            if(trace) 
             {
                 *pos << "// pc += (" << hex::to_hex0x32(rs1Con) << " == " << hex::to_hex0x32(rs2Con) << " ? ";
-                *pos << hex::to_hex0x32(imm_b) << " : 4) = " << hex::to_hex0x32(pc + val) << std::endl;
+                *pos << hex::to_hex0x32(imm_b) << " : " << static_cast<uint32_t>(d.len) << ") = " << hex::to_hex0x32(pc + val) << std::endl;
             }
         }
         break;
 
         case funct3_bne:  //Branch Not Equal
         {
-            val = ((rs1Con != rs2Con) ? imm_b : 4); //If rs1 is not equal to rs2 then add imm_b to pc register, otherwise 4.
-            if(pos) 
+            taken = (rs1Con != rs2Con);
+            val = (taken ? imm_b : d.len); //If rs1 is not equal to rs2 then add imm_b to pc register, otherwise 4.
+            if(trace) 
             {
                 *pos << "// pc += (" << hex::to_hex0x32(rs1Con) << " != " << hex::to_hex0x32(rs2Con) << " ? ";
-                *pos << hex::to_hex0x32(imm_b) << " : 4) = " << hex::to_hex0x32(pc + val)<< std::endl;
+                *pos << hex::to_hex0x32(imm_b) << " : " << static_cast<uint32_t>(d.len) << ") = " << hex::to_hex0x32(pc + val)<< std::endl;
             }
         }
         break;
@@ -466,49 +1136,57 @@ void rv32i_hart::exec_btype(uint32_t insn, std::ostream* pos, uint32_t funct3, c
         case funct3_blt:  //Branch Less Than
         {
 
-            val = ((static_cast<int32_t>(rs1Con) < static_cast<int32_t>(rs2Con)) ? imm_b : 4); //If signed val in rs1 is less than signed val in rs2 
-            if(pos)                                                                            //then add imm_b to pc register, otherwise 4.
+            taken = (static_cast<int32_t>(rs1Con) < static_cast<int32_t>(rs2Con));
+            val = (taken ? imm_b : d.len); //If signed val in rs1 is less than signed val in rs2 
+            if(trace)                                                                            //then add imm_b to pc register, otherwise 4.
             {
                 *pos << "// pc += (" << hex::to_hex0x32(rs1Con) << " < " << hex::to_hex0x32(rs2Con) << " ? ";
-                *pos << hex::to_hex0x32(imm_b) << " : 4) = " << hex::to_hex0x32(pc + val) << std::endl;
+                *pos << hex::to_hex0x32(imm_b) << " : " << static_cast<uint32_t>(d.len) << ") = " << hex::to_hex0x32(pc + val) << std::endl;
             }
         }
         break;
 
         case funct3_bge:  //Branch Greater or Equal
         {
-            val = ((static_cast<int32_t>(rs1Con) >= static_cast<int32_t>(rs2Con)) ? imm_b : 4); //If signed val in rs1 is greater than or equal to 
-            if(pos)                                                                             //signed val in rs2 then add imm_b to pc register, otherwise 4.
+            taken = (static_cast<int32_t>(rs1Con) >= static_cast<int32_t>(rs2Con));
+            val = (taken ? imm_b : d.len); //If signed val in rs1 is greater than or equal to 
+            if(trace)                                                                             //signed val in rs2 then add imm_b to pc register, otherwise 4.
             {
                 *pos << "// pc += (" << hex::to_hex0x32(rs1Con) << " >= " << hex::to_hex0x32(rs2Con) << " ? ";
-                *pos << hex::to_hex0x32(imm_b) << " : 4) = " << hex::to_hex0x32(pc + val) << std::endl;
+                *pos << hex::to_hex0x32(imm_b) << " : " << static_cast<uint32_t>(d.len) << ") = " << hex::to_hex0x32(pc + val) << std::endl;
             }
         }
         break;
 
         case funct3_bltu:  //Branch Less Than Unsigned
         {
-             val = ((rs1Con < rs2Con) ? imm_b : 4); //If unsigned val in rs1 is less than unsigned val in rs2 then add imm_b to pc register, otherwise 4.
-            if(pos)
+            taken = (rs1Con < rs2Con);
+            val = (taken ? imm_b : d.len); //If unsigned val in rs1 is less than unsigned val in rs2 then add imm_b to pc register, otherwise 4.
+            if(trace)
             {
                 *pos << "// pc += (" << hex::to_hex0x32(rs1Con) << " <U " << hex::to_hex0x32(rs2Con) << " ? ";
-                *pos << hex::to_hex0x32(imm_b) << " : 4) = " << hex::to_hex0x32(pc + val) << std::endl;
+                *pos << hex::to_hex0x32(imm_b) << " : " << static_cast<uint32_t>(d.len) << ") = " << hex::to_hex0x32(pc + val) << std::endl;
             }
         }
         break;
 
         case funct3_bgeu:  //Branch Greater or Equal Unsigned
         {
-            val = ((rs1Con >= rs2Con) ? imm_b : 4); //If unsigned val in rs1 is greater than or equal to 
-            if(pos)                                 //unsigned val in rs2 then add imm_b to pc register, otherwise 4.
+            taken = (rs1Con >= rs2Con);
+            val = (taken ? imm_b : d.len); //If unsigned val in rs1 is greater than or equal to 
+            if(trace)                                 //unsigned val in rs2 then add imm_b to pc register, otherwise 4.
             {
                 *pos << "// pc += (" << hex::to_hex0x32(rs1Con) << " >=U " << hex::to_hex0x32(rs2Con) << " ? ";
-                *pos << hex::to_hex0x32(imm_b) << " : 4) = " << hex::to_hex0x32(pc + val) << std::endl;
+                *pos << hex::to_hex0x32(imm_b) << " : " << static_cast<uint32_t>(d.len) << ") = " << hex::to_hex0x32(pc + val) << std::endl;
             }
         }
         break;
     }
 
+    if(bpu)
+    {
+        bpu->branch(pc, pc + imm_b, taken);
+    }
     pc += val;
 }
 
@@ -517,31 +1195,31 @@ void rv32i_hart::exec_btype(uint32_t insn, std::ostream* pos, uint32_t funct3, c
  *
  * Execute between several I Type-LOAD instructions based on funct3 code.
  * 
- * @param insn Instruction to decode and execute.
- * @param pos Pointer to the output stream (if it exists) to send output.
- * @param funct3 Value to discriminate I Type-LOAD instructions.
- * @param mnemonic String to pass to rendering function.
+ * @param d Predecoded instruction to execute.
+ * @tparam trace Whether to render the instruction to pos.
+ * @param pos Pointer to the output stream to send output, only used when tracing.
  */
-void rv32i_hart::exec_itype_load(uint32_t insn, std::ostream* pos, uint32_t funct3, const char *mnemonic)
+template<bool trace>
+void rv32i_hart::exec_itype_load(const decoded_insn &d, std::ostream* pos)
 {
-    uint32_t rd = get_rd(insn);
-    uint32_t rs1Con = regs.get(get_rs1(insn)); //Contents of rs1.
-    int32_t imm_i = get_imm_i(insn);
+    uint32_t rd = d.rd;
+    uint32_t rs1Con = regs.get(d.rs1); //Contents of rs1.
+    int32_t imm_i = d.imm;
     int32_t val; //Value to set register.
 
-    if(pos) //If output stream exists.
+    if(trace) //If tracing, pos is the output stream.
     {
-        std::string s = render_itype_load(insn, mnemonic);
+        std::string s = render_itype_load(d.insn, d.mnemonic);
         *pos << std::setw(instruction_width) << std::setfill(' ') << std::left << s;
     }
     
-    switch(funct3)
+    switch(d.funct3)
     {
-        default:            exec_illegal_insn(insn, pos); return;
+        default:            exec_illegal_insn<trace>(d, pos); return;
         case funct3_lb:   //Load Byte
         {
             val = mem.get8_sx(rs1Con + imm_i); //Set register rd to value of sign-extended byte fetched from memory address given by sum of rs1 and imm_i.
-            if(pos)
+            if(trace)
             {
                 *pos << "// " << render_reg(rd) << " = sx(m8(" << hex::to_hex0x32(rs1Con) << " + " << hex::to_hex0x32(imm_i) << ")) = ";
                 *pos << hex::to_hex0x32(val) << std::endl;
@@ -552,7 +1230,7 @@ void rv32i_hart::exec_itype_load(uint32_t insn, std::ostream* pos, uint32_t func
         case funct3_lh:   //Load Halfword
         {
             val = mem.get16_sx(rs1Con + imm_i); //Set register rd to value of sign-extended 16-bit little-endian half-word value
-            if(pos)                             //from memory address given by sum of rs1 and imm_i.
+            if(trace)                             //from memory address given by sum of rs1 and imm_i.
             {
                 *pos << "// " << render_reg(rd) << " = sx(m16(" << hex::to_hex0x32(rs1Con) << " + " << hex::to_hex0x32(imm_i) << ")) = ";
                 *pos << hex::to_hex0x32(val) << std::endl;
@@ -563,7 +1241,7 @@ void rv32i_hart::exec_itype_load(uint32_t insn, std::ostream* pos, uint32_t func
         case funct3_lw:   //Load Word
         {
             val = mem.get32_sx(rs1Con + imm_i); //Set register rd to value of sign-extended 32-bit little-endian word value
-            if(pos)                             //from memory address given by sum of rs1 and imm_i.
+            if(trace)                             //from memory address given by sum of rs1 and imm_i.
             {
                 *pos << "// " << render_reg(rd) << " = sx(m32(" << hex::to_hex0x32(rs1Con) << " + " << hex::to_hex0x32(imm_i) << ")) = ";
                 *pos << hex::to_hex0x32(val) << std::endl;
@@ -574,7 +1252,7 @@ void rv32i_hart::exec_itype_load(uint32_t insn, std::ostream* pos, uint32_t func
         case funct3_lbu:  //Load Byte Unsigned
         {
             val = mem.get8(rs1Con + imm_i); //Set register rd to value of zero-extended byte from memory address given by sum of rs1 and imm_i.
-            if(pos)
+            if(trace)
             {
                 *pos << "// " << render_reg(rd) << " = zx(m8(" << hex::to_hex0x32(rs1Con) << " + " << hex::to_hex0x32(imm_i) << ")) = ";
                 *pos << hex::to_hex0x32(val) << std::endl;
@@ -585,7 +1263,7 @@ void rv32i_hart::exec_itype_load(uint32_t insn, std::ostream* pos, uint32_t func
         case funct3_lhu:   //Load Halfword Unsigned
         {
              val = mem.get16(rs1Con + imm_i); //Set register rd to value of zero-extended 16-bit little-endian half-word value
-            if(pos)                           //from memory address given by sum of rs1 and imm_i.
+            if(trace)                           //from memory address given by sum of rs1 and imm_i.
             {
                 *pos << "// " << render_reg(rd) << " = zx(m16(" << hex::to_hex0x32(rs1Con) << " + " << hex::to_hex0x32(imm_i) << ")) = ";
                 *pos << hex::to_hex0x32(val) << std::endl;
@@ -594,8 +1272,12 @@ void rv32i_hart::exec_itype_load(uint32_t insn, std::ostream* pos, uint32_t func
         break;
     }
 
+    if(l1d || timing)
+    {
+        model_access(l1d.get(), rs1Con + imm_i, 1u << (d.funct3 & 3)); //funct3 holds log2 of the width.
+    }
     regs.set(rd , val);
-    pc += 4;
+    pc += d.len;
 }
 
 /**
@@ -603,31 +1285,31 @@ void rv32i_hart::exec_itype_load(uint32_t insn, std::ostream* pos, uint32_t func
  *
  * Execute between several S Type instructions based on funct3 code.
  * 
- * @param insn Instruction to decode and execute.
- * @param pos Pointer to the output stream (if it exists) to send output.
- * @param funct3 Value to discriminate S Type instructions.
- * @param mnemonic String to pass to rendering function.
+ * @param d Predecoded instruction to execute.
+ * @tparam trace Whether to render the instruction to pos.
+ * @param pos Pointer to the output stream to send output, only used when tracing.
  */
-void rv32i_hart::exec_stype(uint32_t insn, std::ostream* pos, uint32_t funct3, const char *mnemonic)
+template<bool trace>
+void rv32i_hart::exec_stype(const decoded_insn &d, std::ostream* pos)
 {
-    uint32_t rs1Con = regs.get(get_rs1(insn)); //Contents of rs1.
-    uint32_t rs2Con = regs.get(get_rs2(insn)); //Contents of rs2.
-    int32_t imm_s = get_imm_s(insn);
+    uint32_t rs1Con = regs.get(d.rs1); //Contents of rs1.
+    uint32_t rs2Con = regs.get(d.rs2); //Contents of rs2.
+    int32_t imm_s = d.imm;
     uint32_t addr = (rs1Con + imm_s); //Address to set memory.
 
-    if(pos) //If output stream exists.
+    if(trace) //If tracing, pos is the output stream.
     {
-        std::string s = render_stype(insn, mnemonic);
+        std::string s = render_stype(d.insn, d.mnemonic);
         *pos << std::setw(instruction_width) << std::setfill(' ') << std::left << s;
     }
 
-    switch(funct3)
+    switch(d.funct3)
     {
-        default:            exec_illegal_insn(insn, pos); return;
+        default:            exec_illegal_insn<trace>(d, pos); return;
         case funct3_sb:  //Set Byte
         {
             mem.set8(addr, rs2Con & 0x000000ff); //Set byte of memory at address given by sum of rs1 and imm_s to 8 LSBs of rs2.
-            if(pos)
+            if(trace)
             {
                 *pos << "// m8(" << hex::to_hex0x32(rs1Con) << " + " << hex::to_hex0x32(imm_s) << ") = ";
                 *pos << hex::to_hex0x32(rs2Con & 0x000000ff) << std::endl;
@@ -638,7 +1320,7 @@ void rv32i_hart::exec_stype(uint32_t insn, std::ostream* pos, uint32_t funct3, c
         case funct3_sh:  //Set Halfword
         {
             mem.set16(addr, rs2Con& 0x0000ffff); //Set 16-bit half-word of memory at address given by sum of rs1 and imm_s to 16 LSBs of rs2.
-            if(pos) 
+            if(trace) 
             {
                 *pos << "// m16(" << hex::to_hex0x32(rs1Con) << " + " << hex::to_hex0x32(imm_s) << ") = ";
                 *pos << hex::to_hex0x32(rs2Con & 0x0000ffff) << std::endl;
@@ -649,7 +1331,7 @@ void rv32i_hart::exec_stype(uint32_t insn, std::ostream* pos, uint32_t funct3, c
         case funct3_sw:  //Set Word
         {
             mem.set32(addr, rs2Con); //Store 32-bit value in rs2 into memory at address given by sum of rs1 and imm_s.
-            if(pos) 
+            if(trace) 
             {
                 *pos << "// m32(" << hex::to_hex0x32(rs1Con) << " + " << hex::to_hex0x32(imm_s) << ") = ";
                 *pos << hex::to_hex0x32(rs2Con) << std::endl;
@@ -658,7 +1340,11 @@ void rv32i_hart::exec_stype(uint32_t insn, std::ostream* pos, uint32_t funct3, c
         break;
     }
 
-    pc += 4;
+    if(l1d || timing)
+    {
+        model_access(l1d.get(), addr, 1u << d.funct3); //funct3 holds log2 of the width.
+    }
+    pc += d.len;
 }
 
 /**
@@ -666,40 +1352,40 @@ void rv32i_hart::exec_stype(uint32_t insn, std::ostream* pos, uint32_t funct3, c
  * 
  * Execute between several I Type-ALU instructions based on funct3 code.
  *
- * @param insn Instruction to decode and execute.
- * @param pos Pointer to the output stream (if it exists) to send output.
- * @param funct3 Value to discriminate I Type-ALU instructions.
- * @param mnemonic String to pass to rendering function.
+ * @param d Predecoded instruction to execute.
+ * @tparam trace Whether to render the instruction to pos.
+ * @param pos Pointer to the output stream to send output, only used when tracing.
  */
-void rv32i_hart::exec_itype_alu(uint32_t insn, std::ostream* pos, uint32_t funct3, const char *mnemonic)
+template<bool trace>
+void rv32i_hart::exec_itype_alu(const decoded_insn &d, std::ostream* pos)
 {
-    uint32_t rd = get_rd(insn);
-    uint32_t rs1Con = regs.get(get_rs1(insn)); //Contents of rs1.
-    int32_t imm_i = get_imm_i(insn);
+    uint32_t rd = d.rd;
+    uint32_t rs1Con = regs.get(d.rs1); //Contents of rs1.
+    int32_t imm_i = d.imm;
     int32_t val; //Value to set register.
 
-    if(pos) //If output stream exists.
+    if(trace) //If tracing, pos is the output stream.
     {
         std::string s;
-        if(funct3 == funct3_sll || funct3 == funct3_srx) //If funct3 = operation with shamt requirement.
+        if(d.funct3 == funct3_sll || d.funct3 == funct3_srx) //If funct3 = operation with shamt requirement.
         {
-            s = render_itype_alu(insn, mnemonic, imm_i%XLEN);
+            s = render_itype_alu(d.insn, d.mnemonic, imm_i%XLEN);
         }
         else
         {
-            s = render_itype_alu(insn, mnemonic, imm_i);
+            s = render_itype_alu(d.insn, d.mnemonic, imm_i);
         }
 
         *pos << std::setw(instruction_width) << std::setfill(' ') << std::left << s;
     }
 
-    switch(funct3) //Discriminate by funct3.
+    switch(d.funct3) //Discriminate by funct3.
     {
-        default:                exec_illegal_insn(insn, pos); return;
+        default:                exec_illegal_insn<trace>(d, pos); return;
         case funct3_add:  //Add Immediate
         {
             val = rs1Con + imm_i; //Set register rd to rs1 + imm_i.
-            if(pos) 
+            if(trace) 
             {
                 *pos << "// " << render_reg(rd) << " = " << hex::to_hex0x32(rs1Con) << " + " << hex::to_hex0x32(imm_i) << " = ";
                 *pos << hex::to_hex0x32(val) << std::endl;
@@ -710,7 +1396,7 @@ void rv32i_hart::exec_itype_alu(uint32_t insn, std::ostream* pos, uint32_t funct
         case funct3_slt:  //Set Less Than Immediate 
         {
             val = ((static_cast<int32_t>(rs1Con) < imm_i) ? 1 : 0); //If signed integer value in rs1 is less than signed integer value    
-            if(pos)                                                 //in imm_i, then set rd to 1. Otherwise, set rd to 0. 
+            if(trace)                                                 //in imm_i, then set rd to 1. Otherwise, set rd to 0. 
             {
                 *pos << "// " << render_reg(rd) << " = (" << hex::to_hex0x32(rs1Con) << " < " << imm_i;
                 *pos << ") ? 1 : 0 = " << hex::to_hex0x32(val)<< std::endl;
@@ -721,7 +1407,7 @@ void rv32i_hart::exec_itype_alu(uint32_t insn, std::ostream* pos, uint32_t funct
         case funct3_sltu:  //Set Less Than Immediate Unsigned    
         {
             val = ((rs1Con < static_cast<uint32_t>(imm_i)) ? 1 : 0); //If the unsigned integer value in rs1 is less than the unsigned integer value
-            if(pos)                                                  //in imm_i, then set rd to 1. Otherwise, set rd to 0.                                                  
+            if(trace)                                                  //in imm_i, then set rd to 1. Otherwise, set rd to 0.                                                  
             {
                 *pos << "// " << render_reg(rd) << " = (" << hex::to_hex0x32(rs1Con) << " <U " << imm_i;
                 *pos << ") ? 1 : 0 = " << hex::to_hex0x32(val)<< std::endl;
@@ -732,7 +1418,7 @@ void rv32i_hart::exec_itype_alu(uint32_t insn, std::ostream* pos, uint32_t funct
         case funct3_xor:  //Exclusive Or Immediate
         {
             val = (rs1Con ^ imm_i); //Set register rd to the bitwise xor of rs1 and imm_i.
-            if(pos)                                                     
+            if(trace)                                                     
             {
                 *pos << "// " << render_reg(rd) << " = " << hex::to_hex0x32(rs1Con) << " ^ " << hex::to_hex0x32(imm_i);
                 *pos << " = " << hex::to_hex0x32(val) << std::endl;
@@ -743,7 +1429,7 @@ void rv32i_hart::exec_itype_alu(uint32_t insn, std::ostream* pos, uint32_t funct
         case funct3_or:   //Or Immediate
         {
             val = (rs1Con | imm_i); //Set register rd to the bitwise or of rs1 and imm_i.
-            if(pos)                                                     
+            if(trace)                                                     
             {
                 *pos << "// " << render_reg(rd) << " = " << hex::to_hex0x32(rs1Con) << " | " << hex::to_hex0x32(imm_i);
                 *pos << " = " << hex::to_hex0x32(val) << std::endl;
@@ -754,7 +1440,7 @@ void rv32i_hart::exec_itype_alu(uint32_t insn, std::ostream* pos, uint32_t funct
         case funct3_and:  //And Immediate
         {
             val = (rs1Con & imm_i); //Set register rd to the bitwise and of rs1 and imm_i.
-            if(pos)                                                     
+            if(trace)                                                     
             {
                 *pos << "// " << render_reg(rd) << " = " << hex::to_hex0x32(rs1Con) << " & " << hex::to_hex0x32(imm_i);
                 *pos << " = " << hex::to_hex0x32(val) << std::endl;
@@ -765,7 +1451,7 @@ void rv32i_hart::exec_itype_alu(uint32_t insn, std::ostream* pos, uint32_t funct
         case funct3_sll:  //Shift Left Logical Immediate       
         {
             val = (rs1Con << imm_i%XLEN); //Shift rs1 left by the number of bits specifed in shamt_i and store the result in the rd register.
-            if(pos)                                                     
+            if(trace)                                                     
             {
                 *pos << "// " << render_reg(rd) << " = " << hex::to_hex0x32(rs1Con) << " << " << imm_i%XLEN;
                 *pos << " = " << hex::to_hex0x32(val) << std::endl;
@@ -774,13 +1460,13 @@ void rv32i_hart::exec_itype_alu(uint32_t insn, std::ostream* pos, uint32_t funct
         break;
 
         case funct3_srx:
-        switch(get_funct7(insn)) //Discriminate further by funct7.
+        switch(d.funct7) //Discriminate further by funct7.
         {
             default:            
             case funct7_sra:  //Shift Right Arithmetic Immediate
             {
                 val = (static_cast<int32_t>(rs1Con) >> imm_i%XLEN); //Arithmetic shift rs1 right by the number of bits specifed in shamt_i 
-                if(pos)                                             //and store the result in the rd register.
+                if(trace)                                             //and store the result in the rd register.
                 {
                     *pos << "// " << render_reg(rd) << " = " << hex::to_hex0x32(rs1Con) << " >> " << imm_i%XLEN;
                     *pos << " = " << hex::to_hex0x32(val) << std::endl;
@@ -791,7 +1477,7 @@ void rv32i_hart::exec_itype_alu(uint32_t insn, std::ostream* pos, uint32_t funct
             case funct7_srl:  //Shift Right Logical Immediate
             {
                 val = (rs1Con >> imm_i%XLEN); //Logical shift rs1 right by the number of bits specifed in shamt_i and store the result in the rd register.
-                if(pos)                                                     
+                if(trace)                                                     
                 {
                     *pos << "// " << render_reg(rd) << " = " << hex::to_hex0x32(rs1Con) << " >> " << imm_i%XLEN;
                     *pos << " = " << hex::to_hex0x32(val) << std::endl;
@@ -802,7 +1488,7 @@ void rv32i_hart::exec_itype_alu(uint32_t insn, std::ostream* pos, uint32_t funct
     }
 
     regs.set(rd , val);
-    pc += 4;
+    pc += d.len;
 }
 
 /**
@@ -810,31 +1496,31 @@ void rv32i_hart::exec_itype_alu(uint32_t insn, std::ostream* pos, uint32_t funct
  * 
  * Execute between several R Type instructions based on funct3 code.
  *
- * @param insn Instruction to decode and execute.
- * @param pos Pointer to the output stream (if it exists) to send output.
- * @param funct3 Value to discriminate R Type instructions.
- * @param mnemonic String to pass to rendering function.
+ * @param d Predecoded instruction to execute.
+ * @tparam trace Whether to render the instruction to pos.
+ * @param pos Pointer to the output stream to send output, only used when tracing.
  */
-void rv32i_hart::exec_rtype(uint32_t insn, std::ostream* pos, uint32_t funct3, const char *mnemonic)
+template<bool trace>
+void rv32i_hart::exec_rtype(const decoded_insn &d, std::ostream* pos)
 {
-    uint32_t rd = get_rd(insn);
-    uint32_t rs1Con = regs.get(get_rs1(insn)); //Contents of rs1.
-    uint32_t rs2Con = regs.get(get_rs2(insn)); //Contents of rs1.
+    uint32_t rd = d.rd;
+    uint32_t rs1Con = regs.get(d.rs1); //Contents of rs1.
+    uint32_t rs2Con = regs.get(d.rs2); //Contents of rs1.
     int32_t val; //Value to set register.
 
-    if(pos) //If output stream exists.
+    if(trace) //If tracing, pos is the output stream.
     {
-        std::string s = render_rtype(insn, mnemonic);
+        std::string s = render_rtype(d.insn, d.mnemonic);
         *pos << std::setw(instruction_width) << std::setfill(' ') << std::left << s;
     }
 
-    switch(funct3) //Discriminate by funct3.
+    switch(d.funct3) //Discriminate by funct3.
     {
-        default:                exec_illegal_insn(insn, pos); return;    
+        default:                exec_illegal_insn<trace>(d, pos); return;    
         case funct3_sll:  //Shift Left Logical
         {
             val = (rs1Con << (rs2Con & 0x0000001f)); //Shift rs1 left by number of bits in least signifcant 5 bits of rs2 and store result in rd.
-            if(pos)                                                     
+            if(trace)                                                     
             {
                 *pos << "// " << render_reg(rd) << " = " << hex::to_hex0x32(rs1Con) << " << " << (rs2Con & 0x0000001f);
                 *pos << " = " << hex::to_hex0x32(val) << std::endl;
@@ -845,7 +1531,7 @@ void rv32i_hart::exec_rtype(uint32_t insn, std::ostream* pos, uint32_t funct3, c
         case funct3_slt:  //Set Less Than
         {
             val = ((static_cast<int32_t>(rs1Con) < static_cast<int32_t>(rs2Con)) ? 1 : 0); //If signed integer value in rs1 is less than signed integer value    
-            if(pos)                                                                        //in rs2, then set rd to 1. Otherwise, set rd to 0. 
+            if(trace)                                                                        //in rs2, then set rd to 1. Otherwise, set rd to 0. 
             {
                 *pos << "// " << render_reg(rd) << " = (" << hex::to_hex0x32(rs1Con) << " < " << hex::to_hex0x32(rs2Con);
                 *pos << ") ? 1 : 0 = " << hex::to_hex0x32(val)<< std::endl;
@@ -856,7 +1542,7 @@ void rv32i_hart::exec_rtype(uint32_t insn, std::ostream* pos, uint32_t funct3, c
         case funct3_sltu:  //Set Less Than Unsigned
         {
             val = ((rs1Con < rs2Con) ? 1 : 0); //If unsigned integer value in rs1 is less than unsigned integer value    
-            if(pos)                            //in rs2, then set rd to 1. Otherwise, set rd to 0. 
+            if(trace)                            //in rs2, then set rd to 1. Otherwise, set rd to 0. 
             {
                 *pos << "// " << render_reg(rd) << " = (" << hex::to_hex0x32(rs1Con) << " <U " << hex::to_hex0x32(rs2Con);
                 *pos << ") ? 1 : 0 = " << hex::to_hex0x32(val)<< std::endl;
@@ -867,7 +1553,7 @@ void rv32i_hart::exec_rtype(uint32_t insn, std::ostream* pos, uint32_t funct3, c
         case funct3_xor:  //Exclusive Or
         {
             val = (rs1Con ^ rs2Con); //Set register rd to the bitwise xor of rs1 and rs2.
-            if(pos)                                                     
+            if(trace)                                                     
             {
                 *pos << "// " << render_reg(rd) << " = " << hex::to_hex0x32(rs1Con) << " ^ " << hex::to_hex0x32(rs2Con);
                 *pos << " = " << hex::to_hex0x32(val) << std::endl;
@@ -878,7 +1564,7 @@ void rv32i_hart::exec_rtype(uint32_t insn, std::ostream* pos, uint32_t funct3, c
         case funct3_or:  //OR
         {
             val = (rs1Con | rs2Con); //Set register rd to the bitwise or of rs1 and rs2.
-            if(pos)                                                     
+            if(trace)                                                     
             {
                 *pos << "// " << render_reg(rd) << " = " << hex::to_hex0x32(rs1Con) << " | " << hex::to_hex0x32(rs2Con);
                 *pos << " = " << hex::to_hex0x32(val) << std::endl;
@@ -889,7 +1575,7 @@ void rv32i_hart::exec_rtype(uint32_t insn, std::ostream* pos, uint32_t funct3, c
         case funct3_and:  //And    
         {
             val = (rs1Con & rs2Con); //Set register rd to the bitwise and of rs1 and rs2.
-            if(pos)                                                     
+            if(trace)                                                     
             {
                 *pos << "// " << render_reg(rd) << " = " << hex::to_hex0x32(rs1Con) << " & " << hex::to_hex0x32(rs2Con);
                 *pos << " = " << hex::to_hex0x32(val) << std::endl;
@@ -898,13 +1584,13 @@ void rv32i_hart::exec_rtype(uint32_t insn, std::ostream* pos, uint32_t funct3, c
         break;
 
         case funct3_add:    //std::cout << "entering funcADD" << std::endl;
-        switch(get_funct7(insn))
+        switch(d.funct7)
         {
-            default:            exec_illegal_insn(insn, pos); return;
+            default:            exec_illegal_insn<trace>(d, pos); return;
             case funct7_add:  //Add 
             {
                 val = rs1Con + rs2Con; //Set register rd to rs1 + rs2.
-                if(pos) 
+                if(trace) 
                 {
                     *pos << "// " << render_reg(rd) << " = " << hex::to_hex0x32(rs1Con) << " + " << hex::to_hex0x32(rs2Con) << " = ";
                     *pos << hex::to_hex0x32(val) << std::endl;
@@ -915,7 +1601,7 @@ void rv32i_hart::exec_rtype(uint32_t insn, std::ostream* pos, uint32_t funct3, c
             case funct7_sub:  //Subtract
             {
                 val = rs1Con - rs2Con; //Set register rd to rs1 - rs2.
-                if(pos) 
+                if(trace) 
                 {
                     *pos << "// " << render_reg(rd) << " = " << hex::to_hex0x32(rs1Con) << " - " << hex::to_hex0x32(rs2Con) << " = ";
                     *pos << hex::to_hex0x32(val) << std::endl;
@@ -926,13 +1612,13 @@ void rv32i_hart::exec_rtype(uint32_t insn, std::ostream* pos, uint32_t funct3, c
         break;
         
         case funct3_srx:    //std::cout << "entering funcSRX" << std::endl;
-        switch(get_funct7(insn)) //Discriminate further by funct7.
+        switch(d.funct7) //Discriminate further by funct7.
         {
-            default:            exec_illegal_insn(insn, pos); return;
+            default:            exec_illegal_insn<trace>(d, pos); return;
             case funct7_sra:  //Shift Right Arithmetic
             {
                 val = (static_cast<int32_t>(rs1Con) >> (rs2Con & 0x0000001f)); //Arithmetic shift rs1 right by the number of bits given in the least-signifcant 5 bits 
-                if(pos)                                                        //of the rs2 register and store the result in rd.
+                if(trace)                                                        //of the rs2 register and store the result in rd.
                 {
                     *pos << "// " << render_reg(rd) << " = " << hex::to_hex0x32(rs1Con) << " >> " << (rs2Con & 0x0000001f);
                     *pos << " = " << hex::to_hex0x32(val) << std::endl;
@@ -943,7 +1629,7 @@ void rv32i_hart::exec_rtype(uint32_t insn, std::ostream* pos, uint32_t funct3, c
             case funct7_srl:  //Shift Right Logical
             {
                 val = (rs1Con >> (rs2Con & 0x0000001f)); //Logical shift rs1 right by the number of bits given in the least-signigcant 5 bits 
-                if(pos)                                  //of the rs2 register and store the result in rd.   
+                if(trace)                                  //of the rs2 register and store the result in rd.   
                 {
                     *pos << "// " << render_reg(rd) << " = " << hex::to_hex0x32(rs1Con) << " >> " << (rs2Con & 0x0000001f);
                     *pos << " = " << hex::to_hex0x32(val) << std::endl;
@@ -955,7 +1641,66 @@ void rv32i_hart::exec_rtype(uint32_t insn, std::ostream* pos, uint32_t funct3, c
     }
 
     regs.set(rd , val);
-    pc += 4;
+    pc += d.len;
+}
+
+/**
+ * @brief Execute an RV32M operation.
+ *
+ * Division by zero and signed overflow give the results the M extension defines instead of trapping:
+ * x/0 is all ones, x%0 is x, and INT32_MIN/-1 is INT32_MIN with a remainder of 0.
+ *
+ * @param funct3 Operation.
+ * @param a Contents of rs1.
+ * @param b Contents of rs2.
+ * @return Value for rd.
+ */
+uint32_t rv32i_hart::muldiv(uint32_t funct3, uint32_t a, uint32_t b)
+{
+    int32_t sa = a;
+    int32_t sb = b;
+    bool overflow = (sa == INT32_MIN && sb == -1);
+    switch(funct3)
+    {
+        default:
+        case funct3_mul:    return a * b;
+        case funct3_mulh:   return (static_cast<int64_t>(sa) * sb) >> 32;
+        case funct3_mulhsu: return (static_cast<int64_t>(sa) * static_cast<int64_t>(b)) >> 32;
+        case funct3_mulhu:  return (static_cast<uint64_t>(a) * b) >> 32;
+        case funct3_div:    return b == 0 ? UINT32_MAX : overflow ? a : static_cast<uint32_t>(sa / sb);
+        case funct3_divu:   return b == 0 ? UINT32_MAX : a / b;
+        case funct3_rem:    return b == 0 ? a : overflow ? 0 : static_cast<uint32_t>(sa % sb);
+        case funct3_remu:   return b == 0 ? a : a % b;
+    }
+}
+
+/**
+ * @brief Execute RV32M instruction.
+ *
+ * Execute between the multiply and divide instructions based on funct3 code, each as one host operation.
+ * 
+ * @param d Predecoded instruction to execute.
+ * @tparam trace Whether to render the instruction to pos.
+ * @param pos Pointer to the output stream to send output, only used when tracing.
+ */
+template<bool trace>
+void rv32i_hart::exec_mtype(const decoded_insn &d, std::ostream* pos)
+{
+    static const char *op[8] = { " * ", " *h ", " *hsu ", " *hu ", " / ", " /u ", " % ", " %u " };  //Operators by funct3.
+    uint32_t rs1Con = regs.get(d.rs1); //Contents of rs1.
+    uint32_t rs2Con = regs.get(d.rs2); //Contents of rs2.
+    uint32_t val = muldiv(d.funct3, rs1Con, rs2Con);
+
+    if(trace) //If tracing, pos is the output stream.
+    {
+        std::string s = render_rtype(d.insn, d.mnemonic);
+        *pos << std::setw(instruction_width) << std::setfill(' ') << std::left << s;
+        *pos << "// " << render_reg(d.rd) << " = " << hex::to_hex0x32(rs1Con) << op[d.funct3] << hex::to_hex0x32(rs2Con);
+        *pos << " = " << hex::to_hex0x32(val) << std::endl;
+    }
+
+    regs.set(d.rd, val);
+    pc += d.len;
 }
 
 /**
@@ -963,14 +1708,16 @@ void rv32i_hart::exec_rtype(uint32_t insn, std::ostream* pos, uint32_t funct3, c
  *
  * Terminate and transfer back control to operating system, halting thread.
  * 
- * @param insn Instruction to decode and execute.
- * @param pos Pointer to the output stream (if it exists) to send output.
+ * @param d Predecoded instruction to execute.
+ * @tparam trace Whether to render the instruction to pos.
+ * @param pos Pointer to the output stream to send output, only used when tracing.
  */
-void rv32i_hart::exec_ecall(uint32_t insn, std::ostream* pos)
+template<bool trace>
+void rv32i_hart::exec_ecall(const decoded_insn &d, std::ostream* pos)
 {
-    if(pos) //If output stream exists.
+    if(trace) //If tracing, pos is the output stream.
     {
-        std::string s = render_ecall(insn);
+        std::string s = render_ecall(d.insn);
         *pos << std::setw(instruction_width) << std::setfill(' ') << std::left << s;
         *pos << "// HALT";
     }
@@ -984,14 +1731,16 @@ void rv32i_hart::exec_ecall(uint32_t insn, std::ostream* pos)
  *
  * Terminate and transfer back control to debugger, halting thread.
  * 
- * @param insn Instruction to decode and execute.
- * @param pos Pointer to the output stream (if it exists) to send output.
+ * @param d Predecoded instruction to execute.
+ * @tparam trace Whether to render the instruction to pos.
+ * @param pos Pointer to the output stream to send output, only used when tracing.
  */
-void rv32i_hart::exec_ebreak(uint32_t insn, std::ostream* pos)
+template<bool trace>
+void rv32i_hart::exec_ebreak(const decoded_insn &d, std::ostream* pos)
 {
-    if(pos) //If output stream exists.
+    if(trace) //If tracing, pos is the output stream.
     {
-        std::string s = render_ebreak(insn);
+        std::string s = render_ebreak(d.insn);
         *pos << std::setw(instruction_width) << std::setfill(' ') << std::left << s;
         *pos << "// HALT" << std::endl;
     }
@@ -1003,158 +1752,250 @@ void rv32i_hart::exec_ebreak(uint32_t insn, std::ostream* pos)
 /**
  * @brief Execute csrrx instruction.
  * 
- * @param insn Instruction to decode and execute.
- * @param pos Pointer to the output stream (if it exists) to send output.
- * @param funct3 Value to discriminate csrrx type instructions.
- * @param mnemonic String to pass to rendering function.
+ * @param d Predecoded instruction to execute.
+ * @tparam trace Whether to render the instruction to pos.
+ * @param pos Pointer to the output stream to send output, only used when tracing.
  */
-void rv32i_hart::exec_csrrx(uint32_t insn, std::ostream* pos, uint32_t funct3, const char *mnemonic)
+template<bool trace>
+void rv32i_hart::exec_csrrx(const decoded_insn &d, std::ostream* pos)
 {
-    uint32_t rd = get_rd(insn);
-    uint32_t rs1 = (get_rs1(insn)); 
-    int32_t csr = get_imm_i(insn);
-    int32_t val = 0; //Value to set register.
+    uint32_t rd = d.rd;
+    uint32_t rs1 = d.rs1;
+    uint32_t csr = d.imm & 0x00000fff;
+    uint32_t val = 0; //Value to set register.
 
-    if(pos) //If output stream exists.
+    if(trace) //If tracing, pos is the output stream.
     {
-        std::string s = render_csrrx(insn, mnemonic);
+        std::string s = render_csrrx(d.insn, d.mnemonic);
         *pos << std::setw(instruction_width) << std::setfill(' ') << std::left << s;
     }
 
-    switch(funct3)
+    if(!csr_op(d.funct3, csr, regs.get(rs1), d.funct3 == funct3_csrrw || rs1 != 0, val)) //csrrs and csrrc with x0 only read.
     {
-        default:            exec_illegal_insn(insn, pos); return;
-        case funct3_csrrw:  //Atomic Read/Write
-        {
-            if(rd != 0)
-            {
-                val = regs.get(csr);
-            }
+        halt = true;
+        halt_reason = d.funct3 == funct3_csrrw ? "Illegal CSR in CSRRW instruction" : d.funct3 == funct3_csrrs ? "Illegal CSR in CSRRS instruction" : "Illegal CSR in CSRRC instruction";
+        return;
+    }
 
-            regs.set(csr, regs.get(rs1));
-            if(pos)
-            {
-                *pos << "// " << render_reg(rd) << " = " << val << std::endl;
-            }
-        }
-        break;
+    if(trace)
+    {
+        *pos << "// " << render_reg(rd) << " = " << static_cast<int32_t>(val) << std::endl;
+    }
+    regs.set(rd, val);
+    pc += d.len;
+}
+
+/**
+ * @brief Execute LR, SC or AMO instruction.
+ *
+ * AMOs are one host atomic on shared memory. lr.w reserves the word along with a ticket from memory, and
+ * sc.w only stores if this hart still holds that reservation and no hart has stored to the word since,
+ * even one that put the same value back. Any sc.w gives up the reservation. Atomics must be word
+ * aligned, anything else halts the hart.
+ * 
+ * @param d Predecoded instruction to execute.
+ * @tparam trace Whether to render the instruction to pos.
+ * @param pos Pointer to the output stream to send output, only used when tracing.
+ */
+template<bool trace>
+void rv32i_hart::exec_amo(const decoded_insn &d, std::ostream* pos)
+{
+    uint32_t addr = regs.get(d.rs1);
+    uint32_t rs2Con = regs.get(d.rs2); //Contents of rs2.
+    uint32_t funct5 = d.funct7 >> 2;
+
+    if(trace) //If tracing, pos is the output stream.
+    {
+        std::string s = render_amo(d.insn, d.mnemonic);
+        *pos << std::setw(instruction_width) << std::setfill(' ') << std::left << s;
+    }
 
-        case funct3_csrrs:  //Atomic Read and Set
+    if(addr % 4 != 0)
+    {
+        if(trace)
         {
-            if((csr & 0x00000fff) == 0xf14)
-            {
-                val = mhartid;
-            }
-            else  //If invalid register requested.
-            {
-                halt = true;
-                halt_reason = "Illegal CSR in CSRRS instruction";
-                return;
-                //val = regs.get(csr); Program specific implimentation treats all other registers as illegal.
-            }
+            *pos << std::endl;
+        }
+        halt = true;
+        halt_reason = "Misaligned atomic memory access";
+        return;
+    }
 
-            if(rs1 != 0)
-            {
-                regs.set(csr, (val | regs.get(rs1)));
-            }
-            
-            if(pos) 
-            {
-                *pos << "// " << render_reg(rd) << " = " << val << std::endl;
-            }
-        } 
-        break;
+    if(l1d || timing)
+    {
+        model_access(l1d.get(), addr, 4);
+    }
 
-        case funct3_csrrc:  //Atomic Read and Clear
+    uint32_t val;
+    if(funct5 == funct5_lr) //Load Reserved
+    {
+        val = mem.load_reserved(addr, reservation_ticket);
+        reservation_valid = true;
+        reservation_addr = addr;
+        if(trace)
         {
-            val = regs.get(csr);
-            if(rs1 != 0)
+            *pos << "// " << render_reg(d.rd) << " = m32(" << hex::to_hex0x32(addr) << ") = " << hex::to_hex0x32(val) << std::endl;
+        }
+    }
+    else if(funct5 == funct5_sc) //Store Conditional
+    {
+        bool stored = reservation_valid && reservation_addr == addr && mem.store_conditional(addr, reservation_ticket, rs2Con);
+        reservation_valid = false;
+        val = stored ? 0 : 1;
+        if(trace)
+        {
+            if(stored)
             {
-                regs.set(csr, (val & ~regs.get(rs1)));
+                *pos << "// m32(" << hex::to_hex0x32(addr) << ") = " << hex::to_hex0x32(rs2Con) << ", ";
             }
-            
-            if(pos) 
+            else
             {
-                *pos << "// " << render_reg(rd) << " = " << val << std::endl;
+                *pos << "// ";
             }
+            *pos << render_reg(d.rd) << " = " << hex::to_hex0x32(val) << std::endl;
+        }
+    }
+    else
+    {
+        memory::amo_op op;
+        switch(funct5)
+        {
+            default:                op = memory::amo_add; break;
+            case funct5_amoswap:    op = memory::amo_swap; break;
+            case funct5_amoxor:     op = memory::amo_xor; break;
+            case funct5_amoand:     op = memory::amo_and; break;
+            case funct5_amoor:      op = memory::amo_or; break;
+            case funct5_amomin:     op = memory::amo_min; break;
+            case funct5_amomax:     op = memory::amo_max; break;
+            case funct5_amominu:    op = memory::amo_minu; break;
+            case funct5_amomaxu:    op = memory::amo_maxu; break;
+        }
+        val = mem.amo32(addr, op, rs2Con);
+        if(trace)
+        {
+            *pos << "// " << render_reg(d.rd) << " = m32(" << hex::to_hex0x32(addr) << ") = " << hex::to_hex0x32(val) << ", ";
+            *pos << "m32(" << hex::to_hex0x32(addr) << ") = " << hex::to_hex0x32(mem.get32_atomic(addr)) << std::endl;
         }
-        break;
     }
 
-    regs.set(rd, val);
-    pc += 4;
+    regs.set(d.rd, val);
+    pc += d.len;
 }
 
 /**
  * @brief Execute csrrxi instruction.
  * 
- * @param insn Instruction to decode and execute.
- * @param pos Pointer to the output stream (if it exists) to send output.
- * @param funct3 Value to discriminate csrrxi type instructions.
- * @param mnemonic String to pass to rendering function.
+ * @param d Predecoded instruction to execute.
+ * @tparam trace Whether to render the instruction to pos.
+ * @param pos Pointer to the output stream to send output, only used when tracing.
  */
-void rv32i_hart::exec_csrrxi(uint32_t insn, std::ostream* pos, uint32_t funct3, const char *mnemonic)
+template<bool trace>
+void rv32i_hart::exec_csrrxi(const decoded_insn &d, std::ostream* pos)
 {
-    uint32_t rd = get_rd(insn);
-    uint32_t zimm = (get_rs1(insn));
-    int32_t csr = get_imm_i(insn);
-    int32_t val = 0; //Value to set register.
+    uint32_t rd = d.rd;
+    uint32_t zimm = d.rs1;
+    uint32_t csr = d.imm & 0x00000fff;
+    uint32_t val = 0; //Value to set register.
 
-    if(pos) //If output stream exists.
+    if(trace) //If tracing, pos is the output stream.
     {
-        std::string s = render_csrrxi(insn, mnemonic);
+        std::string s = render_csrrxi(d.insn, d.mnemonic);
         *pos << std::setw(instruction_width) << std::setfill(' ') << std::left << s;
     }
 
-    switch(funct3)
+    uint32_t op = d.funct3 & 0b011; //The same operation as the register form.
+    if(!csr_op(op, csr, zimm, op == funct3_csrrw || zimm != 0, val)) //csrrsi and csrrci with 0 only read.
     {
-        default:            exec_illegal_insn(insn, pos); return;
-        case funct3_csrrw:  //Atomic Read/Write Immediate
-        {
-            if(rd != 0)
-            {
-                val = regs.get(csr);
-            }
+        halt = true;
+        halt_reason = op == funct3_csrrw ? "Illegal CSR in CSRRWI instruction" : op == funct3_csrrs ? "Illegal CSR in CSRRSI instruction" : "Illegal CSR in CSRRCI instruction";
+        return;
+    }
 
-            regs.set(csr, regs.get(zimm));
-            if(pos)
-            {
-                *pos << "// " << render_reg(rd) << " = " << val << std::endl;
-            }
-        }
-        break;
+    if(trace)
+    {
+        *pos << "// " << render_reg(rd) << " = " << static_cast<int32_t>(val) << std::endl;
+    }
+    regs.set(rd, val);
+    pc += d.len;
+}
 
-        case funct3_csrrs:  //Atomic Read and Set Immediate
-        {
-            val = regs.get(csr);
-            if(zimm != 0)
-            {
-                regs.set(csr, (val | regs.get(zimm)));
-            }
-            
-            if(pos) 
-            {
-                *pos << "// " << render_reg(rd) << " = " << val << std::endl;
-            }
-        }
-        break;
+/**
+ * @brief Read and update a CSR.
+ *
+ * @param op funct3_csrrw, funct3_csrrs or funct3_csrrc.
+ * @param csr CSR number.
+ * @param src Value to write, or the bits to set or clear.
+ * @param write Whether the CSR is written at all.
+ * @param val Set to the value the CSR held.
+ * @return false if the CSR does not exist, or is read only and written.
+ */
+bool rv32i_hart::csr_op(uint32_t op, uint32_t csr, uint32_t src, bool write, uint32_t &val)
+{
+    if(!csr_read(csr, val))
+    {
+        return false;
+    }
+    if(!write)
+    {
+        return true;
+    }
+    uint32_t next = (op == funct3_csrrw) ? src : (op == funct3_csrrs) ? (val | src) : (val & ~src);
+    return csr_write(csr, next);
+}
 
-        case funct3_csrrc:  //Atomic Read and Clear Immediate
-        {
-            val = regs.get(csr);
-            if(zimm != 0)
-            {
-                regs.set(csr, (val & ~zimm));
-            }
-            
-            if(pos) 
-            {
-                *pos << "// " << render_reg(rd) << " = " << val << std::endl;
-            }
-        }
-        break;
+/**
+ * @brief Read a CSR.
+ *
+ * The counters count from reset. cycle is the pipeline timing model's count when there is one, otherwise one
+ * cycle per instruction, and time ticks with cycle so runs stay reproducible. None of them count the
+ * instruction reading them.
+ *
+ * @param csr CSR number.
+ * @param val Set to the CSR's value.
+ * @return false if the CSR does not exist.
+ */
+bool rv32i_hart::csr_read(uint32_t csr, uint32_t &val) const
+{
+    uint64_t retired = insn_counter - 1; //tick() counted the instruction reading the CSR.
+    uint64_t cycles = timing ? timing->get_cycles() : retired;
+    switch(csr)
+    {
+        default:                return false;
+        case csr_mhartid:       val = mhartid; return true;
+        case csr_cycle:
+        case csr_time:          val = static_cast<uint32_t>(cycles); return true;
+        case csr_cycleh:
+        case csr_timeh:         val = static_cast<uint32_t>(cycles >> 32); return true;
+        case csr_instret:       val = static_cast<uint32_t>(retired); return true;
+        case csr_instreth:      val = static_cast<uint32_t>(retired >> 32); return true;
+        case csr_mcycle:        val = static_cast<uint32_t>(cycles + mcycle_offset); return true;
+        case csr_mcycleh:       val = static_cast<uint32_t>((cycles + mcycle_offset) >> 32); return true;
+        case csr_minstret:      val = static_cast<uint32_t>(retired + minstret_offset); return true;
+        case csr_minstreth:     val = static_cast<uint32_t>((retired + minstret_offset) >> 32); return true;
     }
+}
 
-    regs.set(rd, val);
-    pc += 4;
+/**
+ * @brief Write a CSR.
+ *
+ * Writing mcycle or minstret, or their high halves, moves those counters without touching cycle and instret.
+ *
+ * @param csr CSR number.
+ * @param val Value to write.
+ * @return false if the CSR does not exist or is read only.
+ */
+bool rv32i_hart::csr_write(uint32_t csr, uint32_t val)
+{
+    uint64_t retired = insn_counter - 1;
+    uint64_t cycles = timing ? timing->get_cycles() : retired;
+    uint64_t mcycle = cycles + mcycle_offset;
+    uint64_t minstret = retired + minstret_offset;
+    switch(csr)
+    {
+        default:                return false;
+        case csr_mcycle:        mcycle_offset = ((mcycle & 0xffffffff00000000ull) | val) - cycles; return true;
+        case csr_mcycleh:       mcycle_offset = ((mcycle & 0x00000000ffffffffull) | static_cast<uint64_t>(val) << 32) - cycles; return true;
+        case csr_minstret:      minstret_offset = ((minstret & 0xffffffff00000000ull) | val) - retired; return true;
+        case csr_minstreth:     minstret_offset = ((minstret & 0x00000000ffffffffull) | static_cast<uint64_t>(val) << 32) - retired; return true;
+    }
 }
\ No newline at end of file
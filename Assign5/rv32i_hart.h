@@ -12,9 +12,17 @@
 //
 //***************************************************************************
 //#include <string>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
 #include "memory.h"
 #include "rv32i_decode.h"
 #include "registerfile.h"
+#include "cache_sim.h"
+#include "branch_predictor.h"
+#include "pipeline_model.h"
+#include "trace_writer.h"
 
 /**
  * @brief Simulated Hardware Thread Class
@@ -22,58 +30,176 @@
  * Facilitates the creation and operation of simulated hardware threads, allowing execution of binary code.
  *
  */
-class rv32i_hart : public rv32i_decode
+class rv32i_hart : public rv32i_decode, public memory_observer
 {
 public:
+    /**
+     * @brief Architectural Hart State
+     * 
+     * Everything needed to resume a hart exactly where it left off, apart from memory.
+     */
+    struct hart_state
+    {
+        uint32_t pc = { 0 };                    //Address of the next instruction.
+        int32_t regs[32] = { 0 };               //xregisters x0..x31.
+        uint64_t insn_counter = { 0 };          //Instructions executed so far.
+        bool halt = { false };                  //Halt status.
+        std::string halt_reason = { "none" };   //Halt reason.
+    };
+
     /**
      * @brief Construct a new rv32i hardware thread.
      * 
      * @param m Size for the memory object to use in initializing the hardware thread.
      */
-    rv32i_hart(memory &m) : mem(m) { }           //Constructor
+    rv32i_hart(memory &m) : reset_sp(m.get_size()), mem(m) { mem.add_observer(this); }  //Constructor
+    ~rv32i_hart() { mem.remove_observer(this); }                 //Destructor
     void set_show_instructions(bool b);          //Set the show instructions flag.
     void set_show_registers(bool b);             //Set the show registers flag.
+    void set_show_register_changes(bool b);      //Show only the registers that changed instead of all of them.
     bool is_halted() const;                      //Return halt status.
     const std::string& get_halt_reason() const;  //Return halt reason.
     uint64_t get_insn_counter() const;           //Get instruction counter.
     void set_mhartid(int ID);                    //Set mhart ID.
+    void set_reset_pc(uint32_t addr);            //Set the address reset() starts execution at.
+    void set_reset_sp(uint32_t addr);            //Set the stack pointer reset() starts with.
+    void set_rvc(bool b);                        //Enable RV32C compressed instructions.
+    void set_l1i(const cache_sim::config &c);    //Model an L1 instruction cache.
+    void set_l1d(const cache_sim::config &c);    //Model an L1 data cache.
+    void report_caches(const std::string &hdr="") const;  //Report the hits and misses of any modeled caches.
+    void set_branch_unit(const branch_unit::config &c);   //Model branch predictors.
+    void report_branches(const std::string &hdr="") const;  //Report the accuracy of any modeled branch predictors.
+    void set_timing(const pipeline_model::config &c);     //Model pipeline timing.
+    void report_timing(const std::string &hdr="") const;  //Report the cycles and stalls of any pipeline timing model.
+    bool set_trace_file(const std::string &fname);       //Record a binary trace of every instruction tick() executes.
+    bool close_trace();                                  //Finish the trace file.
+    void bind_thread();                          //Run on the calling host thread, sharing memory with other harts.
+    void apply_invalidations();                  //Apply writes other harts made to cached instructions.
 
     void tick(const std::string &hdr="");        //Tick instruction execution.
     void dump(const std::string &hdr="") const;  //Dump hardware thread.
+    void dump_changes(const std::string &hdr=""); //Dump the pc and the registers changed since the last call.
     void reset();                                //Reset hardware thread.
+    hart_state save_state() const;               //Capture the architectural state.
+    void restore_state(const hart_state &s);     //Resume from a captured state.
 
-private:
-    static constexpr int instruction_width           = 35;
-    void exec(uint32_t insn, std::ostream* pos);              //Execute instruction.
-    void exec_illegal_insn(uint32_t insn, std::ostream* pos); //Illegal Instruction Subroutine.
-    void exec_lui(uint32_t insn, std::ostream* pos);          //Execute lui.
-    void exec_auipc(uint32_t insn, std::ostream* pos);        //Execute auipc.
-    void exec_jal(uint32_t insn, std::ostream* pos);          //Execute jal.
-    void exec_jalr(uint32_t insn, std::ostream* pos);         //Execute jalr.
-
-    void exec_btype(uint32_t insn, std::ostream* pos, uint32_t funct3, const char *mnemonic);       //Execute B Type instruction.
-    void exec_itype_load(uint32_t insn, std::ostream* pos, uint32_t funct3, const char *mnemonic);  //Execute I Type-LOAD instruction.
-    void exec_stype(uint32_t insn, std::ostream* pos, uint32_t funct3, const char *mnemonic);       //Execute S Type instruction.
-    void exec_itype_alu(uint32_t insn, std::ostream* pos, uint32_t funct3, const char *mnemonic);   //Execute I Type-ALU instruction.
-    void exec_rtype(uint32_t insn, std::ostream* pos, uint32_t funct3, const char *mnemonic);       //Execute R Type instruction.
-
-    void exec_ecall(uint32_t insn, std::ostream* pos);                                          //Execute ecall.
-    void exec_ebreak(uint32_t insn, std::ostream* pos);                                         //Execute ebreak.
-    void exec_csrrx(uint32_t insn, std::ostream* pos, uint32_t funct3, const char *mnemonic);   //Execute csrrx instruction.
-    void exec_csrrxi(uint32_t insn, std::ostream* pos, uint32_t funct3, const char *mnemonic);  //Execute csrrxi instruction.
+    void invalidate(uint32_t addr, uint32_t len) override; //Drop predecoded instructions overwritten in memory.
+
+protected:
+    struct decoded_insn;
+    using exec_handler = void (rv32i_hart::*)(const decoded_insn &d, std::ostream* pos);
+
+    /**
+     * @brief Predecoded Instruction
+     * 
+     * Compact record of an instruction's handler and operand fields, decoded once per static instruction.
+     * A null handler marks an empty cache slot.
+     */
+    struct decoded_insn
+    {
+        exec_handler handler = { nullptr };  //Member function that executes the instruction.
+        exec_handler trace_handler = { nullptr };  //Member function that executes and renders the instruction.
+        const char *mnemonic = { nullptr };  //Mnemonic passed to rendering functions.
+        uint32_t insn = { 0 };               //Raw instruction word, kept for rendering. The 32-bit expansion for RV32C.
+        uint16_t cinsn = { 0 };              //Raw RV32C instruction, kept for tracing.
+        uint8_t len = { 4 };                 //Instruction length in bytes, 2 for RV32C.
+        int32_t imm = { 0 };                 //Sign-extended immediate for the instruction's format.
+        uint8_t rd = { 0 };                  //Result xregister.
+        uint8_t rs1 = { 0 };                 //First source operand xregister.
+        uint8_t rs2 = { 0 };                 //Second source operand xregister.
+        uint8_t funct3 = { 0 };              //funct3 discriminator.
+        uint8_t funct7 = { 0 };              //funct7 discriminator.
+    };
+
+    const decoded_insn& fetch(uint32_t addr, decoded_insn &scratch);   //Fetch a predecoded instruction.
+    void predecode_at(uint32_t addr, decoded_insn &d);                  //Decode the instruction at an address into a cache record.
+    static void predecode(uint32_t insn, decoded_insn &d);              //Decode an instruction into a cache record.
+    static bool is_block_end(const decoded_insn &d);                    //Check if an instruction ends a basic block.
+    static uint32_t muldiv(uint32_t funct3, uint32_t a, uint32_t b);    //Execute an RV32M operation.
+    virtual bool csr_read(uint32_t csr, uint32_t &val) const;           //Read a CSR.
 
     bool halt = { false };
     bool show_instructions = { false };
     bool show_registers = { false };
+    bool show_register_changes = { false };  //Set when show_registers dumps only the registers that changed.
+    bool code_modified = { false };  //Set when a write clears a predecoded instruction.
+    bool rvc = { false };            //Set when RV32C instructions are fetched and the pc may be 2 byte aligned.
     std::string halt_reason = { "none" };
 
     uint64_t insn_counter = { 0 };
     uint32_t pc = { 0 };
+    uint32_t reset_pc = { 0 };
+    uint32_t reset_sp;
     uint32_t mhartid = { 0 };
+    uint64_t mcycle_offset = { 0 };    //mcycle less the cycle count, moved by writes to mcycle.
+    uint64_t minstret_offset = { 0 };  //minstret less the instruction count, moved by writes to minstret.
+
+    bool reservation_valid = { false };  //Set by lr.w, cleared by sc.w.
+    uint32_t reservation_addr = { 0 };   //Word reserved by lr.w.
+    uint32_t reservation_ticket = { 0 }; //Write counter lr.w read, sc.w only stores if nothing has advanced it.
 
-protected:
     registerfile regs; //Vector to simulate registers.
     memory &mem;       //Vector to simulate memory.
+
+    std::unique_ptr<cache_sim> l1i;  //Instruction cache model, fed by tick() if present.
+    std::unique_ptr<cache_sim> l1d;  //Data cache model, fed by loads, stores and atomics if present.
+    std::unique_ptr<branch_unit> bpu;  //Branch prediction model, fed by branches and jumps if present.
+    std::unique_ptr<pipeline_model> timing;  //Pipeline timing model, fed by tick() if present.
+    std::unique_ptr<trace_writer> tracer;    //Binary trace, fed by tick() if present.
+
+private:
+    static constexpr int instruction_width           = 35;
+
+    //CSR numbers.
+    static constexpr uint32_t csr_mcycle             = 0xb00;
+    static constexpr uint32_t csr_minstret           = 0xb02;
+    static constexpr uint32_t csr_mcycleh            = 0xb80;
+    static constexpr uint32_t csr_minstreth          = 0xb82;
+    static constexpr uint32_t csr_cycle              = 0xc00;
+    static constexpr uint32_t csr_time               = 0xc01;
+    static constexpr uint32_t csr_instret            = 0xc02;
+    static constexpr uint32_t csr_cycleh             = 0xc80;
+    static constexpr uint32_t csr_timeh              = 0xc81;
+    static constexpr uint32_t csr_instreth           = 0xc82;
+    static constexpr uint32_t csr_mhartid            = 0xf14;
+
+    void trace_compressed(const decoded_insn &d, std::ostream* pos);  //Execute and render an RV32C instruction.
+    void model_access(cache_sim *cache, uint32_t addr, uint32_t len); //Feed a memory access to a cache model and the timing model.
+    uint32_t trace_address(const decoded_insn &d) const;  //Get the address a load, store or atomic is about to access.
+    void trace_retire(const decoded_insn &d, uint32_t insn_pc, uint32_t mem_addr);  //Add an executed instruction to the binary trace.
+    bool csr_op(uint32_t op, uint32_t csr, uint32_t src, bool write, uint32_t &val);  //Read and update a CSR.
+    bool csr_write(uint32_t csr, uint32_t val);         //Write a CSR.
+    void drop_insns(uint32_t addr, uint32_t len);  //Clear the predecoded instructions in a written range.
+    static void set_exec(decoded_insn &d, exec_handler handler, exec_handler trace_handler, const char *mnemonic = nullptr); //Set the handlers of a cache record.
+
+    void exec(uint32_t insn, std::ostream* pos);                        //Execute instruction.
+    template<bool trace> void exec_illegal_insn(const decoded_insn &d, std::ostream* pos); //Illegal Instruction Subroutine.
+    template<bool trace> void exec_lui(const decoded_insn &d, std::ostream* pos);          //Execute lui.
+    template<bool trace> void exec_auipc(const decoded_insn &d, std::ostream* pos);        //Execute auipc.
+    template<bool trace> void exec_jal(const decoded_insn &d, std::ostream* pos);          //Execute jal.
+    template<bool trace> void exec_jalr(const decoded_insn &d, std::ostream* pos);         //Execute jalr.
+
+    template<bool trace> void exec_btype(const decoded_insn &d, std::ostream* pos);        //Execute B Type instruction.
+    template<bool trace> void exec_itype_load(const decoded_insn &d, std::ostream* pos);   //Execute I Type-LOAD instruction.
+    template<bool trace> void exec_stype(const decoded_insn &d, std::ostream* pos);        //Execute S Type instruction.
+    template<bool trace> void exec_itype_alu(const decoded_insn &d, std::ostream* pos);    //Execute I Type-ALU instruction.
+    template<bool trace> void exec_rtype(const decoded_insn &d, std::ostream* pos);        //Execute R Type instruction.
+    template<bool trace> void exec_mtype(const decoded_insn &d, std::ostream* pos);        //Execute RV32M instruction.
+
+    template<bool trace> void exec_ecall(const decoded_insn &d, std::ostream* pos);        //Execute ecall.
+    template<bool trace> void exec_ebreak(const decoded_insn &d, std::ostream* pos);       //Execute ebreak.
+    template<bool trace> void exec_csrrx(const decoded_insn &d, std::ostream* pos);        //Execute csrrx instruction.
+    template<bool trace> void exec_csrrxi(const decoded_insn &d, std::ostream* pos);       //Execute csrrxi instruction.
+    template<bool trace> void exec_amo(const decoded_insn &d, std::ostream* pos);          //Execute LR, SC or AMO instruction.
+
+    std::vector<std::unique_ptr<decoded_insn[]>> icache; //Predecoded instructions, one lazily allocated array per memory page.
+    uint32_t slot_bits = { 2 };                          //Log2 of the bytes per predecoded slot, 1 with RV32C.
+
+    bool shared = { false };                 //Set when other harts on other host threads share memory.
+    std::thread::id owner;                   //Host thread the hart runs on when shared.
+    std::mutex pending_lock;                 //Guards pending.
+    std::vector<std::pair<uint32_t, uint32_t>> pending;  //Writes by other harts not yet applied to the icache.
+    std::atomic<bool> has_pending = { false };           //Set when pending is not empty.
 };
 
 #endif
\ No newline at end of file
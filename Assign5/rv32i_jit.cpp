@@ -0,0 +1,733 @@
+//***************************************************************************
+//
+//  Matt Borek
+//  z1951125
+//  CSCI463-1
+//
+//  I certify that this is my own work and where appropriate an extension
+//  of the starter code provided for the assignment.
+//
+//***************************************************************************
+#include <cstddef>
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "memory.h"
+#include "rv32i_jit.h"
+
+/**
+ * @brief Construct a new translator.
+ *
+ * Map the code buffer. It is never writable and executable at once: it starts out read and execute only,
+ * and translate() opens just the pages it copies a block into for writing. On hosts that are not x86-64,
+ * or if the buffer can not be mapped, nothing is ever translated and the simulator keeps interpreting.
+ *
+ * @param mem_size Size of the memory backing store that translated loads and stores may access directly.
+ */
+rv32i_jit::rv32i_jit(uint32_t mem_size) : mem_size(mem_size)
+{
+#if defined(__x86_64__)
+    void *p = mmap(nullptr, code_capacity, PROT_READ|PROT_EXEC, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if(p != MAP_FAILED)
+    {
+        code = static_cast<uint8_t*>(p);
+    }
+#endif
+}
+
+/**
+ * @brief Destroy the translator and unmap its code buffer.
+ */
+rv32i_jit::~rv32i_jit()
+{
+    if(code)
+    {
+        munmap(code, code_capacity);
+    }
+}
+
+/**
+ * @brief Check if an instruction can be translated.
+ *
+ * Mirrors the decoding in rv32i_hart so that anything it treats as illegal, along with every system
+ * instruction, is left to the interpreter.
+ *
+ * @param insn Instruction to check.
+ * @return true if translate() can emit native code for the instruction.
+ */
+bool rv32i_jit::can_translate(uint32_t insn)
+{
+    uint32_t funct3 = get_funct3(insn);
+    uint32_t funct7 = get_funct7(insn);
+    switch(get_opcode(insn))
+    {
+        default:                return false;
+        case opcode_lui:
+        case opcode_auipc:
+        case opcode_jal:
+        case opcode_jalr:       return true;
+        case opcode_btype:      return funct3 != 0b010 && funct3 != 0b011;
+        case opcode_load_imm:   return funct3 == funct3_lb || funct3 == funct3_lh || funct3 == funct3_lw
+                                    || funct3 == funct3_lbu || funct3 == funct3_lhu;
+        case opcode_stype:      return funct3 == funct3_sb || funct3 == funct3_sh || funct3 == funct3_sw;
+        case opcode_alu_imm:    return funct3 != funct3_srx || funct7 == funct7_sra || funct7 == funct7_srl;
+        case opcode_rtype:      if(funct7 == funct7_muldiv) //Multiplies only, divides need their zero and overflow cases.
+                                {
+                                    return funct3 == funct3_mul || funct3 == funct3_mulh || funct3 == funct3_mulhsu || funct3 == funct3_mulhu;
+                                }
+                                return (funct3 != funct3_add && funct3 != funct3_srx) || funct7 == funct7_add || funct7 == funct7_sub;
+    }
+}
+
+/**
+ * @brief Check if the code buffer ran out of space.
+ *
+ * @return true if a translation was refused for lack of space since the last reset().
+ */
+bool rv32i_jit::is_full() const
+{
+    return full;
+}
+
+/**
+ * @brief Discard all translated code.
+ *
+ * Every block_fn handed out before the reset must be dropped by the caller.
+ */
+void rv32i_jit::reset()
+{
+    code_used = 0;
+    full = false;
+}
+
+/**
+ * @brief Translate a run of instructions.
+ *
+ * Translate the leading translatable instructions of a basic block into one native function. Translation
+ * stops at the first instruction that can not be translated, or after a branch or jump.
+ *
+ * @param addr Address of the first instruction.
+ * @param insns Instructions of the basic block in execution order.
+ * @param count Set to the number of instructions the native function covers.
+ * @return Native function, or nullptr if nothing could be translated.
+ */
+rv32i_jit::block_fn rv32i_jit::translate(uint32_t addr, const std::vector<uint32_t> &insns, uint32_t &count)
+{
+    count = 0;
+    if(!code)
+    {
+        return nullptr;
+    }
+    while(count < insns.size() && can_translate(insns[count]))
+    {
+        ++count;
+    }
+    if(count == 0)
+    {
+        return nullptr;
+    }
+
+    buf.clear();
+    exits.clear();
+
+    //Prologue: save the callee saved registers the block uses and load the context.
+    emit8(0x53);                //push rbx
+    emit8(0x41); emit8(0x54);   //push r12
+    emit8(0x41); emit8(0x55);   //push r13
+    emit8(0x41); emit8(0x56);   //push r14
+    emit8(0x41); emit8(0x57);   //push r15, keeps the stack 16 byte aligned for calls
+    emit_rex(true, rdi, 0, r13); emit8(0x89); emit_modrm_reg(rdi, r13);                                   //mov r13, rdi
+    emit_rex(true, rbx, 0, r13); emit8(0x8b); emit_modrm_disp(rbx, r13, offsetof(context, regs));        //mov rbx, ctx->regs
+    emit_rex(true, r12, 0, r13); emit8(0x8b); emit_modrm_disp(r12, r13, offsetof(context, mem));         //mov r12, ctx->mem
+    emit_rex(true, r14, 0, r13); emit8(0x8b); emit_modrm_disp(r14, r13, offsetof(context, watched));     //mov r14, ctx->watched
+
+    bool ended = false;
+    for(uint32_t i = 0; i < count && !ended; ++i)
+    {
+        uint32_t opcode = get_opcode(insns[i]);
+        translate_insn(addr + i*4, insns[i], i);
+        if(opcode == opcode_btype || opcode == opcode_jal || opcode == opcode_jalr) //Control transfer ends the block.
+        {
+            count = i + 1;
+            ended = true;
+        }
+    }
+    if(!ended) //Fall through to the instruction after the translated run.
+    {
+        emit_store_pc_imm(addr + count*4);
+        emit_exit(count);
+    }
+
+    //Epilogue shared by every exit.
+    for(size_t at : exits)
+    {
+        patch(at);
+    }
+    emit8(0x41); emit8(0x5f);   //pop r15
+    emit8(0x41); emit8(0x5e);   //pop r14
+    emit8(0x41); emit8(0x5d);   //pop r13
+    emit8(0x41); emit8(0x5c);   //pop r12
+    emit8(0x5b);                //pop rbx
+    emit8(0xc3);                //ret
+
+    if(code_used + buf.size() > code_capacity)
+    {
+        full = true;
+        count = 0;
+        return nullptr;
+    }
+
+    uint8_t *fn = code + code_used;
+    if(!protect(code_used, buf.size(), PROT_READ|PROT_WRITE))
+    {
+        count = 0;
+        return nullptr;
+    }
+    memcpy(fn, buf.data(), buf.size());
+    if(!protect(code_used, buf.size(), PROT_READ|PROT_EXEC)) //Leave the pages unusable rather than writable and executable.
+    {
+        protect(code_used, buf.size(), PROT_NONE);
+        full = true;
+        count = 0;
+        return nullptr;
+    }
+    code_used = (code_used + buf.size() + 15) & ~static_cast<size_t>(15); //Keep blocks 16 byte aligned.
+    return reinterpret_cast<block_fn>(fn);
+}
+
+/**
+ * @brief Change the protection of the code buffer pages holding a range.
+ *
+ * @param offset First byte of the range, from the start of the code buffer.
+ * @param len Bytes in the range.
+ * @param prot New protection, PROT_ flags as for mprotect.
+ * @return true if the protection was changed.
+ */
+bool rv32i_jit::protect(size_t offset, size_t len, int prot)
+{
+    static const size_t host_page = sysconf(_SC_PAGESIZE);
+    size_t first = offset & ~(host_page - 1);
+    size_t last = (offset + len + host_page - 1) & ~(host_page - 1);
+    return mprotect(code + first, last - first, prot) == 0;
+}
+
+/**
+ * @brief Emit one instruction.
+ *
+ * @param addr Address of the instruction.
+ * @param insn Instruction to translate.
+ * @param index Position of the instruction in the block.
+ */
+void rv32i_jit::translate_insn(uint32_t addr, uint32_t insn, uint32_t index)
+{
+    uint32_t rd = get_rd(insn);
+    uint32_t rs1 = get_rs1(insn);
+    uint32_t rs2 = get_rs2(insn);
+    uint32_t funct3 = get_funct3(insn);
+
+    switch(get_opcode(insn))
+    {
+        case opcode_lui:
+            emit_mov_imm(rax, get_imm_u(insn));
+            emit_store_guest(rd, rax);
+            break;
+
+        case opcode_auipc:
+            emit_mov_imm(rax, addr + get_imm_u(insn));
+            emit_store_guest(rd, rax);
+            break;
+
+        case opcode_jal:
+            emit_mov_imm(rax, addr + 4);
+            emit_store_guest(rd, rax);
+            emit_store_pc_imm(addr + get_imm_j(insn));
+            emit_exit(index + 1);
+            break;
+
+        case opcode_jalr: //Target is computed before rd is written in case they are the same register.
+            emit_load_guest(rax, rs1);
+            emit_alu_imm(0, rax, get_imm_i(insn));  //add eax, imm
+            emit_alu_imm(4, rax, 0xfffffffe);       //and eax, ~1
+            emit_store_pc_reg(rax);
+            emit_mov_imm(rcx, addr + 4);
+            emit_store_guest(rd, rcx);
+            emit_exit(index + 1);
+            break;
+
+        case opcode_btype:
+        {
+            int cc;
+            switch(funct3)
+            {
+                default:
+                case funct3_beq:    cc = cc_e; break;
+                case funct3_bne:    cc = cc_ne; break;
+                case funct3_blt:    cc = cc_l; break;
+                case funct3_bge:    cc = cc_ge; break;
+                case funct3_bltu:   cc = cc_b; break;
+                case funct3_bgeu:   cc = cc_ae; break;
+            }
+            emit_load_guest(rax, rs1);
+            emit_load_guest(rcx, rs2);
+            emit_alu_reg(0x39, rax, rcx);           //cmp eax, ecx
+            emit_mov_imm(rdx, addr + 4);
+            emit_mov_imm(rsi, addr + get_imm_b(insn));
+            emit_cmov(cc, rdx, rsi);
+            emit_store_pc_reg(rdx);
+            emit_exit(index + 1);
+        }
+        break;
+
+        case opcode_load_imm:
+            translate_load(insn);
+            break;
+
+        case opcode_stype:
+            translate_store(addr, insn, index);
+            break;
+
+        case opcode_alu_imm:
+        {
+            int32_t imm_i = get_imm_i(insn);
+            emit_load_guest(rax, rs1);
+            switch(funct3)
+            {
+                case funct3_add:    emit_alu_imm(0, rax, imm_i); break;
+                case funct3_slt:    emit_alu_imm(7, rax, imm_i); emit_setcc(cc_l, rax); break;
+                case funct3_sltu:   emit_alu_imm(7, rax, imm_i); emit_setcc(cc_b, rax); break;
+                case funct3_xor:    emit_alu_imm(6, rax, imm_i); break;
+                case funct3_or:     emit_alu_imm(1, rax, imm_i); break;
+                case funct3_and:    emit_alu_imm(4, rax, imm_i); break;
+                case funct3_sll:    emit_shift_imm(4, rax, imm_i%XLEN); break;
+                case funct3_srx:    emit_shift_imm(get_funct7(insn) == funct7_sra ? 7 : 5, rax, imm_i%XLEN); break;
+            }
+            emit_store_guest(rd, rax);
+        }
+        break;
+
+        case opcode_rtype:
+            emit_load_guest(rax, rs1);
+            emit_load_guest(rcx, rs2);
+            if(get_funct7(insn) == funct7_muldiv)
+            {
+                emit_mul(funct3);
+                emit_store_guest(rd, rax);
+                break;
+            }
+            switch(funct3)
+            {
+                case funct3_add:    emit_alu_reg(get_funct7(insn) == funct7_sub ? 0x29 : 0x01, rax, rcx); break;
+                case funct3_sll:    emit_shift_cl(4, rax); break;
+                case funct3_slt:    emit_alu_reg(0x39, rax, rcx); emit_setcc(cc_l, rax); break;
+                case funct3_sltu:   emit_alu_reg(0x39, rax, rcx); emit_setcc(cc_b, rax); break;
+                case funct3_xor:    emit_alu_reg(0x31, rax, rcx); break;
+                case funct3_srx:    emit_shift_cl(get_funct7(insn) == funct7_sra ? 7 : 5, rax); break;
+                case funct3_or:     emit_alu_reg(0x09, rax, rcx); break;
+                case funct3_and:    emit_alu_reg(0x21, rax, rcx); break;
+            }
+            emit_store_guest(rd, rax);
+            break;
+    }
+}
+
+/**
+ * @brief Emit a load.
+ *
+ * Loads that lie entirely within memory read the backing store directly, anything else calls the
+ * context's slow path so out of range warnings and zero reads behave exactly as in memory::get8().
+ *
+ * @param insn Load instruction to translate.
+ */
+void rv32i_jit::translate_load(uint32_t insn)
+{
+    uint32_t funct3 = get_funct3(insn);
+    uint32_t width = 1 << (funct3 & 0x3);
+
+    emit_load_guest(rax, get_rs1(insn));
+    emit_alu_imm(0, rax, get_imm_i(insn));          //add eax, imm
+    size_t to_slow;
+    if(mem_size >= width)
+    {
+        emit_alu_imm(7, rax, mem_size - width);     //cmp eax, size - width
+        to_slow = emit_jcc(cc_a);
+    }
+    else
+    {
+        to_slow = emit_jmp();
+    }
+
+    switch(funct3) //op ecx, [r12 + rax]
+    {
+        case funct3_lb:     emit_rex(false, rcx, rax, r12); emit8(0x0f); emit8(0xbe); break;
+        case funct3_lh:     emit_rex(false, rcx, rax, r12); emit8(0x0f); emit8(0xbf); break;
+        case funct3_lw:     emit_rex(false, rcx, rax, r12); emit8(0x8b); break;
+        case funct3_lbu:    emit_rex(false, rcx, rax, r12); emit8(0x0f); emit8(0xb6); break;
+        case funct3_lhu:    emit_rex(false, rcx, rax, r12); emit8(0x0f); emit8(0xb7); break;
+    }
+    emit_modrm_sib(rcx, r12, rax);
+    size_t to_done = emit_jmp();
+
+    patch(to_slow);
+    emit_alu_reg(0x89, rsi, rax);                   //mov esi, eax
+    emit_mov_imm(rdx, funct3);
+    emit_rex(true, r13, 0, rdi); emit8(0x89); emit_modrm_reg(r13, rdi); //mov rdi, r13
+    emit_call_ctx(offsetof(context, load));
+    emit_alu_reg(0x89, rcx, rax);                   //mov ecx, eax
+
+    patch(to_done);
+    emit_store_guest(get_rd(insn), rcx);
+}
+
+/**
+ * @brief Emit a store.
+ *
+ * Stores that lie entirely within memory and whose first and last bytes both land on unwatched pages write
+ * the backing store directly, so a misaligned store running onto a page of code is caught too.
+ * Anything else calls the context's slow path, and if that overwrote code the block exits right after
+ * the store so the simulator can drop stale translations.
+ *
+ * @param addr Address of the store instruction.
+ * @param insn Store instruction to translate.
+ * @param index Position of the instruction in the block.
+ */
+void rv32i_jit::translate_store(uint32_t addr, uint32_t insn, uint32_t index)
+{
+    uint32_t funct3 = get_funct3(insn);
+    uint32_t width = 1 << (funct3 & 0x3);
+
+    emit_load_guest(rax, get_rs1(insn));
+    emit_alu_imm(0, rax, get_imm_s(insn));          //add eax, imm
+    emit_load_guest(rdx, get_rs2(insn));
+    size_t to_slow;
+    size_t to_slow_watched = 0;
+    size_t to_slow_watched_end = 0;
+    bool inline_path = mem_size >= width;
+    if(inline_path)
+    {
+        emit_alu_imm(7, rax, mem_size - width);     //cmp eax, size - width
+        to_slow = emit_jcc(cc_a);
+        emit_alu_reg(0x89, rcx, rax);               //mov ecx, eax
+        emit_shift_imm(5, rcx, memory::page_bits);  //shr ecx, page_bits
+        emit_rex(false, 0, rcx, r14); emit8(0x80); emit_modrm_sib(7, r14, rcx); emit8(0); //cmp byte [r14 + rcx], 0
+        to_slow_watched = emit_jcc(cc_ne);
+        if(width > 1)
+        {
+            emit_alu_reg(0x89, rcx, rax);               //mov ecx, eax
+            emit_alu_imm(0, rcx, width - 1);            //add ecx, width - 1
+            emit_shift_imm(5, rcx, memory::page_bits);  //shr ecx, page_bits
+            emit_rex(false, 0, rcx, r14); emit8(0x80); emit_modrm_sib(7, r14, rcx); emit8(0); //cmp byte [r14 + rcx], 0
+            to_slow_watched_end = emit_jcc(cc_ne);
+        }
+    }
+    else
+    {
+        to_slow = emit_jmp();
+    }
+
+    switch(funct3) //mov [r12 + rax], dl/dx/edx
+    {
+        case funct3_sb:     emit_rex(false, rdx, rax, r12); emit8(0x88); break;
+        case funct3_sh:     emit8(0x66); emit_rex(false, rdx, rax, r12); emit8(0x89); break;
+        case funct3_sw:     emit_rex(false, rdx, rax, r12); emit8(0x89); break;
+    }
+    emit_modrm_sib(rdx, r12, rax);
+    size_t to_done = emit_jmp();
+
+    patch(to_slow);
+    if(inline_path)
+    {
+        patch(to_slow_watched);
+        if(width > 1)
+        {
+            patch(to_slow_watched_end);
+        }
+    }
+    emit_alu_reg(0x89, rsi, rax);                   //mov esi, eax
+    emit_mov_imm(rcx, funct3);
+    emit_rex(true, r13, 0, rdi); emit8(0x89); emit_modrm_reg(r13, rdi); //mov rdi, r13
+    emit_call_ctx(offsetof(context, store));
+    emit_alu_reg(0x85, rax, rax);                   //test eax, eax
+    size_t to_unmodified = emit_jcc(cc_e);
+    emit_store_pc_imm(addr + 4);
+    emit_exit(index + 1);
+
+    patch(to_done);
+    patch(to_unmodified);
+}
+
+/**
+ * @brief Emit a return to the simulator.
+ *
+ * @param count Number of instructions executed when this exit is taken.
+ */
+void rv32i_jit::emit_exit(uint32_t count)
+{
+    emit_mov_imm(rax, count);
+    exits.push_back(emit_jmp());
+}
+
+void rv32i_jit::emit8(uint8_t b)
+{
+    buf.push_back(b);
+}
+
+void rv32i_jit::emit32(uint32_t v)
+{
+    for(int i = 0; i < 4; ++i)
+    {
+        emit8(v >> (i*8));
+    }
+}
+
+/**
+ * @brief Emit a REX prefix if one is needed.
+ *
+ * @param w Use a 64 bit operand size.
+ * @param reg Register in the ModRM reg field.
+ * @param index Register in the SIB index field.
+ * @param base Register in the ModRM rm or SIB base field.
+ */
+void rv32i_jit::emit_rex(bool w, int reg, int index, int base)
+{
+    uint8_t rex = 0x40 | (w << 3) | ((reg & 8) >> 1) | ((index & 8) >> 2) | ((base & 8) >> 3);
+    if(rex != 0x40)
+    {
+        emit8(rex);
+    }
+}
+
+void rv32i_jit::emit_modrm_reg(int reg, int rm)
+{
+    emit8(0xc0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+/**
+ * @brief Emit a [base + disp32] operand.
+ */
+void rv32i_jit::emit_modrm_disp(int reg, int base, int32_t disp)
+{
+    emit8(0x80 | ((reg & 7) << 3) | (base & 7));
+    if((base & 7) == rsp) //rsp and r12 need a SIB byte.
+    {
+        emit8(0x24);
+    }
+    emit32(disp);
+}
+
+/**
+ * @brief Emit a [base + index] operand. The base must not be rbp or r13.
+ */
+void rv32i_jit::emit_modrm_sib(int reg, int base, int index)
+{
+    emit8(0x04 | ((reg & 7) << 3));
+    emit8(((index & 7) << 3) | (base & 7));
+}
+
+/**
+ * @brief Emit a load of a guest xregister into a 32 bit host register.
+ */
+void rv32i_jit::emit_load_guest(int host, uint32_t xreg)
+{
+    if(xreg == 0)
+    {
+        emit_alu_reg(0x31, host, host); //xor host, host
+        return;
+    }
+    emit_rex(false, host, 0, rbx);
+    emit8(0x8b);
+    emit_modrm_disp(host, rbx, xreg*4);
+}
+
+/**
+ * @brief Emit a store of a 32 bit host register into a guest xregister. Writes to x0 are dropped.
+ */
+void rv32i_jit::emit_store_guest(uint32_t xreg, int host)
+{
+    if(xreg == 0)
+    {
+        return;
+    }
+    emit_rex(false, host, 0, rbx);
+    emit8(0x89);
+    emit_modrm_disp(host, rbx, xreg*4);
+}
+
+void rv32i_jit::emit_mov_imm(int host, uint32_t imm)
+{
+    emit_rex(false, 0, 0, host);
+    emit8(0xb8 + (host & 7));
+    emit32(imm);
+}
+
+/**
+ * @brief Emit a group 1 ALU operation with a 32 bit immediate.
+ *
+ * @param digit Operation: 0 add, 1 or, 4 and, 5 sub, 6 xor, 7 cmp.
+ */
+void rv32i_jit::emit_alu_imm(int digit, int host, uint32_t imm)
+{
+    emit_rex(false, 0, 0, host);
+    emit8(0x81);
+    emit_modrm_reg(digit, host);
+    emit32(imm);
+}
+
+/**
+ * @brief Emit a register to register operation of the form "op dst, src".
+ *
+ * @param op Opcode taking r/m32, r32 operands such as 0x01 add or 0x89 mov.
+ */
+void rv32i_jit::emit_alu_reg(uint8_t op, int dst, int src)
+{
+    emit_rex(false, src, 0, dst);
+    emit8(op);
+    emit_modrm_reg(src, dst);
+}
+
+/**
+ * @brief Emit an RV32M multiply of eax by ecx into eax.
+ *
+ * The upper half products sign or zero extend both operands to 64 bits, where one imul gives the exact
+ * product, and keep its high 32 bits.
+ *
+ * @param funct3 funct3_mul, funct3_mulh, funct3_mulhsu or funct3_mulhu.
+ */
+void rv32i_jit::emit_mul(uint32_t funct3)
+{
+    if(funct3 == funct3_mul)
+    {
+        emit8(0x0f); emit8(0xaf); emit_modrm_reg(rax, rcx);            //imul eax, ecx
+        return;
+    }
+    if(funct3 == funct3_mulh || funct3 == funct3_mulhsu)
+    {
+        emit8(0x48); emit8(0x63); emit_modrm_reg(rax, rax);             //movsxd rax, eax
+    }
+    if(funct3 == funct3_mulh)
+    {
+        emit8(0x48); emit8(0x63); emit_modrm_reg(rcx, rcx);             //movsxd rcx, ecx
+    }
+    emit8(0x48); emit8(0x0f); emit8(0xaf); emit_modrm_reg(rax, rcx);    //imul rax, rcx
+    emit8(0x48); emit8(0xc1); emit_modrm_reg(5, rax); emit8(32);        //shr rax, 32
+}
+
+/**
+ * @brief Emit a shift by an immediate.
+ *
+ * @param digit Operation: 4 shl, 5 shr, 7 sar.
+ */
+void rv32i_jit::emit_shift_imm(int digit, int host, uint8_t shamt)
+{
+    emit_rex(false, 0, 0, host);
+    emit8(0xc1);
+    emit_modrm_reg(digit, host);
+    emit8(shamt);
+}
+
+/**
+ * @brief Emit a shift by cl, which the host masks to 5 bits just like RV32I.
+ *
+ * @param digit Operation: 4 shl, 5 shr, 7 sar.
+ */
+void rv32i_jit::emit_shift_cl(int digit, int host)
+{
+    emit_rex(false, 0, 0, host);
+    emit8(0xd3);
+    emit_modrm_reg(digit, host);
+}
+
+/**
+ * @brief Emit a setcc into the low byte of a register and zero extend it.
+ */
+void rv32i_jit::emit_setcc(int cc, int host)
+{
+    bool byte_rex = host >= 4 && host < 8; //spl, bpl, sil and dil are only reachable with a REX prefix.
+    if(byte_rex)
+    {
+        emit8(0x40);
+    }
+    else
+    {
+        emit_rex(false, 0, 0, host);
+    }
+    emit8(0x0f); emit8(0x90 | cc); emit_modrm_reg(0, host);   //setcc host8
+
+    if(byte_rex)
+    {
+        emit8(0x40);
+    }
+    else
+    {
+        emit_rex(false, host, 0, host);
+    }
+    emit8(0x0f); emit8(0xb6); emit_modrm_reg(host, host);     //movzx host32, host8
+}
+
+void rv32i_jit::emit_cmov(int cc, int dst, int src)
+{
+    emit_rex(false, dst, 0, src);
+    emit8(0x0f);
+    emit8(0x40 | cc);
+    emit_modrm_reg(dst, src);
+}
+
+void rv32i_jit::emit_store_pc_imm(uint32_t pc)
+{
+    emit_rex(false, 0, 0, r13);
+    emit8(0xc7);
+    emit_modrm_disp(0, r13, offsetof(context, pc));
+    emit32(pc);
+}
+
+void rv32i_jit::emit_store_pc_reg(int host)
+{
+    emit_rex(false, host, 0, r13);
+    emit8(0x89);
+    emit_modrm_disp(host, r13, offsetof(context, pc));
+}
+
+/**
+ * @brief Emit a call through a function pointer held in the context.
+ */
+void rv32i_jit::emit_call_ctx(size_t offset)
+{
+    emit_rex(false, 0, 0, r13);
+    emit8(0xff);
+    emit_modrm_disp(2, r13, offset);
+}
+
+/**
+ * @brief Emit a conditional jump with a 32 bit displacement to be patched later.
+ *
+ * @return Position of the displacement.
+ */
+size_t rv32i_jit::emit_jcc(int cc)
+{
+    emit8(0x0f);
+    emit8(0x80 | cc);
+    emit32(0);
+    return buf.size() - 4;
+}
+
+/**
+ * @brief Emit a jump with a 32 bit displacement to be patched later.
+ *
+ * @return Position of the displacement.
+ */
+size_t rv32i_jit::emit_jmp()
+{
+    emit8(0xe9);
+    emit32(0);
+    return buf.size() - 4;
+}
+
+/**
+ * @brief Point a previously emitted jump at the current end of the block.
+ *
+ * @param at Position of the jump's displacement.
+ */
+void rv32i_jit::patch(size_t at)
+{
+    uint32_t rel = buf.size() - (at + 4);
+    memcpy(&buf[at], &rel, 4);
+}
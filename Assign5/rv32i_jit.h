@@ -0,0 +1,102 @@
+#ifndef H_JIT
+#define H_JIT
+
+//***************************************************************************
+//
+//  Matt Borek
+//  z1951125
+//  CSCI463-1
+//
+//  I certify that this is my own work and where appropriate an extension
+//  of the starter code provided for the assignment.
+//
+//***************************************************************************
+#include <vector>
+#include "rv32i_decode.h"
+
+/**
+ * @brief RV32I to x86-64 Translator
+ *
+ * Translates straight-line runs of RV32I instructions into native x86-64 functions held in an executable buffer.
+ * Guest xregisters stay in the registerfile array and memory accesses use an inline range checked path into
+ * the memory backing store, calling back into the simulator for anything out of range or on a watched page.
+ *
+ */
+class rv32i_jit : public rv32i_decode
+{
+public:
+    /**
+     * @brief Translated Block Context
+     *
+     * Everything a translated block needs, passed as its only argument.
+     */
+    struct context
+    {
+        int32_t *regs;             //Guest xregisters x0..x31.
+        uint8_t *mem;              //Memory backing store.
+        const uint8_t *watched;    //Per-page write watch flags.
+        uint32_t (*load)(context *ctx, uint32_t addr, uint32_t funct3);                //Slow path load, returns the loaded value.
+        uint32_t (*store)(context *ctx, uint32_t addr, uint32_t val, uint32_t funct3); //Slow path store, returns nonzero if code was modified.
+        void *owner;               //Simulator that supplied the slow paths.
+        uint32_t pc;               //Next guest pc, written when a block exits.
+    };
+
+    using block_fn = uint32_t (*)(context *ctx); //Translated block, returns the number of instructions it executed.
+
+    rv32i_jit(uint32_t mem_size);  //Constructor
+    ~rv32i_jit();                  //Destructor
+
+    block_fn translate(uint32_t addr, const std::vector<uint32_t> &insns, uint32_t &count); //Translate a run of instructions.
+    static bool can_translate(uint32_t insn);  //Check if an instruction can be translated.
+    bool is_full() const;                      //Check if the code buffer ran out of space.
+    void reset();                              //Discard all translated code.
+
+private:
+    static constexpr size_t code_capacity = 32 << 20;  //Bytes of executable memory.
+
+    //x86-64 register numbers.
+    static constexpr int rax = 0, rcx = 1, rdx = 2, rbx = 3, rsp = 4, rbp = 5, rsi = 6, rdi = 7;
+    static constexpr int r12 = 12, r13 = 13, r14 = 14, r15 = 15;
+
+    //x86-64 condition codes.
+    static constexpr int cc_b = 0x2, cc_ae = 0x3, cc_e = 0x4, cc_ne = 0x5, cc_a = 0x7, cc_l = 0xc, cc_ge = 0xd;
+
+    void translate_insn(uint32_t addr, uint32_t insn, uint32_t index);  //Emit one instruction.
+    void translate_load(uint32_t insn);                                 //Emit a load.
+    void translate_store(uint32_t addr, uint32_t insn, uint32_t index); //Emit a store.
+    void emit_exit(uint32_t count);                                     //Emit a return to the simulator.
+
+    void emit8(uint8_t b);
+    void emit32(uint32_t v);
+    void emit_rex(bool w, int reg, int index, int base);
+    void emit_modrm_reg(int reg, int rm);
+    void emit_modrm_disp(int reg, int base, int32_t disp);
+    void emit_modrm_sib(int reg, int base, int index);
+
+    void emit_load_guest(int host, uint32_t xreg);
+    void emit_store_guest(uint32_t xreg, int host);
+    void emit_mov_imm(int host, uint32_t imm);
+    void emit_alu_imm(int digit, int host, uint32_t imm);
+    void emit_alu_reg(uint8_t op, int dst, int src);
+    void emit_mul(uint32_t funct3);
+    void emit_shift_imm(int digit, int host, uint8_t shamt);
+    void emit_shift_cl(int digit, int host);
+    void emit_setcc(int cc, int host);
+    void emit_cmov(int cc, int dst, int src);
+    void emit_store_pc_imm(uint32_t pc);
+    void emit_store_pc_reg(int host);
+    void emit_call_ctx(size_t offset);
+    size_t emit_jcc(int cc);
+    size_t emit_jmp();
+    void patch(size_t at);
+    bool protect(size_t offset, size_t len, int prot);  //Change the protection of the code buffer pages holding a range.
+
+    uint32_t mem_size;             //Size of the memory backing store.
+    uint8_t *code = { nullptr };   //Executable code buffer.
+    size_t code_used = { 0 };      //Bytes of the code buffer in use.
+    bool full = { false };         //Set when a translation did not fit.
+    std::vector<uint8_t> buf;      //Code for the block being translated.
+    std::vector<size_t> exits;     //Jumps to patch to the block epilogue.
+};
+
+#endif
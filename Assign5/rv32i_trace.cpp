@@ -0,0 +1,191 @@
+//***************************************************************************
+//
+//  Matt Borek
+//  z1951125
+//  CSCI463-1
+//
+//  I certify that this is my own work and where appropriate an extension
+//  of the starter code provided for the assignment.
+//
+//***************************************************************************
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include "memory.h"
+#include "rv32i_hart.h"
+#include "trace_writer.h"
+
+using std::cerr;
+using std::endl;
+
+/**
+ * @brief Trace Replaying Hart Class
+ *
+ * Renders a binary trace as the -i text by executing each record's instruction on a hart whose registers
+ * follow the trace. Before each instruction the instruction word and any value it loads are placed in
+ * memory, so the hart's own rendering code prints the same operands the traced run did.
+ *
+ */
+class trace_replay : public rv32i_hart
+{
+public:
+    trace_replay(memory &m, const trace_writer::header &h);  //Constructor
+    void replay(const trace_writer::record &r);              //Render one record.
+
+protected:
+    bool csr_read(uint32_t csr, uint32_t &val) const override;  //Read a CSR as the traced run did.
+
+private:
+    void poke(uint32_t addr, uint32_t val, uint32_t width);  //Place a value in memory, if in range.
+
+    const trace_writer::record *current = { nullptr };  //Record being replayed.
+};
+
+/**
+ * @brief Construct a hart in the state the trace started from.
+ *
+ * @param m Memory to replay into, as large as the traced memory.
+ * @param h Trace header.
+ */
+trace_replay::trace_replay(memory &m, const trace_writer::header &h) : rv32i_hart(m)
+{
+    hart_state s;
+    s.pc = h.pc;
+    std::copy(h.regs, h.regs + 32, s.regs);
+    s.insn_counter = h.insn_counter;
+    restore_state(s);
+    set_rvc(h.flags & trace_writer::flag_rvc);
+    set_show_instructions(true);
+}
+
+/**
+ * @brief Render one record.
+ *
+ * @param r Record of an executed instruction.
+ */
+void trace_replay::replay(const trace_writer::record &r)
+{
+    bool compressed = rvc && is_compressed(r.insn);
+    uint32_t insn = compressed ? expand_compressed(r.insn) : r.insn;
+    poke(r.pc, r.insn, compressed ? 2 : 4);
+
+    uint32_t rs1Con = regs.get(get_rs1(insn));
+    switch(get_opcode(insn))
+    {
+        case opcode_load_imm:
+        if(r.mem_addr == rs1Con + get_imm_i(insn)) //Recorded, so it was in range.
+        {
+            poke(r.mem_addr, r.mem_value, 1u << (get_funct3(insn) & 3));
+        }
+        break;
+
+        case opcode_amo:
+        if(get_funct5(insn) == funct5_sc)
+        {
+            if(r.rd_value == 0 && reservation_valid) //Stored, so nothing wrote the word in between.
+            {
+                mem.load_reserved(rs1Con, reservation_ticket); //Forget what the replay itself poked since lr.w.
+            }
+            else
+            {
+                reservation_valid = false; //Failed in the traced run as well.
+            }
+        }
+        else if(get_rd(insn) != 0) //rd holds what memory held.
+        {
+            poke(rs1Con, r.rd_value, 4);
+        }
+        break;
+    }
+
+    pc = r.pc;
+    current = &r;
+    tick();
+    current = nullptr;
+    regs.set(get_rd(insn), r.rd_value); //Keep up with anything else the replay could not reproduce.
+}
+
+/**
+ * @brief Read a CSR as the traced run did.
+ *
+ * Counters such as cycle depend on models the replay does not run, so a CSR read into a register takes the value
+ * recorded for that register.
+ *
+ * @param csr CSR number.
+ * @param val Set to the CSR's value.
+ * @return false if the CSR does not exist.
+ */
+bool trace_replay::csr_read(uint32_t csr, uint32_t &val) const
+{
+    if(!rv32i_hart::csr_read(csr, val))
+    {
+        return false;
+    }
+    if(current && get_rd(current->insn) != 0)
+    {
+        val = current->rd_value;
+    }
+    return true;
+}
+
+/**
+ * @brief Place a value in memory, if in range.
+ *
+ * Out of range addresses are skipped quietly, the replayed instruction prints any warning itself.
+ *
+ * @param addr Address of the first byte.
+ * @param val Value, little endian.
+ * @param width Bytes to place.
+ */
+void trace_replay::poke(uint32_t addr, uint32_t val, uint32_t width)
+{
+    uint8_t bytes[4] = { static_cast<uint8_t>(val), static_cast<uint8_t>(val >> 8), static_cast<uint8_t>(val >> 16), static_cast<uint8_t>(val >> 24) };
+    mem.write_block(addr, bytes, width); //Does nothing out of range.
+}
+
+/**
+ * @brief Print usage statement.
+ *
+ * Print argument usage statements and terminate program.
+ *
+ */
+static void usage()
+{
+    cerr << "Usage: rv32i_trace tracefile" << endl;
+    cerr << "    tracefile is a binary trace written by rv32i -b, printed as rv32i -i would have" << endl;
+    exit(1); //Terminate program.
+}
+
+/**
+ * @brief Main program function.
+ *
+ * Read a binary trace and print every record as an -i trace line.
+ *
+ * @param argc Number of arguments.
+ * @param argv Vector of arguments.
+ * @return 0 on success.
+ */
+int main(int argc, char **argv)
+{
+    if(argc != 2)
+    {
+        usage();
+    }
+
+    std::ifstream in(argv[1], std::ios::binary);
+    trace_writer::header h;
+    if(!in || !trace_writer::read_header(in, h))
+    {
+        cerr << "Can't read trace file '" << argv[1] << "'." << endl;
+        usage();
+    }
+
+    memory mem(h.mem_size);
+    trace_replay hart(mem, h);
+    trace_writer::record r;
+    while(in.read(reinterpret_cast<char*>(&r), sizeof(r)))
+    {
+        hart.replay(r);
+    }
+    return 0;
+}
@@ -0,0 +1,119 @@
+//***************************************************************************
+//
+//  Matt Borek
+//  z1951125
+//  CSCI463-1
+//
+//  I certify that this is my own work and where appropriate an extension
+//  of the starter code provided for the assignment.
+//
+//***************************************************************************
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include "trace_writer.h"
+
+/**
+ * @brief Destroy the trace writer, finishing the file.
+ *
+ */
+trace_writer::~trace_writer()
+{
+    close();
+}
+
+/**
+ * @brief Create the trace file and start draining to it.
+ *
+ * @param fname Name of the file to create.
+ * @param h Header describing the hart's state before the first record.
+ * @return false if the file could not be created.
+ */
+bool trace_writer::open(const std::string &fname, const header &h)
+{
+    out.open(fname, std::ios::binary | std::ios::trunc);
+    if(!out)
+    {
+        return false;
+    }
+    out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    if(!out)
+    {
+        out.close();
+        return false;
+    }
+    ring.reset(new record[capacity]);
+    writer = std::thread(&trace_writer::drain, this);
+    return true;
+}
+
+/**
+ * @brief Drain the remaining records and close the file.
+ *
+ * @return false if any of the file could not be written.
+ */
+bool trace_writer::close()
+{
+    if(writer.joinable())
+    {
+        closing.store(true, std::memory_order_release);
+        writer.join();
+        out.close();
+        failed = failed || !out;
+    }
+    return !failed;
+}
+
+/**
+ * @brief Read and check a trace file header.
+ *
+ * @param is Stream positioned at the start of a trace file.
+ * @param h Header to fill in.
+ * @return false if is does not hold a trace file header.
+ */
+bool trace_writer::read_header(std::istream &is, header &h)
+{
+    char magic[sizeof(h.magic)];
+    std::memcpy(magic, h.magic, sizeof(magic));
+    is.read(reinterpret_cast<char*>(&h), sizeof(h));
+    return is && std::memcmp(magic, h.magic, sizeof(magic)) == 0;
+}
+
+/**
+ * @brief Write records to the file until closed.
+ *
+ * Each pass writes everything put so far, in at most two pieces as the ring wraps, then sleeps briefly if
+ * there was nothing to write. Once a write fails the records are still taken, so put() never waits on a
+ * file that can not be written.
+ *
+ */
+void trace_writer::drain()
+{
+    for(;;)
+    {
+        bool last = closing.load(std::memory_order_acquire); //Read before head, so nothing put before close() is missed.
+        uint64_t t = tail.load(std::memory_order_relaxed);
+        uint64_t h = head.load(std::memory_order_acquire);
+        bool idle = (t == h);
+        while(t != h)
+        {
+            uint64_t first = t & (capacity - 1);
+            uint64_t n = std::min(h - t, capacity - first); //Stop at the end of the ring.
+            if(!failed)
+            {
+                out.write(reinterpret_cast<const char*>(&ring[first]), n * sizeof(record));
+                failed = !out;
+            }
+            t += n;
+            tail.store(t, std::memory_order_release);
+        }
+        if(last)
+        {
+            return;
+        }
+        if(idle)
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    }
+}
@@ -0,0 +1,108 @@
+#ifndef H_TRACE_WRITER
+#define H_TRACE_WRITER
+
+//***************************************************************************
+//
+//  Matt Borek
+//  z1951125
+//  CSCI463-1
+//
+//  I certify that this is my own work and where appropriate an extension
+//  of the starter code provided for the assignment.
+//
+//***************************************************************************
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <fstream>
+#include "hex.h"
+
+/**
+ * @brief Binary Execution Trace Writer Class
+ *
+ * Records one fixed size record per executed instruction into a single producer, single consumer ring
+ * buffer, while a background thread drains the ring to the trace file. The simulator only ever blocks
+ * when the ring is full.
+ *
+ * A trace file is a header holding the hart's state when tracing started followed by the records, all in
+ * host byte order.
+ *
+ */
+class trace_writer : public hex
+{
+public:
+    /**
+     * @brief Trace File Header
+     */
+    struct header
+    {
+        char magic[8] = { 'R', 'V', '3', '2', 'T', 'R', 'C', '1' };  //Identifies a trace file.
+        uint64_t insn_counter = { 0 };   //Instructions executed before the first record.
+        uint32_t mem_size = { 0 };       //Size of the traced memory.
+        uint32_t flags = { 0 };          //flag_rvc if RV32C instructions were fetched.
+        uint32_t pc = { 0 };             //Address of the first instruction.
+        int32_t regs[32] = { 0 };        //xregisters before the first instruction.
+        uint32_t reserved = { 0 };       //Keeps the header free of padding.
+    };
+
+    /**
+     * @brief Executed Instruction
+     */
+    struct record
+    {
+        uint32_t pc;           //Address the instruction was fetched from.
+        uint32_t insn;         //Instruction as fetched, a halfword for RV32C.
+        uint32_t rd_value;     //Contents of rd after the instruction.
+        uint32_t mem_addr;     //Address a load, store or atomic accessed, else zero.
+        uint32_t mem_value;    //Memory at mem_addr after the access, as wide as the access, else zero.
+    };
+
+    static constexpr uint32_t flag_rvc = 1;  //Header flag set when RV32C instructions were fetched.
+
+    trace_writer() = default;  //Constructor
+    ~trace_writer();           //Destructor
+
+    bool open(const std::string &fname, const header &h);  //Create the trace file and start draining to it.
+    bool close();                                          //Drain the remaining records and close the file.
+    void put(const record &r);                             //Add a record, waiting if the ring is full.
+
+    static bool read_header(std::istream &is, header &h);  //Read and check a trace file header.
+
+private:
+    static constexpr uint64_t capacity = 1 << 16;  //Records the ring holds, a power of two.
+
+    void drain();  //Write records to the file until closed.
+
+    std::unique_ptr<record[]> ring;            //Records not yet written.
+    std::atomic<uint64_t> head = { 0 };        //Records put, only advanced by put().
+    std::atomic<uint64_t> tail = { 0 };        //Records written, only advanced by drain().
+    uint64_t tail_seen = { 0 };                //Last tail put() read, so it rarely touches the consumer's line.
+    std::atomic<bool> closing = { false };     //Set when no more records will be put.
+    bool failed = { false };                   //Set by drain() once a write fails, read after it is joined.
+    std::thread writer;                        //Runs drain().
+    std::ofstream out;                         //Trace file.
+};
+
+/**
+ * @brief Add a record, waiting if the ring is full.
+ *
+ * Only the hart that opened the trace may put records.
+ *
+ * @param r Record to add.
+ */
+inline void trace_writer::put(const record &r)
+{
+    uint64_t h = head.load(std::memory_order_relaxed);
+    while(h - tail_seen >= capacity) //Full as far as we know, look again.
+    {
+        tail_seen = tail.load(std::memory_order_acquire);
+        if(h - tail_seen >= capacity)
+        {
+            std::this_thread::yield();
+        }
+    }
+    ring[h & (capacity - 1)] = r;
+    head.store(h + 1, std::memory_order_release);
+}
+
+#endif